@@ -25,6 +25,7 @@
 #define RPU_CPP_FILE
 #include "RPU_Config.h"
 #include "RPU.h"
+#include "RPU_Ring.h"
 
 #define DEBUG_MESSAGES  0
 
@@ -119,11 +120,125 @@ volatile byte DisplayDigits[5][RPU_OS_NUM_DIGITS];
 volatile byte DisplayDigitEnable[5];
 volatile boolean DisplayOffCycle = false;
 volatile byte CurrentDisplayDigit = 0;
-volatile byte LampStates[RPU_NUM_LAMP_BANKS], LampDim1[RPU_NUM_LAMP_BANKS], LampDim2[RPU_NUM_LAMP_BANKS];
-volatile byte LampFlashPeriod[RPU_MAX_LAMPS];
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+// Lamps are triple buffered so a game can compose a whole frame
+// and hand it to the interrupt in one go. The interrupt shows
+// LampFrontBuffer and swaps in LampSpareBuffer (a committed frame)
+// at the start of a strobe cycle. LampStates is whichever buffer
+// lamp writes go to: the back buffer while a frame is open,
+// otherwise the newest committed frame.
+#define LAMP_NUM_FRAME_BUFFERS    3
+volatile byte LampBuffers[LAMP_NUM_FRAME_BUFFERS][RPU_NUM_LAMP_BANKS];
+volatile byte *LampStates = LampBuffers[0];
+volatile byte *LampFrontBuffer = LampBuffers[0];
+volatile byte *LampSpareBuffer = LampBuffers[1];
+volatile byte *LampBackBuffer = LampBuffers[2];
+volatile boolean LampFramePending = false;
+boolean LampFrameOpen = false;
+#else
+volatile byte LampStates[RPU_NUM_LAMP_BANKS];
+#endif
+volatile byte LampDim1[RPU_NUM_LAMP_BANKS], LampDim2[RPU_NUM_LAMP_BANKS];
+
+// Flashing lamps are kept in groups that share a period and
+// phase offset. A group only does any arithmetic when it crosses
+// a half-period boundary, and then it flips all of its lamps
+// with one mask per lamp bank.
+#ifndef RPU_NUM_LAMP_FLASH_GROUPS
+#define RPU_NUM_LAMP_FLASH_GROUPS     12
+#endif
+#define LAMP_FLASH_GROUP_NONE         0xFF
+struct LampFlashGroup {
+  unsigned short period;
+  unsigned short phaseOffset;
+  unsigned long nextToggle;
+  byte numLamps;
+  boolean lampsOn;
+  boolean needsSync;
+  byte lampMask[RPU_NUM_LAMP_BANKS];
+};
+LampFlashGroup LampFlashGroups[RPU_NUM_LAMP_FLASH_GROUPS];
+byte LampFlashGroupNum[RPU_MAX_LAMPS];
+unsigned short LampFlashGroupOverflows = 0;
 byte DimDivisor1 = 2;
 byte DimDivisor2 = 3;
 
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+// Lamp PWM is shown over a frame of 12 lamp passes (one pass is a
+// sweep of all the banks, ~16.6 ms). Every level is lit in evenly
+// spaced passes - 1/4, 1/3, 1/2, 2/3 or 3/4 of them - so the slowest
+// any lamp blinks is every 4th pass (15 Hz), and the old dim divisors
+// of 2 and 3 give the same pattern they always did. Bit-angle
+// modulation would need 15 passes (~250 ms) for 4 bits, which blinks
+// visibly at the low levels. LampPWMOffSlots[n] has a bit set for each
+// lamp that has to be dark in pass n.
+#define LAMP_PWM_FRAME_PASSES   12
+volatile byte LampPWMOffSlots[LAMP_PWM_FRAME_PASSES][RPU_NUM_LAMP_BANKS];
+// The passes each PWM level is lit for (bit n = pass n)
+const unsigned short LampPWMLevelPasses[RPU_LAMP_PWM_FULL + 1] = {
+  0x0000, 0x0111, 0x0249, 0x0555, 0x06DB, 0x0777, 0x0FFF
+};
+byte LampPWMLevel[RPU_MAX_LAMPS];
+byte LampShownPWMLevel[RPU_MAX_LAMPS];
+#endif
+
+// Lamp animation player - frames stay in PROGMEM and are 8 banks
+// (64 lamps) a step on every board. The animation is an overlay on
+// the lamp buffers: lamps it has turned on or off (through the trail)
+// are forced that way until the animation stops. On arch >= 10 the
+// interrupt steps it, everywhere else RPU_Update does.
+#define LAMP_ANIMATION_BANKS    8
+const byte *LampAnimationFrames = NULL;
+byte LampAnimationNumSteps = 0;
+byte LampAnimationSubOffset = 0;
+byte LampAnimationFlags = 0;
+unsigned short LampAnimationStepMS = 0;
+volatile byte LampAnimationStep = 0;
+volatile boolean LampAnimationActive = false;
+byte LampAnimationKeepMask[LAMP_ANIMATION_BANKS];
+volatile byte LampAnimationOnMask[RPU_NUM_LAMP_BANKS];
+volatile byte LampAnimationOffMask[RPU_NUM_LAMP_BANKS];
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+// Steps are timed in timer counts and the remainder carries over,
+// so steps average stepMS instead of rounding to whole ticks
+#define LAMP_ANIMATION_COUNTS_PER_MS  (F_CPU / 1000UL)
+#define LAMP_ANIMATION_TICK_COUNTS    (2UL * (INTERRUPT_OCR1A_COUNTER + 1))
+unsigned long LampAnimationStepCounts = LAMP_ANIMATION_TICK_COUNTS;
+volatile unsigned long LampAnimationCounts = 0;
+#else
+unsigned long LampAnimationStartTime = 0;
+unsigned short LampAnimationStartPhase = 0;
+byte LampAnimationFirstStep = 0;
+#endif
+
+// Lamp layers - the ordinary lamp buffers are the base layer, and the
+// mode, animation and override layers are overlays stacked on it in
+// priority order (see RPU_SetLampLayerPriority). A layer only decides
+// the lamps in its owner mask. Layers are blended into an on/off
+// overlay (per bank, only where something changed). On arch >= 10
+// the interrupt stacks the overlays, everywhere else RPU_Update
+// writes them into the lamp states.
+#define LAMP_NUM_COMPOSITOR_LAYERS  2
+struct LampLayer {
+  byte ownerMask[RPU_NUM_LAMP_BANKS];
+  byte onMask[RPU_NUM_LAMP_BANKS];
+  byte flashMask[RPU_NUM_LAMP_BANKS];
+  unsigned short flashPeriod;
+  unsigned long nextFlashToggle;
+  boolean flashOn;
+  unsigned short changedBanks;
+};
+LampLayer LampLayers[LAMP_NUM_COMPOSITOR_LAYERS];
+volatile byte LampLayerOnMask[LAMP_NUM_COMPOSITOR_LAYERS][RPU_NUM_LAMP_BANKS];
+volatile byte LampLayerOffMask[LAMP_NUM_COMPOSITOR_LAYERS][RPU_NUM_LAMP_BANKS];
+// Overlays are mode, animation, override (RPU_LAMP_LAYER_MODE onwards).
+// The mask pointers are kept sorted lowest priority first.
+#define LAMP_NUM_OVERLAYS           3
+#define LAMP_DEFAULT_PRIORITY(o)    ((o) + 1)
+byte LampOverlayPriority[LAMP_NUM_OVERLAYS] = {LAMP_DEFAULT_PRIORITY(0), LAMP_DEFAULT_PRIORITY(1), LAMP_DEFAULT_PRIORITY(2)};
+volatile byte *LampOverlayOnMasks[LAMP_NUM_OVERLAYS] = {LampLayerOnMask[0], LampAnimationOnMask, LampLayerOnMask[1]};
+volatile byte *LampOverlayOffMasks[LAMP_NUM_OVERLAYS] = {LampLayerOffMask[0], LampAnimationOffMask, LampLayerOffMask[1]};
+
 #if (RPU_OS_HARDWARE_REV==200)
 volatile byte OldLampStates[RPU_NUM_LAMP_BANKS];
 unsigned long LISYLastWatchdog = 0;
@@ -145,47 +260,138 @@ volatile byte SwitchesMinus2[NUM_SWITCH_BYTES];
 volatile byte SwitchesMinus1[NUM_SWITCH_BYTES];
 volatile byte SwitchesNow[NUM_SWITCH_BYTES];
 byte SwitchInverter[NUM_SWITCH_BYTES] = {0x00};
+byte SwitchOpenEventMask[NUM_SWITCH_BYTES] = {0x00};
+// Switches queued in the priority lane (see RPU_SetSwitchPriority)
+byte SwitchPriorityMask[NUM_SWITCH_BYTES] = {0x00};
+
+#if (RPU_MPU_ARCHITECTURE>=10)
+// Debounce is done with a 3-bit counter per switch, stored as bit
+// planes ([0] = bit 0 of every switch's count) so the ISR can run
+// all eight switches of a column at once without branching
+volatile byte SwitchesDebounced[NUM_SWITCH_BYTES];
+byte SwitchDebounceCount[3][NUM_SWITCH_BYTES];
+byte SwitchClosedSamples[3][NUM_SWITCH_BYTES];
+byte SwitchOpenSamples[3][NUM_SWITCH_BYTES];
+#endif
 
 #ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
 #define MAX_IMMEDIATE_STREAMLINED_SOLENOIDS     10
 byte ImmediateSolenoidSwitchByte[MAX_IMMEDIATE_STREAMLINED_SOLENOIDS]; // Can't imagine more than 10 immediate solenoids
 byte ImmediateSolenoidSwitchFlag[MAX_IMMEDIATE_STREAMLINED_SOLENOIDS]; // Can't imagine more than 10 immediate solenoids
 byte ImmediateSolenoidSwitchMask[NUM_SWITCH_BYTES];
+byte NumImmediateSolenoids = 0;
+#if (RPU_MPU_ARCHITECTURE>=10)
+// A coil fired from the switch interrupt won't fire again
+// until this many ms after its last pulse (per coil)
+volatile unsigned long ImmediateSolenoidLastFired[RPU_NUM_SOLENOIDS];
+byte ImmediateSolenoidHoldoff[RPU_NUM_SOLENOIDS];
+#endif
 #endif
 
 #ifdef RPU_OS_USE_DIP_SWITCHES
 byte DipSwitches[4];
 #endif
 
-#if (RPU_OS_HARDWARE_REV>2)
-#define SOLENOID_STACK_SIZE 150
+// The queues below are RPU_Rings, so their sizes are powers of two
+#if (RPU_MPU_ARCHITECTURE>=10 && RPU_OS_HARDWARE_REV<200)
+// Each entry is a whole pulse (see pulseTicks)
+#define SOLENOID_STACK_SIZE 32
+#elif (RPU_OS_HARDWARE_REV>2)
+#define SOLENOID_STACK_SIZE 128
 #else
-#define SOLENOID_STACK_SIZE 60
+#define SOLENOID_STACK_SIZE 64
 #endif
 #define SOLENOID_STACK_EMPTY 0xFF
-volatile byte SolenoidStackFirst;
-volatile byte SolenoidStackLast;
-volatile byte SolenoidStack[SOLENOID_STACK_SIZE];
+struct SolenoidStackEntry {
+  byte solenoidNum;
+#if (RPU_MPU_ARCHITECTURE>=10 && RPU_OS_HARDWARE_REV<200)
+  byte pulseTicks;
+#endif
+};
+// Pushed by the loop (with interrupts off) and by the switch
+// interrupt, pulled by the interrupt
+RPU_Ring<SolenoidStackEntry, SOLENOID_STACK_SIZE> SolenoidStack;
+#if (RPU_MPU_ARCHITECTURE>=10 && RPU_OS_HARDWARE_REV<200)
+// Pulse widths are in solenoid ticks (every other interrupt, ~2 ms).
+// The ISR starts one queued pulse per tick and then counts down
+// every running coil, so coils can overlap.
+volatile byte SolenoidPulseTicks[RPU_NUM_SOLENOIDS];
+volatile unsigned long SolenoidPulseBits = 0;
+byte SolenoidDefaultPulseTicks[RPU_NUM_SOLENOIDS];
+// Solenoids 16-21 are driven by CA2/CB2 control lines
+byte SpecialSolenoidsOn = 0x3F;
+
+// Coil governor - a pulse that would go over a coil's limits
+// is parked in SolenoidPendingTicks until it's allowed to start.
+// Heat is a leaky bucket: each tick on adds (100-maxDuty),
+// each tick off drains maxDuty.
+#define SOLENOID_HEAT_LIMIT             6400
+#define RPU_NUM_SOLENOID_POWER_GROUPS   4
+byte SolenoidMaxDuty[RPU_NUM_SOLENOIDS];
+byte SolenoidMinRefireTicks[RPU_NUM_SOLENOIDS];
+byte SolenoidPowerGroup[RPU_NUM_SOLENOIDS];
+byte PowerGroupMaxActive[RPU_NUM_SOLENOID_POWER_GROUPS];
+volatile byte PowerGroupActive[RPU_NUM_SOLENOID_POWER_GROUPS];
+volatile unsigned short SolenoidHeat[RPU_NUM_SOLENOIDS];
+volatile byte SolenoidRefireTicksLeft[RPU_NUM_SOLENOIDS];
+volatile byte SolenoidPendingTicks[RPU_NUM_SOLENOIDS];
+volatile unsigned long SolenoidPendingBits = 0;
+volatile unsigned long SolenoidCoolingBits = 0;
+volatile unsigned short SolenoidDeferrals = 0;
+
+// Continuous solenoids can be held with an 8-tick on/off pattern
+byte ContinuousSolenoidPWM[16];
+unsigned short ContinuousSolenoidPWMBits = 0;
+volatile byte SolenoidPWMPhase = 0;
+#endif
 boolean SolenoidStackEnabled = true;
 volatile byte CurrentSolenoidByte = 0xFF;
 volatile byte RevertSolenoidBit = 0x00;
 volatile byte NumCyclesBeforeRevertingSolenoidByte = 0;
 
-#define TIMED_SOLENOID_STACK_SIZE 30
-struct TimedSolenoidEntry {
-  byte inUse;
+// Timed stacks are kept sorted by deadline, latest first, so the
+// next entry due is always the last one (and equal deadlines come
+// out in the order they were pushed)
+struct TimedStackEntry {
   unsigned long pushTime;
-  byte solenoidNumber;
+  unsigned short itemNumber;
   byte numPushes;
   byte disableOverride;
 };
-TimedSolenoidEntry TimedSolenoidStack[TIMED_SOLENOID_STACK_SIZE] = {0, 0, 0, 0, 0};
 
-#define SWITCH_STACK_SIZE   60
+struct TimedStack {
+  TimedStackEntry *entries;
+  byte size;
+  byte count;
+  unsigned short overflows;
+};
+
+#define TIMED_SOLENOID_STACK_SIZE 30
+TimedStackEntry TimedSolenoidEntries[TIMED_SOLENOID_STACK_SIZE];
+TimedStack TimedSolenoidStack = {TimedSolenoidEntries, TIMED_SOLENOID_STACK_SIZE, 0, 0};
+
+#define SWITCH_STACK_SIZE   64
 #define SWITCH_STACK_EMPTY  0xFF
-volatile byte SwitchStackFirst;
-volatile byte SwitchStackLast;
-volatile byte SwitchStack[SWITCH_STACK_SIZE];
+// Opened events are stored with the high bit set
+#define SWITCH_STACK_OPENED_FLAG  0x80
+struct SwitchStackEntry {
+  byte switchNum;
+  unsigned long eventTime;
+};
+// Pushed by the interrupt (and by the loop with interrupts off),
+// pulled by the loop. Priority switches have their own lane, which
+// is pulled first, so a flood of playfield switches can't hold them
+// up or push them out.
+RPU_Ring<SwitchStackEntry, SWITCH_STACK_SIZE> SwitchStack;
+#define PRIORITY_SWITCH_STACK_SIZE  16
+RPU_Ring<SwitchStackEntry, PRIORITY_SWITCH_STACK_SIZE> PrioritySwitchStack;
+// Set (by the pusher) when a priority switch didn't fit in its lane
+// and went in the ordinary one. Priority switches keep going there
+// until it's empty, so a switch's events never get pulled out of order.
+volatile boolean PrioritySwitchesSpilled = false;
+// Priority switches that went in the ordinary lane (the lane's
+// overflows only counts the ones that were dropped)
+volatile unsigned short PrioritySwitchSpills = 0;
 
 
 // The WTYPE1 and WTYPE2 sound cards can only play one sound at a time,
@@ -198,18 +404,12 @@ volatile byte SwitchStack[SWITCH_STACK_SIZE];
 
 #define SOUND_STACK_SIZE  64
 #define SOUND_STACK_EMPTY 0x0000
-volatile byte SoundStackFirst;
-volatile byte SoundStackLast;
-volatile unsigned short SoundStack[SOUND_STACK_SIZE];
+// Pushed by the loop, pulled by the interrupt
+RPU_Ring<unsigned short, SOUND_STACK_SIZE> SoundStack;
 
 #define TIMED_SOUND_STACK_SIZE  20
-struct TimedSoundEntry {
-  byte inUse;
-  unsigned long pushTime;
-  unsigned short soundNumber;
-  byte numPushes;
-};
-TimedSoundEntry TimedSoundStack[TIMED_SOUND_STACK_SIZE] = {0, 0, 0, 0};
+TimedStackEntry TimedSoundEntries[TIMED_SOUND_STACK_SIZE];
+TimedStack TimedSoundStack = {TimedSoundEntries, TIMED_SOUND_STACK_SIZE, 0, 0};
 #endif
 
 #if (RPU_OS_HARDWARE_REV==1)
@@ -1075,6 +1275,101 @@ byte RPU_DataRead(int address) {
   return inputData;
 }
 
+// REVISION 101/102 HARDWARE
+// Runs the same bus cycle as RPU_DataWrite/RPU_DataRead for each
+// operation, but the data direction, R/W and address bytes are only
+// changed when the next operation needs them to be (VMA is off
+// between cycles, so nothing is selected while they're left up).
+// The address lines are cleared once at the end.
+//
+// Port register accesses per bus access, counted in the host build
+// (6802/8 clock path) for the interrupt's own batches:
+//   RPU_DataWrite/RPU_DataRead one at a time   23.0-23.4
+//   RPU_DataTransaction                        17.8-19.3
+// That's 608 -> 474 for the 26 accesses of a full tick (display,
+// scan and solenoids). The settle time is unchanged: each switch
+// column still waits RPU_BUS_SETTLE_MICROSECONDS between its strobe
+// and its read, 96 us a scan, as the single calls did (see
+// RPU_SPLIT_SWITCH_SCAN for overlapping it with other work).
+void RPU_DataTransaction(RPU_BusOperation *operations, byte numOperations) {
+  if (numOperations == 0) return;
+
+  byte busReading = 0xFF;
+  byte addressLow = PORTF;
+  byte addressHigh = PORTK;
+  boolean m6800Clock = UsesM6800Processor;
+
+  for (byte opCount = 0; opCount < numOperations; opCount++) {
+    RPU_BusOperation *operation = &operations[opCount];
+    byte readOperation = operation->flags & RPU_BUS_READ;
+
+    if (readOperation != busReading) {
+      busReading = readOperation;
+      if (readOperation) {
+        // Set data pins to input, R/W to HIGH
+        DDRA = 0x00;
+        DDRE = DDRE | 0x20;
+        PORTE = (PORTE | 0x20);
+      } else {
+        // Set data pins to output, R/W to LOW
+        DDRA = 0xFF;
+        PORTE = (PORTE & 0xDF);
+      }
+    }
+    if (!readOperation) PORTA = operation->data;
+
+    // Set up address lines (only the bytes that changed)
+    if ((byte)(operation->address & 0x00FF) != addressLow) {
+      addressLow = (byte)(operation->address & 0x00FF);
+      PORTF = addressLow;
+    }
+    if ((byte)(operation->address / 256) != addressHigh) {
+      addressHigh = (byte)(operation->address / 256);
+      PORTK = addressHigh;
+    }
+
+    if (m6800Clock) {
+      // Wait until clock is high and then
+      // move on after falling edge
+      while (!(PING & 0x04));
+      while ((PING & 0x04));
+    } else {
+      // Set clock low
+      PORTG &= ~0x04;
+    }
+
+    // Pulse VMA over one clock cycle
+    PORTG = PORTG | 0x02;
+
+    if (m6800Clock) {
+      while (!(PING & 0x04));
+      while ((PING & 0x04));
+      while (!(PING & 0x04));
+    } else {
+      PORTG |= 0x04;
+      PORTG &= ~0x04;
+      PORTG |= 0x04;
+    }
+
+    if (readOperation) operation->data = PINA;
+
+    // Set VMA OFF
+    PORTG = PORTG & 0xFD;
+
+    if (operation->flags & RPU_BUS_SETTLE) delayMicroseconds(RPU_BUS_SETTLE_MICROSECONDS);
+  }
+
+  // Leave the bus the way the single calls do
+  PORTF = 0x00;
+  PORTK = 0x00;
+  if (busReading) {
+    PORTE = (PORTE & 0xDF);
+  } else {
+    PORTE = (PORTE | 0x20);
+    DDRA = 0x00;
+  }
+}
+
 #elif (RPU_OS_HARDWARE_REV==200)
 
 #if defined(__AVR_ATmega328P__)
@@ -1113,17 +1408,145 @@ byte RPU_DataRead(int address) { return 0; }
 #error "RPU Hardware Definition Not Recognized"
 #endif
 
+#if (RPU_OS_HARDWARE_REV!=101) && (RPU_OS_HARDWARE_REV!=102)
+// Other boards just run the operations one at a time
+void RPU_DataTransaction(RPU_BusOperation *operations, byte numOperations) {
+  for (byte opCount = 0; opCount < numOperations; opCount++) {
+    if (operations[opCount].flags & RPU_BUS_READ) operations[opCount].data = RPU_DataRead(operations[opCount].address);
+    else RPU_DataWrite(operations[opCount].address, operations[opCount].data);
+    if (operations[opCount].flags & RPU_BUS_SETTLE) delayMicroseconds(RPU_BUS_SETTLE_MICROSECONDS);
+  }
+}
+#endif
+
+
+/******************************************************
+     PIA shadow registers
+*/
+// Every write to a PIA port or control register goes through
+// WritePIARegister, which keeps a copy. Reads that only want back
+// what the firmware wrote (read-modify-write of control bits, port
+// backups) come from the copy - the bus is only read for real inputs
+// and interrupt flags.
+#if (RPU_MPU_ARCHITECTURE<10)
+#define NUM_PIA_SHADOW_REGISTERS    8
+#define PIA_SHADOW_INDEX(address)   ((((address) >= ADDRESS_U11_A) ? 4 : 0) + ((address) & 0x03))
+#else
+// PIAs are at 0x21xx, 0x22xx, 0x24xx, 0x28xx, 0x2Cxx, 0x30xx & 0x34xx
+#define NUM_PIA_SHADOW_REGISTERS    28
+#define PIA_SHADOW_SLOT(highByte)   (((highByte) & 0x03) ? (((highByte) & 0x03) - 1) : ((((highByte) >> 2) & 0x07) + 1))
+#define PIA_SHADOW_INDEX(address)   (PIA_SHADOW_SLOT((address) >> 8) * 4 + ((address) & 0x03))
+#endif
+byte PIAShadowRegisters[NUM_PIA_SHADOW_REGISTERS];
+
+inline void WritePIARegister(int address, byte data) {
+  PIAShadowRegisters[PIA_SHADOW_INDEX(address)] = data;
+  RPU_DataWrite(address, data);
+}
+
+inline byte ReadPIAShadow(int address) {
+  return PIAShadowRegisters[PIA_SHADOW_INDEX(address)];
+}
+
+
+#ifdef RPU_ISR_PROFILER
+/******************************************************
+     Interrupt profiler
+*/
+// Arch >= 10 times with Timer 1 itself (one count per CPU clock,
+// counting up from the compare match). Arch < 10 prescales Timer 1
+// by 1024, so it uses micros() instead.
+#if (RPU_MPU_ARCHITECTURE>=10)
+#define ISR_PROFILE_CLOCK()           ((unsigned short)TCNT1)
+#define ISR_PROFILE_COUNTS_PER_US     (F_CPU / 1000000UL)
+#else
+#define ISR_PROFILE_CLOCK()           ((unsigned short)micros())
+#define ISR_PROFILE_COUNTS_PER_US     1
+#endif
+#define ISR_PROFILE_FIRST_BUCKET_US   16
+
+// Kept in clock counts - RPU_GetISRProfile converts to microseconds
+volatile RPU_ISRPhaseProfile ISRProfiles[RPU_ISR_NUM_PHASES];
+volatile unsigned long ISROverruns = 0;
+
+void RecordISRPhase(byte phase, unsigned short counts) {
+  volatile RPU_ISRPhaseProfile *profile = &ISRProfiles[phase];
+  if (counts < profile->minTime) profile->minTime = counts;
+  if (counts > profile->maxTime) profile->maxTime = counts;
+  profile->samples += 1;
+
+  byte bucket = 0;
+  unsigned short bucketLimit = ISR_PROFILE_FIRST_BUCKET_US * ISR_PROFILE_COUNTS_PER_US;
+  while (bucket < (RPU_ISR_PROFILE_BUCKETS - 1) && counts >= bucketLimit) {
+    bucket += 1;
+    bucketLimit *= 2;
+  }
+  profile->buckets[bucket] += 1;
+}
+
+// Records the time since *phaseStart and starts the next phase
+inline void EndISRPhase(byte phase, unsigned short *phaseStart) {
+  unsigned short now = ISR_PROFILE_CLOCK();
+  RecordISRPhase(phase, now - *phaseStart);
+  *phaseStart = now;
+}
+
+// For a phase done in pieces - adds the time since *phaseStart
+// to *phaseCounts (to be recorded once) and starts the next phase
+inline void AddToISRPhase(unsigned short *phaseCounts, unsigned short *phaseStart) {
+  unsigned short now = ISR_PROFILE_CLOCK();
+  *phaseCounts += (now - *phaseStart);
+  *phaseStart = now;
+}
+
+void RPU_ResetISRProfile() {
+  noInterrupts();
+  for (byte phaseCount = 0; phaseCount < RPU_ISR_NUM_PHASES; phaseCount++) {
+    ISRProfiles[phaseCount].minTime = 0xFFFF;
+    ISRProfiles[phaseCount].maxTime = 0;
+    ISRProfiles[phaseCount].samples = 0;
+    for (byte bucketCount = 0; bucketCount < RPU_ISR_PROFILE_BUCKETS; bucketCount++) ISRProfiles[phaseCount].buckets[bucketCount] = 0;
+  }
+  ISROverruns = 0;
+  interrupts();
+}
+
+boolean RPU_GetISRProfile(byte phase, RPU_ISRPhaseProfile *profile) {
+  if (phase >= RPU_ISR_NUM_PHASES) return false;
+
+  noInterrupts();
+  profile->minTime = ISRProfiles[phase].minTime;
+  profile->maxTime = ISRProfiles[phase].maxTime;
+  profile->samples = ISRProfiles[phase].samples;
+  for (byte bucketCount = 0; bucketCount < RPU_ISR_PROFILE_BUCKETS; bucketCount++) profile->buckets[bucketCount] = ISRProfiles[phase].buckets[bucketCount];
+  interrupts();
+
+  if (profile->samples == 0) profile->minTime = 0;
+  profile->minTime /= ISR_PROFILE_COUNTS_PER_US;
+  profile->maxTime /= ISR_PROFILE_COUNTS_PER_US;
+  return true;
+}
+
+// Missed timer compare matches (the interrupt ran past the next one)
+unsigned long RPU_GetISROverruns() {
+  noInterrupts();
+  unsigned long overruns = ISROverruns;
+  interrupts();
+  return overruns;
+}
+#endif
+
 
 #if (RPU_MPU_ARCHITECTURE<10)
 
 // RPU_MPU_ARCHITECTURE < 10
 void TestLightOn() {
-  RPU_DataWrite(ADDRESS_U11_A_CONTROL, RPU_DataRead(ADDRESS_U11_A_CONTROL) | 0x08);
+  WritePIARegister(ADDRESS_U11_A_CONTROL, ReadPIAShadow(ADDRESS_U11_A_CONTROL) | 0x08);
 }
 
 // RPU_MPU_ARCHITECTURE < 10
 void TestLightOff() {
-  RPU_DataWrite(ADDRESS_U11_A_CONTROL, RPU_DataRead(ADDRESS_U11_A_CONTROL) & 0xF7);
+  WritePIARegister(ADDRESS_U11_A_CONTROL, ReadPIAShadow(ADDRESS_U11_A_CONTROL) & 0xF7);
 }
 
 // RPU_MPU_ARCHITECTURE < 10
@@ -1135,58 +1558,58 @@ void InitializeU10PIA() {
   // PA0-7 - output for switch bank, lamps, and BCD
   // PB0-7 - switch returns
 
-  RPU_DataWrite(ADDRESS_U10_A_CONTROL, 0x38);
+  WritePIARegister(ADDRESS_U10_A_CONTROL, 0x38);
   // Set up U10A as output
-  RPU_DataWrite(ADDRESS_U10_A, 0xFF);
+  WritePIARegister(ADDRESS_U10_A, 0xFF);
   // Set bit 3 to write data
-  RPU_DataWrite(ADDRESS_U10_A_CONTROL, RPU_DataRead(ADDRESS_U10_A_CONTROL) | 0x04);
+  WritePIARegister(ADDRESS_U10_A_CONTROL, ReadPIAShadow(ADDRESS_U10_A_CONTROL) | 0x04);
   // Store F0 in U10A Output
-  RPU_DataWrite(ADDRESS_U10_A, 0xF0);
+  WritePIARegister(ADDRESS_U10_A, 0xF0);
 
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, 0x33);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, 0x33);
   // Set up U10B as input
-  RPU_DataWrite(ADDRESS_U10_B, 0x00);
+  WritePIARegister(ADDRESS_U10_B, 0x00);
   // Set bit 3 so future reads will read data
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) | 0x04);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) | 0x04);
 
 }
 
 #ifdef RPU_OS_USE_DIP_SWITCHES
 // RPU_MPU_ARCHITECTURE < 10
 void ReadDipSwitches() {
-  byte backupU10A = RPU_DataRead(ADDRESS_U10_A);
-  byte backupU10BControl = RPU_DataRead(ADDRESS_U10_B_CONTROL);
+  byte backupU10A = ReadPIAShadow(ADDRESS_U10_A);
+  byte backupU10BControl = ReadPIAShadow(ADDRESS_U10_B_CONTROL);
 
   // Turn on Switch strobe 5 & Read Switches
-  RPU_DataWrite(ADDRESS_U10_A, 0x20);
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, backupU10BControl & 0xF7);
+  WritePIARegister(ADDRESS_U10_A, 0x20);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, backupU10BControl & 0xF7);
   // Wait for switch capacitors to charge
   delayMicroseconds(RPU_OS_SWITCH_DELAY_IN_MICROSECONDS);
   DipSwitches[0] = RPU_DataRead(ADDRESS_U10_B);
 
   // Turn on Switch strobe 6 & Read Switches
-  RPU_DataWrite(ADDRESS_U10_A, 0x40);
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, backupU10BControl & 0xF7);
+  WritePIARegister(ADDRESS_U10_A, 0x40);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, backupU10BControl & 0xF7);
   // Wait for switch capacitors to charge
   delayMicroseconds(RPU_OS_SWITCH_DELAY_IN_MICROSECONDS);
   DipSwitches[1] = RPU_DataRead(ADDRESS_U10_B);
 
   // Turn on Switch strobe 7 & Read Switches
-  RPU_DataWrite(ADDRESS_U10_A, 0x80);
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, backupU10BControl & 0xF7);
+  WritePIARegister(ADDRESS_U10_A, 0x80);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, backupU10BControl & 0xF7);
   // Wait for switch capacitors to charge
   delayMicroseconds(RPU_OS_SWITCH_DELAY_IN_MICROSECONDS);
   DipSwitches[2] = RPU_DataRead(ADDRESS_U10_B);
 
   // Turn on U10 CB2 (strobe 8) and read switches
-  RPU_DataWrite(ADDRESS_U10_A, 0x00);
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, backupU10BControl | 0x08);
+  WritePIARegister(ADDRESS_U10_A, 0x00);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, backupU10BControl | 0x08);
   // Wait for switch capacitors to charge
   delayMicroseconds(RPU_OS_SWITCH_DELAY_IN_MICROSECONDS);
   DipSwitches[3] = RPU_DataRead(ADDRESS_U10_B);
 
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, backupU10BControl);
-  RPU_DataWrite(ADDRESS_U10_A, backupU10A);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, backupU10BControl);
+  WritePIARegister(ADDRESS_U10_A, backupU10A);
 }
 #endif
 
@@ -1199,21 +1622,21 @@ void InitializeU11PIA() {
   // PA0-7 - display digit enable
   // PB0-7 - solenoid data
 
-  RPU_DataWrite(ADDRESS_U11_A_CONTROL, 0x30);
+  WritePIARegister(ADDRESS_U11_A_CONTROL, 0x30);
   // Set up U11A as output
-  RPU_DataWrite(ADDRESS_U11_A, 0xFF);
+  WritePIARegister(ADDRESS_U11_A, 0xFF);
   // Set bit 3 to write data
-  RPU_DataWrite(ADDRESS_U11_A_CONTROL, RPU_DataRead(ADDRESS_U11_A_CONTROL) | 0x04);
+  WritePIARegister(ADDRESS_U11_A_CONTROL, ReadPIAShadow(ADDRESS_U11_A_CONTROL) | 0x04);
   // Store 00 in U11A Output
-  RPU_DataWrite(ADDRESS_U11_A, 0x00);
+  WritePIARegister(ADDRESS_U11_A, 0x00);
 
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, 0x30);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, 0x30);
   // Set up U11B as output
-  RPU_DataWrite(ADDRESS_U11_B, 0xFF);
+  WritePIARegister(ADDRESS_U11_B, 0xFF);
   // Set bit 3 so future reads will read data
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, RPU_DataRead(ADDRESS_U11_B_CONTROL) | 0x04);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, ReadPIAShadow(ADDRESS_U11_B_CONTROL) | 0x04);
   // Store 9F in U11B Output
-  RPU_DataWrite(ADDRESS_U11_B, DEFAULT_SOLENOID_STATE);
+  WritePIARegister(ADDRESS_U11_B, DEFAULT_SOLENOID_STATE);
   CurrentSolenoidByte = DEFAULT_SOLENOID_STATE;
 
 }
@@ -1239,91 +1662,91 @@ unsigned long RPU_TestPIAs() {
 
 // RPU_MPU_ARCHITECTURE >= 10
 void RPU_InitializePIAs() {
-  RPU_DataWrite(PIA_DISPLAY_CONTROL_A, 0x31);
-  RPU_DataWrite(PIA_DISPLAY_PORT_A, 0xFF);
-  RPU_DataWrite(PIA_DISPLAY_CONTROL_A, 0x3D);
-  RPU_DataWrite(PIA_DISPLAY_PORT_A, 0xC0);
-
-  RPU_DataWrite(PIA_DISPLAY_CONTROL_B, 0x31);
-  RPU_DataWrite(PIA_DISPLAY_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_DISPLAY_CONTROL_B, 0x3D);
-  RPU_DataWrite(PIA_DISPLAY_PORT_B, 0x00);
-
-  RPU_DataWrite(PIA_SWITCH_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_SWITCH_PORT_A, 0x00);
-  RPU_DataWrite(PIA_SWITCH_CONTROL_A, 0x3C);
-
-  RPU_DataWrite(PIA_SWITCH_CONTROL_B, 0x38);
-  RPU_DataWrite(PIA_SWITCH_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_SWITCH_CONTROL_B, 0x3C);
-  RPU_DataWrite(PIA_SWITCH_PORT_B, 0x00);
-
-  RPU_DataWrite(PIA_LAMPS_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_LAMPS_PORT_A, 0xFF);
-  RPU_DataWrite(PIA_LAMPS_CONTROL_A, 0x3C);
-  RPU_DataWrite(PIA_LAMPS_PORT_A, 0xFF);
-
-  RPU_DataWrite(PIA_LAMPS_CONTROL_B, 0x38);
-  RPU_DataWrite(PIA_LAMPS_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_LAMPS_CONTROL_B, 0x3C);
-  RPU_DataWrite(PIA_LAMPS_PORT_B, 0x00);
+  WritePIARegister(PIA_DISPLAY_CONTROL_A, 0x31);
+  WritePIARegister(PIA_DISPLAY_PORT_A, 0xFF);
+  WritePIARegister(PIA_DISPLAY_CONTROL_A, 0x3D);
+  WritePIARegister(PIA_DISPLAY_PORT_A, 0xC0);
+
+  WritePIARegister(PIA_DISPLAY_CONTROL_B, 0x31);
+  WritePIARegister(PIA_DISPLAY_PORT_B, 0xFF);
+  WritePIARegister(PIA_DISPLAY_CONTROL_B, 0x3D);
+  WritePIARegister(PIA_DISPLAY_PORT_B, 0x00);
+
+  WritePIARegister(PIA_SWITCH_CONTROL_A, 0x38);
+  WritePIARegister(PIA_SWITCH_PORT_A, 0x00);
+  WritePIARegister(PIA_SWITCH_CONTROL_A, 0x3C);
+
+  WritePIARegister(PIA_SWITCH_CONTROL_B, 0x38);
+  WritePIARegister(PIA_SWITCH_PORT_B, 0xFF);
+  WritePIARegister(PIA_SWITCH_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_SWITCH_PORT_B, 0x00);
+
+  WritePIARegister(PIA_LAMPS_CONTROL_A, 0x38);
+  WritePIARegister(PIA_LAMPS_PORT_A, 0xFF);
+  WritePIARegister(PIA_LAMPS_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_LAMPS_PORT_A, 0xFF);
+
+  WritePIARegister(PIA_LAMPS_CONTROL_B, 0x38);
+  WritePIARegister(PIA_LAMPS_PORT_B, 0xFF);
+  WritePIARegister(PIA_LAMPS_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_LAMPS_PORT_B, 0x00);
 
 #if (RPU_MPU_ARCHITECTURE<15)
-  RPU_DataWrite(PIA_SOLENOID_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_SOLENOID_PORT_A, 0xFF);
-  RPU_DataWrite(PIA_SOLENOID_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_SOLENOID_CONTROL_A, 0x38);
+  WritePIARegister(PIA_SOLENOID_PORT_A, 0xFF);
+  WritePIARegister(PIA_SOLENOID_CONTROL_A, 0x3C);
 #endif
-  RPU_DataWrite(PIA_SOLENOID_PORT_A, 0x00);
+  WritePIARegister(PIA_SOLENOID_PORT_A, 0x00);
 
 #if (RPU_MPU_ARCHITECTURE<15)
-  RPU_DataWrite(PIA_SOLENOID_CONTROL_B, 0x30);
-  RPU_DataWrite(PIA_SOLENOID_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_SOLENOID_CONTROL_B, 0x34);
-  RPU_DataWrite(PIA_SOLENOID_PORT_B, 0x00);
+  WritePIARegister(PIA_SOLENOID_CONTROL_B, 0x30);
+  WritePIARegister(PIA_SOLENOID_PORT_B, 0xFF);
+  WritePIARegister(PIA_SOLENOID_CONTROL_B, 0x34);
+  WritePIARegister(PIA_SOLENOID_PORT_B, 0x00);
 #endif
 
 #if (RPU_MPU_ARCHITECTURE==15)
-  RPU_DataWrite(PIA_SOLENOID_11_CONTROL_B, 0x38);
-  RPU_DataWrite(PIA_SOLENOID_11_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_SOLENOID_11_CONTROL_B, 0x3C);
-  RPU_DataWrite(PIA_SOLENOID_11_PORT_B, 0x00);
-
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_PORT_A, 0xFF);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_CONTROL_A, 0x3C);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_PORT_A, 0x00);
-
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_CONTROL_B, 0x38);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_CONTROL_B, 0x3C);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_PORT_B, 0x00);
-
-  RPU_DataWrite(PIA_NUM_DISPLAY_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_NUM_DISPLAY_PORT_A, 0xFF);
-  RPU_DataWrite(PIA_NUM_DISPLAY_CONTROL_A, 0x3C);
-  RPU_DataWrite(PIA_NUM_DISPLAY_PORT_A, 0x00);
-
-  RPU_DataWrite(PIA_SOUND_11_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_SOUND_11_PORT_A, 0xFF);
-  RPU_DataWrite(PIA_SOUND_11_CONTROL_A, 0x3C);
-  RPU_DataWrite(PIA_SOUND_11_PORT_A, 0x00);
-
-  RPU_DataWrite(PIA_WIDGET_CONTROL_B, 0x38);
-  RPU_DataWrite(PIA_WIDGET_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_WIDGET_CONTROL_B, 0x3C);
-  RPU_DataWrite(PIA_WIDGET_PORT_B, 0x00);
+  WritePIARegister(PIA_SOLENOID_11_CONTROL_B, 0x38);
+  WritePIARegister(PIA_SOLENOID_11_PORT_B, 0xFF);
+  WritePIARegister(PIA_SOLENOID_11_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_SOLENOID_11_PORT_B, 0x00);
+
+  WritePIARegister(PIA_ALPHA_DISPLAY_CONTROL_A, 0x38);
+  WritePIARegister(PIA_ALPHA_DISPLAY_PORT_A, 0xFF);
+  WritePIARegister(PIA_ALPHA_DISPLAY_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_ALPHA_DISPLAY_PORT_A, 0x00);
+
+  WritePIARegister(PIA_ALPHA_DISPLAY_CONTROL_B, 0x38);
+  WritePIARegister(PIA_ALPHA_DISPLAY_PORT_B, 0xFF);
+  WritePIARegister(PIA_ALPHA_DISPLAY_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_ALPHA_DISPLAY_PORT_B, 0x00);
+
+  WritePIARegister(PIA_NUM_DISPLAY_CONTROL_A, 0x38);
+  WritePIARegister(PIA_NUM_DISPLAY_PORT_A, 0xFF);
+  WritePIARegister(PIA_NUM_DISPLAY_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_NUM_DISPLAY_PORT_A, 0x00);
+
+  WritePIARegister(PIA_SOUND_11_CONTROL_A, 0x38);
+  WritePIARegister(PIA_SOUND_11_PORT_A, 0xFF);
+  WritePIARegister(PIA_SOUND_11_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_SOUND_11_PORT_A, 0x00);
+
+  WritePIARegister(PIA_WIDGET_CONTROL_B, 0x38);
+  WritePIARegister(PIA_WIDGET_PORT_B, 0xFF);
+  WritePIARegister(PIA_WIDGET_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_WIDGET_PORT_B, 0x00);
 #endif
 
 #if (RPU_MPU_ARCHITECTURE==13)
-  RPU_DataWrite(PIA_SOUND_COMMA_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_SOUND_COMMA_PORT_A, 0xFF);
-  RPU_DataWrite(PIA_SOUND_COMMA_CONTROL_A, 0x3C);
-  RPU_DataWrite(PIA_SOUND_COMMA_PORT_A, 0x00);
-
-  RPU_DataWrite(PIA_SOUND_COMMA_CONTROL_B, 0x38);
-  RPU_DataWrite(PIA_SOUND_COMMA_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_SOUND_COMMA_CONTROL_B, 0x3C);
-  RPU_DataWrite(PIA_SOUND_COMMA_PORT_B, 0x00);
+  WritePIARegister(PIA_SOUND_COMMA_CONTROL_A, 0x38);
+  WritePIARegister(PIA_SOUND_COMMA_PORT_A, 0xFF);
+  WritePIARegister(PIA_SOUND_COMMA_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_SOUND_COMMA_PORT_A, 0x00);
+
+  WritePIARegister(PIA_SOUND_COMMA_CONTROL_B, 0x38);
+  WritePIARegister(PIA_SOUND_COMMA_PORT_B, 0xFF);
+  WritePIARegister(PIA_SOUND_COMMA_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_SOUND_COMMA_PORT_B, 0x00);
 #endif
 
 }
@@ -1381,6 +1804,48 @@ void RPU_SetBoardLEDs(boolean LED1, boolean LED2, byte BCDValue) {
 #endif
 
 
+/******************************************************
+ * 
+ * 
+ *    Timed Stack Functions
+ *    
+ *    
+*******************************************************/
+
+boolean PushToTimedStack(TimedStack *timedStack, unsigned short itemNumber, byte numPushes, unsigned long pushTime, byte disableOverride) {
+  if (timedStack->count >= timedStack->size) {
+    timedStack->overflows += 1;
+    return false;
+  }
+
+  // Slide everything due at or before this one up a slot
+  // (signed difference so millis() rollover is handled)
+  byte insertIndex = timedStack->count;
+  while (insertIndex > 0 && (long)(timedStack->entries[insertIndex - 1].pushTime - pushTime) <= 0) {
+    timedStack->entries[insertIndex] = timedStack->entries[insertIndex - 1];
+    insertIndex -= 1;
+  }
+
+  timedStack->entries[insertIndex].pushTime = pushTime;
+  timedStack->entries[insertIndex].itemNumber = itemNumber;
+  timedStack->entries[insertIndex].numPushes = numPushes;
+  timedStack->entries[insertIndex].disableOverride = disableOverride;
+  timedStack->count += 1;
+  return true;
+}
+
+// Returns the next entry if it's due (it's removed from the stack,
+// but stays valid until the next push), otherwise NULL
+TimedStackEntry *PullDueFromTimedStack(TimedStack *timedStack, unsigned long curTime) {
+  if (timedStack->count == 0) return NULL;
+  TimedStackEntry *nextEntry = &(timedStack->entries[timedStack->count - 1]);
+  if ((long)(curTime - nextEntry->pushTime) <= 0) return NULL;
+  timedStack->count -= 1;
+  return nextEntry;
+}
+
+
+
 /******************************************************
  * 
  * 
@@ -1389,61 +1854,318 @@ void RPU_SetBoardLEDs(boolean LED1, boolean LED2, byte BCDValue) {
  *    
 *******************************************************/
 
-int SpaceLeftOnSwitchStack() {
-  if (SwitchStackFirst >= SWITCH_STACK_SIZE || SwitchStackLast >= SWITCH_STACK_SIZE) return 0;
-  if (SwitchStackLast >= SwitchStackFirst) return ((SWITCH_STACK_SIZE - 1) - (SwitchStackLast - SwitchStackFirst));
-  return (SwitchStackFirst - SwitchStackLast) - 1;
+boolean IsPrioritySwitch(byte switchNumber) {
+  // Self test is always in the priority lane
+  if (switchNumber == SW_SELF_TEST_SWITCH) return true;
+  byte switchNum = switchNumber & ~SWITCH_STACK_OPENED_FLAG;
+  if (switchNum < MAX_NUM_SWITCHES && (SwitchPriorityMask[switchNum / 8] & (0x01 << (switchNum % 8)))) return true;
+  return false;
 }
 
-void PushToSwitchStack(byte switchNumber) {
-  if (switchNumber == SWITCH_STACK_EMPTY) return;
+// Both lanes are full, so the newest ordinary switch makes way for a
+// priority one. The spilled priority switches after it move up a slot
+// to keep them in order, and the new one goes on the end. The front
+// entry is left alone, as the loop may be reading it. Called by the
+// pusher, like PushToSwitchStack.
+boolean ReplaceNewestOrdinarySwitch(byte switchNumber, unsigned long eventTime) {
+  byte lastPosition = SwitchStack.Count() - 1;
+  for (byte position = lastPosition; position > 0; position--) {
+    if (IsPrioritySwitch(SwitchStack.Peek(position)->switchNum)) continue;
+    for (; position < lastPosition; position++) *SwitchStack.Peek(position) = *SwitchStack.Peek(position + 1);
+    SwitchStackEntry *newEntry = SwitchStack.Peek(lastPosition);
+    newEntry->switchNum = switchNumber;
+    newEntry->eventTime = eventTime;
+    return true;
+  }
+  return false;
+}
 
-  // If the switch stack last index is out of range, then it's an error - return
-  if (SpaceLeftOnSwitchStack() == 0) return;
+// Called from the interrupt (or where there isn't one)
+void PushToSwitchStack(byte switchNumber, unsigned long eventTime) {
+  if (switchNumber == SWITCH_STACK_EMPTY) return;
+  boolean priorityLane = IsPrioritySwitch(switchNumber);
 
   // Self test is a special case - there's no good way to debounce it
-  // so if it's already first on the stack, ignore it
+  // so if it's already last on the stack, ignore it
   if (switchNumber == SW_SELF_TEST_SWITCH) {
-    //if (SwitchStackLast != SwitchStackFirst && SwitchStack[SwitchStackFirst] == SW_SELF_TEST_SWITCH) return;
-    int lastAddedIndex = (SwitchStackLast == 0) ? SWITCH_STACK_SIZE - 1 : SwitchStackLast - 1;
-    if ((SwitchStackLast != SwitchStackFirst) && SwitchStack[lastAddedIndex] == SW_SELF_TEST_SWITCH) return;
+    SwitchStackEntry *lastAdded = PrioritySwitchStack.Back();
+    if (lastAdded && lastAdded->switchNum == SW_SELF_TEST_SWITCH) return;
   }
 
-  SwitchStack[SwitchStackLast] = switchNumber;
-
-  SwitchStackLast += 1;
-  if (SwitchStackLast == SWITCH_STACK_SIZE) {
-    // If the end index is off the end, then wrap
-    SwitchStackLast = 0;
+  // A full priority lane spills the switch into the ordinary lane. If
+  // that's full too, an ordinary switch is dropped to make room - a
+  // priority switch is only dropped if there's no ordinary one left.
+  SwitchStackEntry *newEntry = NULL;
+  boolean prioritySwitch = priorityLane;
+  if (priorityLane && (PrioritySwitchesSpilled || PrioritySwitchStack.Count() >= PRIORITY_SWITCH_STACK_SIZE)) {
+    PrioritySwitchesSpilled = true;
+    PrioritySwitchSpills += 1;
+    priorityLane = false;
+  }
+  if (priorityLane) newEntry = PrioritySwitchStack.Reserve();
+  else newEntry = SwitchStack.Reserve();
+  if (newEntry == NULL) {
+    // (the ordinary lane has already counted the overflow)
+    if (prioritySwitch && !ReplaceNewestOrdinarySwitch(switchNumber, eventTime)) PrioritySwitchStack.overflows += 1;
+    return;
   }
+  newEntry->switchNum = switchNumber;
+  newEntry->eventTime = eventTime;
+  if (priorityLane) PrioritySwitchStack.Publish();
+  else SwitchStack.Publish();
+}
+
+void PushToSwitchStack(byte switchNumber) {
+  PushToSwitchStack(switchNumber, millis());
 }
 
 void RPU_PushToSwitchStack(byte switchNumber) {
-  PushToSwitchStack(switchNumber);
+  // The interrupt pushes too. SREG puts interrupts back the way
+  // they were, so this can be called with them already off.
+  unsigned long eventTime = millis();
+  byte oldSREG = SREG;
+  cli();
+  PushToSwitchStack(switchNumber, eventTime);
+  SREG = oldSREG;
 }
 
-byte RPU_PullFirstFromSwitchStack() {
-  // If first and last are equal, there's nothing on the stack
-  if (SwitchStackFirst == SwitchStackLast) return SWITCH_STACK_EMPTY;
+#ifdef RPU_SWITCH_RECORDER
+/******************************************************
+     Switch recorder
+*/
+const byte SwitchLogHeader[RPU_SWITCH_LOG_HEADER_SIZE] = {'R', 'S', 'W', RPU_SWITCH_LOG_VERSION};
+
+// A replayed closure of a switch that doesn't report openings
+// reads as closed for this long
+#define SWITCH_REPLAY_CLOSED_MS   50
+
+Print *SwitchRecorder = NULL;
+unsigned long SwitchRecorderLastEvent;
+
+Stream *SwitchReplay = NULL;
+byte SwitchReplaySpeed;
+byte SwitchReplayHeaderBytes = 0;
+byte SwitchReplayStateBytes;
+byte SwitchReplayRecord[RPU_SWITCH_LOG_RECORD_SIZE];
+byte SwitchReplayRecordBytes;
+unsigned long SwitchReplayStartTime;
+unsigned long SwitchReplayLogTime;
+byte SwitchReplayStates[RPU_SWITCH_LOG_STATE_SIZE];
+byte SwitchReplayPulsed[RPU_SWITCH_LOG_STATE_SIZE];
+unsigned short SwitchReplayCloseTimes[MAX_NUM_SWITCHES];
+
+void WriteSwitchLogRecord(byte logEvent, unsigned short elapsed) {
+  byte record[RPU_SWITCH_LOG_RECORD_SIZE] = {logEvent, lowByte(elapsed), highByte(elapsed)};
+  SwitchRecorder->write(record, RPU_SWITCH_LOG_RECORD_SIZE);
+}
+
+void RPU_SetSwitchRecorder(Print *switchLog) {
+  SwitchRecorder = switchLog;
+  if (SwitchRecorder == NULL) return;
+  SwitchRecorder->write(SwitchLogHeader, RPU_SWITCH_LOG_HEADER_SIZE);
+  for (byte stateByte = 0; stateByte < RPU_SWITCH_LOG_STATE_SIZE; stateByte++) {
+    byte switchStates = 0;
+    for (byte bitCount = 0; bitCount < 8; bitCount++) {
+      if (RPU_ReadSingleSwitchState(stateByte * 8 + bitCount)) switchStates |= (0x01 << bitCount);
+    }
+    SwitchRecorder->write(switchStates);
+  }
+  SwitchRecorderLastEvent = millis();
+}
+
+void RecordSwitchEvent(byte switchNum, byte eventType, unsigned long eventTime) {
+  // An event that was waiting on the stack when recording
+  // started can be older than the header
+  unsigned long elapsed = 0;
+  if (!((eventTime - SwitchRecorderLastEvent) & 0x80000000)) {
+    elapsed = eventTime - SwitchRecorderLastEvent;
+    SwitchRecorderLastEvent = eventTime;
+  }
+  while (elapsed > 0xFFFF) {
+    WriteSwitchLogRecord(RPU_SWITCH_LOG_GAP, 0xFFFF);
+    elapsed -= 0xFFFF;
+  }
+  WriteSwitchLogRecord(switchNum | ((eventType == SWITCH_EVENT_OPENED) ? RPU_SWITCH_LOG_OPENED_FLAG : 0), elapsed);
+}
+
+boolean RPU_StartSwitchReplay(Stream *switchLog, byte speedMultiple) {
+  // The header can arrive across several calls
+  while (switchLog->available()) {
+    byte nextByte = switchLog->read();
+    if (nextByte == SwitchLogHeader[SwitchReplayHeaderBytes]) SwitchReplayHeaderBytes += 1;
+    else SwitchReplayHeaderBytes = (nextByte == SwitchLogHeader[0]) ? 1 : 0;
+
+    if (SwitchReplayHeaderBytes == RPU_SWITCH_LOG_HEADER_SIZE) {
+      SwitchReplayHeaderBytes = 0;
+      SwitchReplay = switchLog;
+      SwitchReplaySpeed = speedMultiple;
+      SwitchReplayStateBytes = 0;
+      SwitchReplayRecordBytes = 0;
+      SwitchReplayLogTime = 0;
+      for (byte stateByte = 0; stateByte < RPU_SWITCH_LOG_STATE_SIZE; stateByte++) {
+        SwitchReplayStates[stateByte] = 0;
+        SwitchReplayPulsed[stateByte] = 0;
+      }
+      // Echo the header so a sender knows to start
+      SwitchReplay->write(SwitchLogHeader, RPU_SWITCH_LOG_HEADER_SIZE);
+      return true;
+    }
+  }
+  return false;
+}
 
-  byte retVal = SwitchStack[SwitchStackFirst];
+void RPU_StopSwitchReplay() {
+  SwitchReplay = NULL;
+}
+
+boolean RPU_SwitchReplayRunning() {
+  return (SwitchReplay != NULL) ? true : false;
+}
+
+boolean ReadReplaySwitchState(byte switchNum) {
+  byte switchByte = switchNum / 8;
+  byte switchBit = 0x01 << (switchNum % 8);
+  if (!(SwitchReplayStates[switchByte] & switchBit)) return false;
+  if (!(SwitchReplayPulsed[switchByte] & switchBit)) return true;
+  return ((unsigned short)((unsigned short)millis() - SwitchReplayCloseTimes[switchNum]) < SWITCH_REPLAY_CLOSED_MS) ? true : false;
+}
 
-  SwitchStackFirst += 1;
-  if (SwitchStackFirst >= SWITCH_STACK_SIZE) SwitchStackFirst = 0;
+void SetReplaySwitchState(byte switchNum, boolean opened, unsigned long currentTime) {
+  if (switchNum >= MAX_NUM_SWITCHES) return;
+  byte switchByte = switchNum / 8;
+  byte switchBit = 0x01 << (switchNum % 8);
+  if (opened) {
+    SwitchReplayStates[switchByte] &= ~switchBit;
+  } else {
+    SwitchReplayStates[switchByte] |= switchBit;
+    // Without opened events, the log can't say how long it stays closed
+    if (SwitchOpenEventMask[switchByte] & switchBit) SwitchReplayPulsed[switchByte] &= ~switchBit;
+    else SwitchReplayPulsed[switchByte] |= switchBit;
+    SwitchReplayCloseTimes[switchNum] = (unsigned short)currentTime;
+  }
+}
+
+// Pushes the log's events onto the switch stack as they come due
+// (live switches still get through, so keep hands off the machine).
+// Speed 0 hands over the next event whenever the stack is empty.
+void UpdateSwitchReplay(unsigned long currentTime) {
+  if (SwitchReplay == NULL) return;
+
+  // The switch states come before the first event
+  while (SwitchReplayStateBytes < RPU_SWITCH_LOG_STATE_SIZE && SwitchReplay->available()) {
+    SwitchReplayStates[SwitchReplayStateBytes] = SwitchReplay->read();
+    SwitchReplayStateBytes += 1;
+    if (SwitchReplayStateBytes == RPU_SWITCH_LOG_STATE_SIZE) SwitchReplayStartTime = currentTime;
+  }
+  if (SwitchReplayStateBytes < RPU_SWITCH_LOG_STATE_SIZE) return;
+
+  while (SwitchReplay) {
+    while (SwitchReplayRecordBytes < RPU_SWITCH_LOG_RECORD_SIZE && SwitchReplay->available()) {
+      SwitchReplayRecord[SwitchReplayRecordBytes] = SwitchReplay->read();
+      SwitchReplayRecordBytes += 1;
+    }
+    if (SwitchReplayRecordBytes < RPU_SWITCH_LOG_RECORD_SIZE) return;
+
+    unsigned long eventLogTime = SwitchReplayLogTime + ((unsigned short)SwitchReplayRecord[1] | ((unsigned short)SwitchReplayRecord[2] << 8));
+    if (SwitchReplaySpeed) {
+      if ((currentTime - SwitchReplayStartTime) < (eventLogTime / SwitchReplaySpeed)) return;
+    } else if (!SwitchStack.IsEmpty() || !PrioritySwitchStack.IsEmpty()) {
+      return;
+    }
+    SwitchReplayLogTime = eventLogTime;
+    SwitchReplayRecordBytes = 0;
+
+    byte logEvent = SwitchReplayRecord[0];
+    if (logEvent == RPU_SWITCH_LOG_GAP) continue;
+    byte switchNum = logEvent & ~RPU_SWITCH_LOG_OPENED_FLAG;
+    boolean opened = (logEvent & RPU_SWITCH_LOG_OPENED_FLAG) ? true : false;
+    SetReplaySwitchState(switchNum, opened, currentTime);
+    noInterrupts();
+    PushToSwitchStack(opened ? (switchNum | SWITCH_STACK_OPENED_FLAG) : switchNum, currentTime);
+    interrupts();
+  }
+}
+#endif
+
+byte RPU_PullFirstSwitchEvent(RPU_SwitchEvent *switchEvent) {
+  // Priority switches go first
+  boolean priorityLane = true;
+  SwitchStackEntry *firstEntry = PrioritySwitchStack.Front();
+  if (firstEntry == NULL) {
+    priorityLane = false;
+    firstEntry = SwitchStack.Front();
+  }
+  if (firstEntry == NULL) return SWITCH_STACK_EMPTY;
+
+  byte retVal = firstEntry->switchNum;
+  byte eventType = SWITCH_EVENT_CLOSED;
+  if (retVal & SWITCH_STACK_OPENED_FLAG) {
+    retVal &= ~SWITCH_STACK_OPENED_FLAG;
+    eventType = SWITCH_EVENT_OPENED;
+  }
+  if (switchEvent) {
+    switchEvent->switchNum = retVal;
+    switchEvent->eventType = eventType;
+    switchEvent->eventTime = firstEntry->eventTime;
+    // The matrix position is implied by the switch number
+    // (column = strobe, row = return line)
+    if (retVal < MAX_NUM_SWITCHES) {
+      switchEvent->column = retVal / 8;
+      switchEvent->row = retVal % 8;
+    } else {
+      switchEvent->column = 0xFF;
+      switchEvent->row = 0xFF;
+    }
+  }
+
+#ifdef RPU_SWITCH_RECORDER
+  if (SwitchRecorder) RecordSwitchEvent(retVal, eventType, firstEntry->eventTime);
+#endif
+
+  if (priorityLane) {
+    PrioritySwitchStack.Release();
+  } else {
+    SwitchStack.Release();
+    if (PrioritySwitchesSpilled) {
+      // The pusher can't spill another one between the check and the clear
+      byte oldSREG = SREG;
+      cli();
+      if (SwitchStack.IsEmpty()) PrioritySwitchesSpilled = false;
+      SREG = oldSREG;
+    }
+  }
 
   return retVal;
 }
 
+byte RPU_PullFirstFromSwitchStack() {
+  // Callers of this function only know about closures,
+  // so opened events are discarded
+  RPU_SwitchEvent switchEvent;
+  byte retVal;
+  do {
+    retVal = RPU_PullFirstSwitchEvent(&switchEvent);
+  } while (retVal != SWITCH_STACK_EMPTY && switchEvent.eventType == SWITCH_EVENT_OPENED);
+  return retVal;
+}
+
 boolean RPU_ReadSingleSwitchState(byte switchNum) {
 #if (RPU_OS_HARDWARE_REV==200)
   return LISYSwitchStates[switchNum] ? true : false;
 #endif
 
   if (switchNum >= MAX_NUM_SWITCHES) return false;
+#ifdef RPU_SWITCH_RECORDER
+  if (SwitchReplay) return ReadReplaySwitchState(switchNum);
+#endif
 
   int switchByte = switchNum / 8;
   int switchBit = switchNum % 8;
+#if (RPU_MPU_ARCHITECTURE>=10)
+  if ( ((SwitchesDebounced[switchByte]) >> switchBit) & 0x01 ) return true;
+#else
   if ( ((SwitchesNow[switchByte]) >> switchBit) & 0x01 ) return true;
+#endif
   else return false;
 }
 
@@ -1454,6 +2176,45 @@ boolean RPU_SetSwitchInversion(byte switchNum) {
   return true;
 }
 
+// Switches set here also report debounced openings (supported
+// by RPU_MPU_ARCHITECTURE >= 10 and LISY)
+boolean RPU_SetSwitchOpenEvents(byte switchNum, boolean reportOpens) {
+  if (switchNum >= MAX_NUM_SWITCHES) return false;
+  if (reportOpens) SwitchOpenEventMask[switchNum / 8] |= (0x01 << (switchNum % 8));
+  else SwitchOpenEventMask[switchNum / 8] &= ~(0x01 << (switchNum % 8));
+  return true;
+}
+
+boolean RPU_SetSwitchPriority(byte switchNum, boolean priority) {
+  if (switchNum >= MAX_NUM_SWITCHES) return false;
+  if (priority) SwitchPriorityMask[switchNum / 8] |= (0x01 << (switchNum % 8));
+  else SwitchPriorityMask[switchNum / 8] &= ~(0x01 << (switchNum % 8));
+  return true;
+}
+
+// Only used by the RPU_MPU_ARCHITECTURE >= 10 scan
+boolean RPU_SetSwitchDebounce(byte switchNum, byte closedSamples, byte openSamples) {
+#if (RPU_MPU_ARCHITECTURE>=10)
+  if (switchNum >= MAX_NUM_SWITCHES) return false;
+  if (closedSamples < 1) closedSamples = 1;
+  if (closedSamples > SWITCH_DEBOUNCE_MAX_SAMPLES) closedSamples = SWITCH_DEBOUNCE_MAX_SAMPLES;
+  if (openSamples < 1) openSamples = 1;
+  if (openSamples > SWITCH_DEBOUNCE_MAX_SAMPLES) openSamples = SWITCH_DEBOUNCE_MAX_SAMPLES;
+
+  byte switchByte = switchNum / 8;
+  byte switchMask = 0x01 << (switchNum % 8);
+  for (byte plane = 0; plane < 3; plane++) {
+    if ((closedSamples >> plane) & 0x01) SwitchClosedSamples[plane][switchByte] |= switchMask;
+    else SwitchClosedSamples[plane][switchByte] &= ~switchMask;
+    if ((openSamples >> plane) & 0x01) SwitchOpenSamples[plane][switchByte] |= switchMask;
+    else SwitchOpenSamples[plane][switchByte] &= ~switchMask;
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
 byte RPU_GetDipSwitches(byte index) {
 #ifdef RPU_OS_USE_DIP_SWITCHES
   if (index > 3) return 0x00;
@@ -1463,10 +2224,63 @@ byte RPU_GetDipSwitches(byte index) {
 #endif
 }
 
-void RPU_SetupGameSwitches(int s_numSwitches, int s_numPrioritySwitches, PlayfieldAndCabinetSwitch *s_gameSwitchArray) {
+#ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
+void BuildImmediateSolenoidMasks() {
+  for (byte count = 0; count < NUM_SWITCH_BYTES; count++) {
+    ImmediateSolenoidSwitchMask[count] = 0x00;
+  }
+  for (byte count = 0; count < MAX_IMMEDIATE_STREAMLINED_SOLENOIDS; count++) {
+    ImmediateSolenoidSwitchByte[count] = 0x00;
+    ImmediateSolenoidSwitchFlag[count] = 0x00;
+  }
+
+  // The byte & flag arrays are indexed the same as GameSwitches
+  NumImmediateSolenoids = (NumGameSwitches < MAX_IMMEDIATE_STREAMLINED_SOLENOIDS) ? NumGameSwitches : MAX_IMMEDIATE_STREAMLINED_SOLENOIDS;
+  if (GameSwitches == NULL) NumImmediateSolenoids = 0;
+
+  for (byte count = 0; count < NumImmediateSolenoids; count++) {
+    if (GameSwitches[count].switchNum < MAX_NUM_SWITCHES && GameSwitches[count].solenoid != SOL_NONE) {
+      ImmediateSolenoidSwitchMask[GameSwitches[count].switchNum / 8] |= (0x01 << (GameSwitches[count].switchNum % 8));
+      ImmediateSolenoidSwitchByte[count] = GameSwitches[count].switchNum / 8;
+      ImmediateSolenoidSwitchFlag[count] = (0x01 << (GameSwitches[count].switchNum % 8));
+    }
+  }
+/*
+    if (DEBUG_MESSAGES) {
+      char buf[256];
+      for (byte count = 0; count < NUM_SWITCH_BYTES; count++) {
+        sprintf(buf, "Switch mask byte %d = 0x%02X\n", count, ImmediateSolenoidSwitchMask[count]);
+        Serial.write(buf);
+      }
+      for (byte count = 0; count < NumGameSwitches; count++) {
+        sprintf(buf, "Triggered sol switch=%d, byte=%d, mask=0x%02X\n", GameSwitches[count].switchNum, ImmediateSolenoidSwitchByte[count], ImmediateSolenoidSwitchFlag[count]);
+        Serial.write(buf);
+      }
+    }
+*/
+}
+
+#if (RPU_MPU_ARCHITECTURE>=10)
+void RPU_SetImmediateSolenoidHoldoff(byte solenoidNumber, byte holdoffMS) {
+  if (solenoidNumber >= RPU_NUM_SOLENOIDS) return;
+  ImmediateSolenoidHoldoff[solenoidNumber] = holdoffMS;
+}
+#endif
+#endif
+
+void RPU_SetupGameSwitches(int s_numSwitches, int s_numPrioritySwitches, PlayfieldAndCabinetSwitch *s_gameSwitchArray, int s_numDebounceProfiles, SwitchDebounceProfile *s_debounceProfiles) {
   NumGameSwitches = s_numSwitches;
   NumGamePrioritySwitches = s_numPrioritySwitches;
   GameSwitches = s_gameSwitchArray;
+#ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
+  BuildImmediateSolenoidMasks();
+#endif
+
+  if (s_debounceProfiles) {
+    for (int count = 0; count < s_numDebounceProfiles; count++) {
+      RPU_SetSwitchDebounce(s_debounceProfiles[count].switchNum, s_debounceProfiles[count].closedSamples, s_debounceProfiles[count].openSamples);
+    }
+  }
 }
 
 
@@ -1505,89 +2319,104 @@ boolean RPU_GetUpDownSwitchState() {
  *    
 *******************************************************/
 
-int SpaceLeftOnSolenoidStack() {
-  if (SolenoidStackFirst >= SOLENOID_STACK_SIZE || SolenoidStackLast >= SOLENOID_STACK_SIZE) return 0;
-  if (SolenoidStackLast >= SolenoidStackFirst) return ((SOLENOID_STACK_SIZE - 1) - (SolenoidStackLast - SolenoidStackFirst));
-  return (SolenoidStackFirst - SolenoidStackLast) - 1;
-}
-
-
-void RPU_PushToSolenoidStack(byte solenoidNumber, byte numPushes, boolean disableOverride) {
+// Called from the interrupt (or with interrupts off)
+void PushToSolenoidStack(byte solenoidNumber, byte numPushes, boolean disableOverride = false) {
   if (solenoidNumber >= RPU_NUM_SOLENOIDS) return;
 
   // if the solenoid stack is disabled and this isn't an override push, then return
   if (!disableOverride && !SolenoidStackEnabled) return;
 
-  // If the solenoid stack last index is out of range, then it's an error - return
-  if (SpaceLeftOnSolenoidStack() == 0) return;
-
 #if (RPU_OS_HARDWARE_REV==200)
   // For SA LISY, we only need to push once to the stack
   // because the MPU will handle the actual pulse width.
   numPushes = 1; 
+#elif (RPU_MPU_ARCHITECTURE>=10)
+  // One entry holds the whole pulse. Like LISY, a default
+  // pulse for this coil takes precedence over numPushes.
+  if (SolenoidDefaultPulseTicks[solenoidNumber]) numPushes = SolenoidDefaultPulseTicks[solenoidNumber];
+  if (numPushes == 0) return;
+  SolenoidStackEntry *newEntry = SolenoidStack.Reserve();
+  if (newEntry == NULL) return;
+  newEntry->solenoidNum = solenoidNumber;
+  newEntry->pulseTicks = numPushes;
+  SolenoidStack.Publish();
+  numPushes = 0;
 #endif
 
   for (int count = 0; count < numPushes; count++) {
-    SolenoidStack[SolenoidStackLast] = solenoidNumber;
-
-    SolenoidStackLast += 1;
-    if (SolenoidStackLast == SOLENOID_STACK_SIZE) {
-      // If the end index is off the end, then wrap
-      SolenoidStackLast = 0;
-    }
-    // If the stack is now full, return
-    if (SpaceLeftOnSolenoidStack() == 0) return;
+    SolenoidStackEntry *newEntry = SolenoidStack.Reserve();
+    // If the stack is full, return
+    if (newEntry == NULL) return;
+    newEntry->solenoidNum = solenoidNumber;
+    SolenoidStack.Publish();
   }
 }
 
+void RPU_PushToSolenoidStack(byte solenoidNumber, byte numPushes, boolean disableOverride) {
+  // The interrupt pushes too (and to the front), and this can be
+  // called with interrupts off
+  byte oldSREG = SREG;
+  cli();
+  PushToSolenoidStack(solenoidNumber, numPushes, disableOverride);
+  SREG = oldSREG;
+}
+
+// Only called from the interrupt, which is the consumer
 void PushToFrontOfSolenoidStack(byte solenoidNumber, byte numPushes) {
-  // If the stack is full, return
-  if (SpaceLeftOnSolenoidStack() == 0  || !SolenoidStackEnabled) return;
+  if (!SolenoidStackEnabled) return;
+
+#if (RPU_MPU_ARCHITECTURE>=10 && RPU_OS_HARDWARE_REV<200)
+  if (solenoidNumber >= RPU_NUM_SOLENOIDS) return;
+  if (SolenoidDefaultPulseTicks[solenoidNumber]) numPushes = SolenoidDefaultPulseTicks[solenoidNumber];
+  if (numPushes == 0) return;
+  SolenoidStackEntry *newEntry = SolenoidStack.ReserveFront();
+  if (newEntry == NULL) return;
+  newEntry->solenoidNum = solenoidNumber;
+  newEntry->pulseTicks = numPushes;
+  SolenoidStack.PublishFront();
+  numPushes = 0;
+#endif
 
   for (int count = 0; count < numPushes; count++) {
-    if (SolenoidStackFirst == 0) SolenoidStackFirst = SOLENOID_STACK_SIZE - 1;
-    else SolenoidStackFirst -= 1;
-    SolenoidStack[SolenoidStackFirst] = solenoidNumber;
-    if (SpaceLeftOnSolenoidStack() == 0) return;
+    SolenoidStackEntry *newEntry = SolenoidStack.ReserveFront();
+    if (newEntry == NULL) return;
+    newEntry->solenoidNum = solenoidNumber;
+    SolenoidStack.PublishFront();
   }
 
 }
 
-byte PullFirstFromSolenoidStack() {
-  // If first and last are equal, there's nothing on the stack
-  if (SolenoidStackFirst == SolenoidStackLast) return SOLENOID_STACK_EMPTY;
+byte PullFirstFromSolenoidStack(byte *pulseTicks = NULL) {
+  SolenoidStackEntry *firstEntry = SolenoidStack.Front();
+  if (firstEntry == NULL) return SOLENOID_STACK_EMPTY;
 
-  byte retVal = SolenoidStack[SolenoidStackFirst];
+  byte retVal = firstEntry->solenoidNum;
+#if (RPU_MPU_ARCHITECTURE>=10 && RPU_OS_HARDWARE_REV<200)
+  if (pulseTicks) *pulseTicks = firstEntry->pulseTicks;
+#else
+  if (pulseTicks) *pulseTicks = 1;
+#endif
 
-  SolenoidStackFirst += 1;
-  if (SolenoidStackFirst >= SOLENOID_STACK_SIZE) SolenoidStackFirst = 0;
+  SolenoidStack.Release();
 
   return retVal;
 }
 
 boolean RPU_PushToTimedSolenoidStack(byte solenoidNumber, byte numPushes, unsigned long whenToFire, boolean disableOverride) {
-  for (int count = 0; count < TIMED_SOLENOID_STACK_SIZE; count++) {
-    if (!TimedSolenoidStack[count].inUse) {
-      TimedSolenoidStack[count].inUse = true;
-      TimedSolenoidStack[count].pushTime = whenToFire;
-      TimedSolenoidStack[count].disableOverride = disableOverride;
-      TimedSolenoidStack[count].solenoidNumber = solenoidNumber;
-      TimedSolenoidStack[count].numPushes = numPushes;
-      return true;
-    }
-  }
-  return false;
+  return PushToTimedStack(&TimedSolenoidStack, solenoidNumber, numPushes, whenToFire, disableOverride);
 }
 
 void RPU_UpdateTimedSolenoidStack(unsigned long curTime) {
-  for (int count = 0; count < TIMED_SOLENOID_STACK_SIZE; count++) {
-    if (TimedSolenoidStack[count].inUse && TimedSolenoidStack[count].pushTime < curTime) {
-      RPU_PushToSolenoidStack(TimedSolenoidStack[count].solenoidNumber, TimedSolenoidStack[count].numPushes, TimedSolenoidStack[count].disableOverride);
-      TimedSolenoidStack[count].inUse = false;
-    }
+  TimedStackEntry *dueEntry;
+  while ( (dueEntry = PullDueFromTimedStack(&TimedSolenoidStack, curTime)) != NULL ) {
+    RPU_PushToSolenoidStack(dueEntry->itemNumber, dueEntry->numPushes, dueEntry->disableOverride);
   }
 }
 
+unsigned short RPU_GetTimedSolenoidStackOverflows() {
+  return TimedSolenoidStack.overflows;
+}
+
 #if (RPU_MPU_ARCHITECTURE<10)
 
 // RPU_MPU_ARCHITECTURE < 10
@@ -1597,7 +2426,7 @@ void RPU_SetCoinLockout(boolean lockoutOff, byte solbit) {
   } else {
     CurrentSolenoidByte = CurrentSolenoidByte | solbit;
   }
-  RPU_DataWrite(ADDRESS_U11_B, CurrentSolenoidByte);
+  WritePIARegister(ADDRESS_U11_B, CurrentSolenoidByte);
 }
 
 // RPU_MPU_ARCHITECTURE < 10
@@ -1608,7 +2437,7 @@ void RPU_SetDisableFlippers(boolean disableFlippers, byte solbit) {
     CurrentSolenoidByte = CurrentSolenoidByte & ~solbit;
   }
 
-  RPU_DataWrite(ADDRESS_U11_B, CurrentSolenoidByte);
+  WritePIARegister(ADDRESS_U11_B, CurrentSolenoidByte);
 }
 
 // RPU_MPU_ARCHITECTURE < 10
@@ -1623,7 +2452,7 @@ void RPU_SetContinuousSolenoidBit(boolean bitOn, byte solbit) {
   } else {
     CurrentSolenoidByte = CurrentSolenoidByte & ~solbit;
   }
-  RPU_DataWrite(ADDRESS_U11_B, CurrentSolenoidByte);
+  WritePIARegister(ADDRESS_U11_B, CurrentSolenoidByte);
 }
 
 // RPU_MPU_ARCHITECTURE < 10
@@ -1639,7 +2468,7 @@ boolean RPU_FireContinuousSolenoid(byte solBit, byte numCyclesToFire) {
 
 // RPU_MPU_ARCHITECTURE < 10
 byte RPU_ReadContinuousSolenoids() {
-  return RPU_DataRead(ADDRESS_U11_B);
+  return ReadPIAShadow(ADDRESS_U11_B);
 }
 
 // RPU_MPU_ARCHITECTURE < 10
@@ -1672,8 +2501,8 @@ void RPU_SetDisableFlippers(boolean disableFlippers, byte solbit) {
 #if (RPU_OS_HARDWARE_REV==200)
   RPU_LISYSendGameOverState(disableFlippers);
 #else
-  if (disableFlippers) RPU_DataWrite(PIA_SOLENOID_CONTROL_B, 0x34);
-  else RPU_DataWrite(PIA_SOLENOID_CONTROL_B, 0x3C);
+  if (disableFlippers) WritePIARegister(PIA_SOLENOID_CONTROL_B, 0x34);
+  else WritePIARegister(PIA_SOLENOID_CONTROL_B, 0x3C);
 #endif  
 }
 
@@ -1694,10 +2523,12 @@ void RPU_SetContinuousSolenoid(boolean solOn, byte solNum) {
 #else
 
   if (oldCont != ContinuousSolenoidBits) {
-    byte origPortA = RPU_DataRead(PIA_SOLENOID_PORT_A);
-    byte origPortB = RPU_DataRead(PIA_SOLENOID_PORT_B);
-    if (origPortA != (ContinuousSolenoidBits & 0xFF)) RPU_DataWrite(PIA_SOLENOID_PORT_A, (ContinuousSolenoidBits & 0xFF));
-    if (origPortB != (ContinuousSolenoidBits / 256)) RPU_DataWrite(PIA_SOLENOID_PORT_B, (ContinuousSolenoidBits / 256));
+    // Don't cut off any coil that's in the middle of a pulse
+    unsigned short solenoidBits = ContinuousSolenoidBits | (unsigned short)(SolenoidPulseBits & 0xFFFF);
+    byte origPortA = ReadPIAShadow(PIA_SOLENOID_PORT_A);
+    byte origPortB = ReadPIAShadow(PIA_SOLENOID_PORT_B);
+    if (origPortA != (solenoidBits & 0xFF)) WritePIARegister(PIA_SOLENOID_PORT_A, (solenoidBits & 0xFF));
+    if (origPortB != (solenoidBits / 256)) WritePIARegister(PIA_SOLENOID_PORT_B, (solenoidBits / 256));
   }
 #endif  
 }
@@ -1715,13 +2546,13 @@ void RPU_SetCoinLockout(boolean lockoutOn, byte solNum) {
 // RPU_MPU_ARCHITECTURE >= 10
 void RPU_DisableSolenoidStack() {
   SolenoidStackEnabled = false;
-  RPU_DataWrite(PIA_SOLENOID_CONTROL_B, 0x34);
+  WritePIARegister(PIA_SOLENOID_CONTROL_B, 0x34);
 }
 
 // RPU_MPU_ARCHITECTURE >= 10
 void RPU_EnableSolenoidStack() {
   SolenoidStackEnabled = true;
-  RPU_DataWrite(PIA_SOLENOID_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_SOLENOID_CONTROL_B, 0x3C);
 }
 
 // RPU_MPU_ARCHITECTURE >= 10
@@ -1730,9 +2561,76 @@ boolean RPU_IsSolenoidStackEnabled() {
 }
 
 #if (RPU_OS_HARDWARE_REV!=200)
+// RPU_MPU_ARCHITECTURE >= 10
+// pulseTimeMS of 0 goes back to using numPushes as the width
 void RPU_SetSolenoidDefaultPulse(byte solenoidNumber, byte pulseTimeMS) {
-  (void)solenoidNumber;
-  (void)pulseTimeMS;
+  if (solenoidNumber >= RPU_NUM_SOLENOIDS) return;
+  // Solenoid ticks are ~2.07 ms apart (round up)
+  SolenoidDefaultPulseTicks[solenoidNumber] = (byte)(((unsigned short)pulseTimeMS * 100 + 206) / 207);
+}
+
+// RPU_MPU_ARCHITECTURE >= 10
+// maxDutyPercent of 100, minRefireMS of 0 and powerGroup 0 mean no limit
+void RPU_SetSolenoidLimits(byte solenoidNumber, byte maxDutyPercent, unsigned short minRefireMS, byte powerGroup) {
+  if (solenoidNumber >= RPU_NUM_SOLENOIDS) return;
+  if (maxDutyPercent == 0 || maxDutyPercent > 100) maxDutyPercent = 100;
+  if (powerGroup >= RPU_NUM_SOLENOID_POWER_GROUPS) powerGroup = 0;
+  unsigned long refireTicks = ((unsigned long)minRefireMS * 100 + 206) / 207;
+  if (refireTicks > 255) refireTicks = 255;
+
+  noInterrupts();
+  // Move a running pulse to its new group's count
+  if (SolenoidPulseBits & (1UL << solenoidNumber)) {
+    if (SolenoidPowerGroup[solenoidNumber]) PowerGroupActive[SolenoidPowerGroup[solenoidNumber]] -= 1;
+    if (powerGroup) PowerGroupActive[powerGroup] += 1;
+  }
+  SolenoidMaxDuty[solenoidNumber] = maxDutyPercent;
+  SolenoidMinRefireTicks[solenoidNumber] = (byte)refireTicks;
+  SolenoidPowerGroup[solenoidNumber] = powerGroup;
+  interrupts();
+}
+
+// RPU_MPU_ARCHITECTURE >= 10
+void RPU_SetSolenoidPowerGroupLimit(byte powerGroup, byte maxSimultaneous) {
+  if (powerGroup == 0 || powerGroup >= RPU_NUM_SOLENOID_POWER_GROUPS) return;
+  PowerGroupMaxActive[powerGroup] = maxSimultaneous ? maxSimultaneous : 1;
+}
+
+// RPU_MPU_ARCHITECTURE >= 10
+unsigned short RPU_GetSolenoidDeferrals() {
+  return SolenoidDeferrals;
+}
+
+// RPU_MPU_ARCHITECTURE >= 10
+// Each bit of the pattern is one solenoid tick (0xFF = always on)
+void RPU_SetContinuousSolenoidPWM(byte solNum, byte pattern) {
+  if (solNum > 15) return;
+  ContinuousSolenoidPWM[solNum] = pattern;
+  if (pattern == 0xFF) ContinuousSolenoidPWMBits &= ~(1 << solNum);
+  else ContinuousSolenoidPWMBits |= (1 << solNum);
+}
+
+// RPU_MPU_ARCHITECTURE >= 10 (called from the ISR)
+boolean SolenoidWithinBudget(byte solNum) {
+  if (SolenoidRefireTicksLeft[solNum]) return false;
+  if (SolenoidMaxDuty[solNum] < 100 && SolenoidHeat[solNum] >= SOLENOID_HEAT_LIMIT) return false;
+  byte powerGroup = SolenoidPowerGroup[solNum];
+  if (powerGroup && !(SolenoidPulseBits & (1UL << solNum)) && PowerGroupActive[powerGroup] >= PowerGroupMaxActive[powerGroup]) return false;
+  return true;
+}
+
+// RPU_MPU_ARCHITECTURE >= 10 (called from the ISR)
+void StartSolenoidPulse(byte solNum, byte pulseTicks) {
+  unsigned long solBit = (1UL << solNum);
+  if (!(SolenoidPulseBits & solBit)) {
+    SolenoidPulseBits |= solBit;
+    if (SolenoidPowerGroup[solNum]) PowerGroupActive[SolenoidPowerGroup[solNum]] += 1;
+  }
+  if (pulseTicks > SolenoidPulseTicks[solNum]) SolenoidPulseTicks[solNum] = pulseTicks;
+  if (SolenoidMinRefireTicks[solNum]) {
+    SolenoidRefireTicksLeft[solNum] = SolenoidMinRefireTicks[solNum];
+    SolenoidCoolingBits |= solBit;
+  }
 }
 #endif
 
@@ -1750,14 +2648,126 @@ void RPU_SetSolenoidDefaultPulse(byte solenoidNumber, byte pulseTimeMS) {
  *    
  *    
 *******************************************************/
+
+// Packed BCD scores hold one decimal digit per nibble (8 digits), so
+// adding to them and showing them doesn't need any 32-bit division.
+// Anything past 99,999,999 sticks at 99,999,999.
+const unsigned long BCDBinaryPlaces[RPU_BCD_SCORE_DIGITS] = {10000000UL, 1000000UL, 100000UL, 10000UL, 1000UL, 100UL, 10UL, 1UL};
+
+RPU_BCDScore RPU_BCDFromBinary(unsigned long value) {
+  if (value > 99999999UL) return RPU_BCD_SCORE_MAX;
+
+  RPU_BCDScore bcdValue = 0;
+  for (byte place = 0; place < RPU_BCD_SCORE_DIGITS; place++) {
+    byte digit = 0;
+    while (value >= BCDBinaryPlaces[place]) {
+      value -= BCDBinaryPlaces[place];
+      digit += 1;
+    }
+    bcdValue = (bcdValue << 4) | digit;
+  }
+  return bcdValue;
+}
+
+unsigned long RPU_BCDToBinary(RPU_BCDScore bcdValue) {
+  unsigned long value = 0;
+  for (byte place = 0; place < RPU_BCD_SCORE_DIGITS; place++) {
+    value = value * 10 + ((bcdValue >> 28) & 0x0F);
+    bcdValue <<= 4;
+  }
+  return value;
+}
+
+// Adds every digit at once: bias each digit by 6 so a decimal carry
+// becomes a nibble carry, then take the 6 back out of every digit
+// that didn't carry. The sum is kept to 32 bits so the top digit's
+// carry shows up the same where a long is wider (the host build).
+RPU_BCDScore RPU_BCDAdd(RPU_BCDScore bcdValue1, RPU_BCDScore bcdValue2) {
+  unsigned long biasedSum = bcdValue1 + 0x66666666UL;
+  unsigned long sum = (biasedSum + bcdValue2) & 0xFFFFFFFFUL;
+  if (sum < biasedSum) return RPU_BCD_SCORE_MAX;
+
+  unsigned long noCarry = ~(sum ^ biasedSum ^ bcdValue2) & 0x11111110UL;
+  return sum - ((noCarry >> 2) | (noCarry >> 3)) - 0x60000000UL;
+}
+
+RPU_BCDScore RPU_BCDMultiply(RPU_BCDScore bcdValue, byte multiplier) {
+  RPU_BCDScore product = 0;
+  while (multiplier) {
+    if (multiplier & 0x01) product = RPU_BCDAdd(product, bcdValue);
+    multiplier >>= 1;
+    if (multiplier) bcdValue = RPU_BCDAdd(bcdValue, bcdValue);
+  }
+  return product;
+}
+
+byte RPU_BCDMagnitude(RPU_BCDScore bcdValue) {
+  byte magnitude = 0;
+  while (bcdValue) {
+    bcdValue >>= 4;
+    magnitude += 1;
+  }
+  return magnitude;
+}
+
 #if (RPU_MPU_ARCHITECTURE<15)
 
 
 
+// Display digit cache - RPU_SetDisplay is usually asked to show the
+// same score loop after loop, so if the value and options match what
+// the display already has, the digits aren't worked out again
+#define DISPLAY_CACHE_VALID             0x80
+#define DISPLAY_CACHE_BCD               0x40
+#define DISPLAY_CACHE_BLANK_BY_MAG      0x20
+#define DISPLAY_CACHE_COMMAS            0x10
+unsigned long DisplayCacheValue[5];
+byte DisplayCacheOptions[5];
+byte DisplayCacheBlank[5];
+
+// Display effects - each display can run one effect on its own
+// timeline (frame n starts at startTime + n * rate). RPU_Update
+// works out a frame only when its time comes (or the value changes)
+// and only writes digits or blanking that actually changed.
+// Writing to a display directly takes it back from its effect.
+struct DisplayEffect {
+  byte effectType;
+  byte minDigits;
+  boolean needsRender;
+  unsigned short rate;
+  unsigned long startTime;
+  unsigned long value;
+  unsigned long nextFrameTime;
+};
+DisplayEffect DisplayEffects[5];
+boolean DisplayEffectRendering = false;
+
+void TakeDisplayFromEffect(int displayNumber) {
+  if (!DisplayEffectRendering && displayNumber >= 0 && displayNumber < 5) DisplayEffects[displayNumber].effectType = RPU_DISPLAY_EFFECT_NONE;
+}
+
 // RPU_MPU_ARCHITECTURE < 15
-byte RPU_SetDisplay(int displayNumber, unsigned long value, boolean blankByMagnitude, byte minDigits, boolean showCommasByMagnitude) {
+byte WriteDisplayDigits(int displayNumber, unsigned long value, boolean valueIsBCD, boolean blankByMagnitude, byte minDigits, boolean showCommasByMagnitude) {
   if (displayNumber < 0 || displayNumber > 4) return 0;
 
+  byte cacheOptions = DISPLAY_CACHE_VALID | (minDigits & 0x0F);
+  if (valueIsBCD) cacheOptions |= DISPLAY_CACHE_BCD;
+  if (blankByMagnitude) cacheOptions |= DISPLAY_CACHE_BLANK_BY_MAG;
+  if (showCommasByMagnitude) cacheOptions |= DISPLAY_CACHE_COMMAS;
+
+  if (DisplayCacheOptions[displayNumber] == cacheOptions && DisplayCacheValue[displayNumber] == value) {
+    // Digits are already there, but the blanking may have been changed since
+    if (blankByMagnitude && DisplayDigitEnable[displayNumber] != DisplayCacheBlank[displayNumber]) {
+      DisplayDigitEnable[displayNumber] = DisplayCacheBlank[displayNumber];
+#if (RPU_OS_HARDWARE_REV==200)
+      RPU_LISYSendScore(displayNumber, RPU_OS_NUM_DIGITS);
+#endif
+    }
+    return DisplayCacheBlank[displayNumber];
+  }
+  DisplayCacheOptions[displayNumber] = cacheOptions;
+  DisplayCacheValue[displayNumber] = value;
+
 #if (RPU_OS_HARDWARE_REV==200)
 #if (RPU_MPU_ARCHITECTURE>=13)
   byte oldDisplayCommas = DisplayCommas;
@@ -1794,14 +2804,20 @@ byte RPU_SetDisplay(int displayNumber, unsigned long value, boolean blankByMagni
 #if (RPU_OS_HARDWARE_REV==200)
     byte lastDigit = DisplayDigits[displayNumber][(RPU_OS_NUM_DIGITS - 1) - count];
 #endif
-    DisplayDigits[displayNumber][(RPU_OS_NUM_DIGITS - 1) - count] = value % 10;
+    if (valueIsBCD) {
+      DisplayDigits[displayNumber][(RPU_OS_NUM_DIGITS - 1) - count] = value & 0x0F;
+      value >>= 4;
+    } else {
+      DisplayDigits[displayNumber][(RPU_OS_NUM_DIGITS - 1) - count] = value % 10;
+      value /= 10;
+    }
 #if (RPU_OS_HARDWARE_REV==200)
     if (lastDigit!=DisplayDigits[displayNumber][(RPU_OS_NUM_DIGITS - 1) - count]) digitsChanged = true;
 #endif
-    value /= 10;
   }
 
   if (blankByMagnitude) DisplayDigitEnable[displayNumber] = blank;
+  DisplayCacheBlank[displayNumber] = blank;
 
 #if (RPU_OS_HARDWARE_REV==200)
 #if (RPU_MPU_ARCHITECTURE>=13)
@@ -1812,6 +2828,19 @@ byte RPU_SetDisplay(int displayNumber, unsigned long value, boolean blankByMagni
 #endif
   return blank;
 }
+
+// RPU_MPU_ARCHITECTURE < 15
+byte RPU_SetDisplay(int displayNumber, unsigned long value, boolean blankByMagnitude, byte minDigits, boolean showCommasByMagnitude) {
+  TakeDisplayFromEffect(displayNumber);
+  return WriteDisplayDigits(displayNumber, value, false, blankByMagnitude, minDigits, showCommasByMagnitude);
+}
+
+// RPU_MPU_ARCHITECTURE < 15
+// Same as RPU_SetDisplay, but the digits come straight from the nibbles
+byte RPU_SetDisplayBCD(int displayNumber, RPU_BCDScore value, boolean blankByMagnitude, byte minDigits, boolean showCommasByMagnitude) {
+  TakeDisplayFromEffect(displayNumber);
+  return WriteDisplayDigits(displayNumber, value, true, blankByMagnitude, minDigits, showCommasByMagnitude);
+}
 #endif
 
 
@@ -1826,6 +2855,8 @@ void RPU_SetDisplayCredits(int value, boolean displayOn, boolean showBothDigits)
   DisplayDigits[4][2] = (value % 10);
 #endif
   byte enableMask = DisplayDigitEnable[4] & RPU_OS_MASK_SHIFT_1;
+  // These digits belong to display 4, so its cached value is stale
+  DisplayCacheOptions[4] = 0;
 
   if (displayOn) {
     if (value > 9 || showBothDigits) enableMask |= RPU_OS_MASK_SHIFT_2;
@@ -1845,6 +2876,8 @@ void RPU_SetDisplayBallInPlay(int value, boolean displayOn, boolean showBothDigi
   DisplayDigits[4][5] = (value % 10);
 #endif
   byte enableMask = DisplayDigitEnable[4] & RPU_OS_MASK_SHIFT_2;
+  // These digits belong to display 4, so its cached value is stale
+  DisplayCacheOptions[4] = 0;
 
   if (displayOn) {
     if (value > 9 || showBothDigits) enableMask |= RPU_OS_MASK_SHIFT_1;
@@ -1994,6 +3027,9 @@ void RPU_SetDisplayMatch(int value, boolean displayOn, boolean showBothDigits) {
 //   bit=   b0 b1 b2 b3 b4 b5
 void RPU_SetDisplayBlank(int displayNumber, byte bitMask) {
   if (displayNumber < 0 || displayNumber > 4) return;
+#if (RPU_MPU_ARCHITECTURE<15)
+  TakeDisplayFromEffect(displayNumber);
+#endif
 
 #if (RPU_OS_HARDWARE_REV==200)
   boolean sendScore = false;
@@ -2009,7 +3045,11 @@ void RPU_SetDisplayBlank(int displayNumber, byte bitMask) {
 #else
     (void)oldCommas;
 #endif
-
+#if (RPU_MPU_ARCHITECTURE<15)
+    // A cache hit only puts the blanking back, so drop the cached
+    // value and let the next RPU_SetDisplay work the commas out again
+    DisplayCacheOptions[displayNumber] = 0;
+#endif
   }
 #endif
 #if (RPU_OS_HARDWARE_REV==200)
@@ -2070,6 +3110,195 @@ void RPU_SetDisplayFlashCredits(unsigned long curTime, int period) {
   }
 }
 
+#if (RPU_MPU_ARCHITECTURE<15)
+// Blanking bits run from the most significant digit (0x01) to the ones digit
+#define DISPLAY_ONES_DIGIT_BIT    (0x01 << (RPU_OS_NUM_DIGITS - 1))
+
+byte DisplayMagnitude(unsigned long value) {
+  byte magnitude = 0;
+  unsigned long placeValue = 1;
+  while (value >= placeValue) {
+    magnitude += 1;
+    if (magnitude == 10) break;
+    placeValue *= 10;
+  }
+  return magnitude;
+}
+
+byte DisplayMaskForDigits(byte numDigits) {
+  byte displayMask = 0;
+  for (byte digitCount = 0; digitCount < numDigits && digitCount < RPU_OS_NUM_DIGITS; digitCount++) {
+    displayMask |= (DISPLAY_ONES_DIGIT_BIT >> digitCount);
+  }
+  return displayMask;
+}
+
+// RPU_MPU_ARCHITECTURE < 15
+// Calling this again with the same effect, start time and rate
+// keeps the timeline going (a new value is just redrawn), so it can
+// be called every loop.
+void RPU_StartDisplayEffect(byte displayNumber, byte effectType, unsigned long value, unsigned long startTime, unsigned short rate, byte minDigits) {
+  if (displayNumber > 4 || rate == 0) return;
+  DisplayEffect *effect = &DisplayEffects[displayNumber];
+
+  if (effect->effectType == effectType && effect->startTime == startTime && effect->rate == rate && effect->minDigits == minDigits) {
+    if (effect->value != value) {
+      effect->value = value;
+      effect->needsRender = true;
+    }
+    return;
+  }
+
+  effect->effectType = effectType;
+  effect->minDigits = minDigits;
+  effect->rate = rate;
+  effect->startTime = startTime;
+  effect->value = value;
+  effect->needsRender = true;
+}
+
+// RPU_MPU_ARCHITECTURE < 15
+// The display is left showing the effect's last frame
+void RPU_StopDisplayEffect(byte displayNumber) {
+  if (displayNumber > 4) return;
+  DisplayEffects[displayNumber].effectType = RPU_DISPLAY_EFFECT_NONE;
+}
+
+// RPU_MPU_ARCHITECTURE < 15
+byte RPU_GetDisplayEffect(byte displayNumber) {
+  if (displayNumber > 4) return RPU_DISPLAY_EFFECT_NONE;
+  return DisplayEffects[displayNumber].effectType;
+}
+
+void RenderDisplayEffect(byte displayNumber, DisplayEffect *effect, unsigned long frame) {
+  unsigned long value = effect->value;
+  byte displayMask;
+
+  switch (effect->effectType) {
+    case RPU_DISPLAY_EFFECT_FLASH:
+      displayMask = RPU_SetDisplay(displayNumber, value, false, effect->minDigits);
+      if ((frame % 2) == 0) displayMask = 0x00;
+      break;
+
+    case RPU_DISPLAY_EFFECT_DASH: {
+        // Blanking sweeps in from the left, then back out the right
+        byte dashPhase = frame % 36;
+        displayMask = RPU_SetDisplay(displayNumber, value, false, effect->minDigits);
+        if (dashPhase < 12) {
+          byte numDigits = DisplayMagnitude(value);
+          displayMask = DisplayMaskForDigits((numDigits == 0) ? 2 : numDigits);
+          if (dashPhase < 7) {
+            for (byte maskCount = 0; maskCount < dashPhase; maskCount++) {
+              displayMask &= ~(0x01 << maskCount);
+            }
+          } else {
+            for (byte maskCount = 12; maskCount > dashPhase; maskCount--) {
+              displayMask &= ~(DISPLAY_ONES_DIGIT_BIT >> (maskCount - dashPhase - 1));
+            }
+          }
+        }
+      }
+      break;
+
+    case RPU_DISPLAY_EFFECT_SCROLL: {
+        // The low digits hold for 16 frames, then the whole value
+        // scrolls through a 10 digit window for 11 frames out of 16
+        if (frame < 16) {
+          RPU_SetDisplay(displayNumber, value % (RPU_OS_MAX_DISPLAY_SCORE + 1), false, effect->minDigits);
+          displayMask = RPU_OS_ALL_DIGITS_MASK;
+          break;
+        }
+        byte scrollPhase = frame % 16;
+        if (scrollPhase >= 11) return;
+
+        byte numDigits = DisplayMagnitude(value);
+        unsigned long displayValue = value;
+        if (scrollPhase < RPU_OS_NUM_DIGITS) {
+          displayMask = RPU_OS_ALL_DIGITS_MASK;
+          for (byte scrollCount = 0; scrollCount < scrollPhase; scrollCount++) {
+            displayValue = (displayValue % (RPU_OS_MAX_DISPLAY_SCORE + 1)) * 10;
+            displayMask = displayMask >> 1;
+          }
+        } else {
+          displayValue = 0;
+          displayMask = 0x00;
+        }
+
+        // Bring in the top of the value from the right
+        if ((numDigits + scrollPhase) > 10) {
+          byte numDigitsNeeded = (numDigits + scrollPhase) - 10;
+          unsigned long topOfValue = value;
+          for (byte scrollCount = 0; scrollCount < (numDigits - numDigitsNeeded); scrollCount++) {
+            topOfValue /= 10;
+          }
+          displayMask |= DisplayMaskForDigits(DisplayMagnitude(topOfValue));
+          displayValue += topOfValue;
+        }
+        RPU_SetDisplay(displayNumber, displayValue, false, effect->minDigits);
+      }
+      break;
+
+    case RPU_DISPLAY_EFFECT_FLYBY: {
+        // The value comes in from the right a digit per frame
+        byte rightSideBlank = 0;
+        unsigned long bigVersionOfValue = value;
+        for (unsigned long count = 0; count < frame && count < 12; count++) {
+          bigVersionOfValue *= 10;
+          rightSideBlank /= 2;
+          if (count > 2) rightSideBlank |= DISPLAY_ONES_DIGIT_BIT;
+        }
+        bigVersionOfValue /= 1000;
+
+        displayMask = RPU_SetDisplay(displayNumber, bigVersionOfValue, false, 0);
+        if (bigVersionOfValue == 0) displayMask = 0;
+        displayMask &= ~rightSideBlank;
+      }
+      break;
+
+    case RPU_DISPLAY_EFFECT_BOUNCE: {
+        // A short value moves back and forth a digit per frame
+        byte numDigits = DisplayMagnitude(value);
+        if (numDigits == 0) numDigits = 1;
+        if (numDigits >= (RPU_OS_NUM_DIGITS - 1)) {
+          displayMask = RPU_SetDisplay(displayNumber, value, false, 1);
+          break;
+        }
+        byte shiftDigits = frame % (((RPU_OS_NUM_DIGITS + 1) - numDigits) + ((RPU_OS_NUM_DIGITS - 1) - numDigits));
+        if (shiftDigits >= ((RPU_OS_NUM_DIGITS + 1) - numDigits)) shiftDigits = (RPU_OS_NUM_DIGITS - numDigits) * 2 - shiftDigits;
+        displayMask = DisplayMaskForDigits(numDigits);
+        for (byte digitCount = 0; digitCount < shiftDigits; digitCount++) {
+          value *= 10;
+          displayMask = displayMask >> 1;
+        }
+        RPU_SetDisplay(displayNumber, value, false, effect->minDigits);
+      }
+      break;
+
+    default:
+      return;
+  }
+
+  if (DisplayDigitEnable[displayNumber] != displayMask) RPU_SetDisplayBlank(displayNumber, displayMask);
+}
+
+// RPU_MPU_ARCHITECTURE < 15 (called from RPU_Update)
+void RPU_UpdateDisplayEffects(unsigned long curTime) {
+  for (byte displayCount = 0; displayCount < 5; displayCount++) {
+    DisplayEffect *effect = &DisplayEffects[displayCount];
+    if (effect->effectType == RPU_DISPLAY_EFFECT_NONE) continue;
+    if (!effect->needsRender && (long)(curTime - effect->nextFrameTime) < 0) continue;
+
+    unsigned long frame = 0;
+    if ((long)(curTime - effect->startTime) > 0) frame = (curTime - effect->startTime) / effect->rate;
+    effect->nextFrameTime = effect->startTime + (frame + 1) * effect->rate;
+    effect->needsRender = false;
+    DisplayEffectRendering = true;
+    RenderDisplayEffect(displayCount, effect, frame);
+    DisplayEffectRendering = false;
+  }
+}
+#endif
+
 #if (RPU_MPU_ARCHITECTURE==15)
 // RPU_MPU_ARCHITECTURE = 15
 byte RPU_SetDisplayText(int displayNumber, char *text, boolean blankByLength) {
@@ -2169,26 +3398,138 @@ void RPU_SetDimDivisor(byte level, byte divisor) {
 // left shift is iterative on Arduinos, so a bit array is suprisingly faster
 byte BitShiftValues[8] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80};
 
-void RPU_SetLampState(int lampNum, byte s_lampState, byte s_lampDim, int s_lampFlashPeriod) {
+void RemoveLampFromFlashGroup(byte lampNum, byte lampCol, byte lampBit) {
+  byte groupNum = LampFlashGroupNum[lampNum];
+  if (groupNum == LAMP_FLASH_GROUP_NONE) return;
+
+  LampFlashGroups[groupNum].lampMask[lampCol] &= ~lampBit;
+  LampFlashGroups[groupNum].numLamps -= 1;
+  LampFlashGroupNum[lampNum] = LAMP_FLASH_GROUP_NONE;
+}
+
+boolean AddLampToFlashGroup(byte lampNum, byte lampCol, byte lampBit, unsigned short period, unsigned short phaseOffset) {
+  byte groupNum = LampFlashGroupNum[lampNum];
+  if (groupNum != LAMP_FLASH_GROUP_NONE) {
+    // Already flashing this way (the usual case, since
+    // games set their lamps on every loop)
+    if (LampFlashGroups[groupNum].period == period && LampFlashGroups[groupNum].phaseOffset == phaseOffset) return true;
+    RemoveLampFromFlashGroup(lampNum, lampCol, lampBit);
+  }
+
+  byte freeGroup = LAMP_FLASH_GROUP_NONE;
+  for (groupNum = 0; groupNum < RPU_NUM_LAMP_FLASH_GROUPS; groupNum++) {
+    LampFlashGroup *group = &LampFlashGroups[groupNum];
+    if (group->numLamps == 0) {
+      if (freeGroup == LAMP_FLASH_GROUP_NONE) freeGroup = groupNum;
+    } else if (group->period == period && group->phaseOffset == phaseOffset) {
+      break;
+    }
+  }
+
+  if (groupNum == RPU_NUM_LAMP_FLASH_GROUPS) {
+    if (freeGroup == LAMP_FLASH_GROUP_NONE) {
+      LampFlashGroupOverflows += 1;
+      return false;
+    }
+    groupNum = freeGroup;
+    LampFlashGroups[groupNum].period = period;
+    LampFlashGroups[groupNum].phaseOffset = phaseOffset;
+    LampFlashGroups[groupNum].needsSync = true;
+  }
+
+  LampFlashGroup *group = &LampFlashGroups[groupNum];
+  group->lampMask[lampCol] |= lampBit;
+  group->numLamps += 1;
+  LampFlashGroupNum[lampNum] = groupNum;
+
+  // Joining a running group - match the rest of the group now
+  if (!group->needsSync) {
+    if (group->lampsOn) LampStates[lampCol] &= ~lampBit;
+    else LampStates[lampCol] |= lampBit;
+  }
+  return true;
+}
+
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+void SetLampPWMPattern(byte lampNum, byte lampCol, byte lampBit, byte pwmLevel) {
+  if (LampShownPWMLevel[lampNum] == pwmLevel) return;
+  LampShownPWMLevel[lampNum] = pwmLevel;
+
+  unsigned short litSlots = LampPWMLevelPasses[pwmLevel];
+  for (byte slot = 0; slot < LAMP_PWM_FRAME_PASSES; slot++) {
+    if (litSlots & 0x0001) LampPWMOffSlots[slot][lampCol] &= ~lampBit;
+    else LampPWMOffSlots[slot][lampCol] |= lampBit;
+    litSlots >>= 1;
+  }
+}
+
+// The old dim levels are lit one pass in every divisor passes, so
+// divisors of 2, 3 and 4 map straight onto a PWM level. Anything
+// bigger (both dim bits at the default 2 and 3 used to be 1 in 6, a
+// 10 Hz blink) is shown at 1/4 instead.
+byte DimmedLampPWMLevel(byte lampDim) {
+  byte divisor = 1;
+  if (lampDim & 0x01) divisor *= DimDivisor1;
+  if (lampDim & 0x02) divisor *= DimDivisor2;
+  if (divisor <= 1) return RPU_LAMP_PWM_FULL;
+  if (divisor == 2) return RPU_LAMP_PWM_HALF;
+  if (divisor == 3) return RPU_LAMP_PWM_THIRD;
+  return RPU_LAMP_PWM_QUARTER;
+}
+
+// RPU_MPU_ARCHITECTURE >= 10
+// The PWM level is used whenever the lamp isn't set with a dim level
+void RPU_SetLampPWMLevel(int lampNum, byte pwmLevel) {
+  if (lampNum >= RPU_MAX_LAMPS || lampNum < 0) return;
+  if (pwmLevel > RPU_LAMP_PWM_FULL) pwmLevel = RPU_LAMP_PWM_FULL;
+  LampPWMLevel[lampNum] = pwmLevel;
+
+  byte lampCol = lampNum / 8;
+  byte lampBit = BitShiftValues[lampNum % 8];
+  if (!((LampDim1[lampCol] | LampDim2[lampCol]) & lampBit)) SetLampPWMPattern(lampNum, lampCol, lampBit, pwmLevel);
+}
+
+// RPU_MPU_ARCHITECTURE >= 10
+byte RPU_ReadLampPWMLevel(int lampNum) {
+  if (lampNum >= RPU_MAX_LAMPS || lampNum < 0) return 0;
+  return LampShownPWMLevel[lampNum];
+}
+#endif
+
+void RPU_SetLampState(int lampNum, byte s_lampState, byte s_lampDim, int s_lampFlashPeriod, int s_lampFlashOffset) {
   if (lampNum >= RPU_MAX_LAMPS || lampNum < 0) return;
   byte lampRow = lampNum % 8;
   byte lampCol = lampNum / 8;
   byte lampBit = BitShiftValues[lampRow];
 
+#if (RPU_MPU_ARCHITECTURE<10) || (RPU_OS_HARDWARE_REV>=200)
+  // Lamps a layer or the animation owns are left to ApplyLampOverlays
+  byte overlayLamps = 0;
+  for (byte position = 0; position < LAMP_NUM_OVERLAYS; position++) {
+    overlayLamps |= LampOverlayOnMasks[position][lampCol] | LampOverlayOffMasks[position][lampCol];
+  }
+  if (overlayLamps & lampBit) return;
+#endif
 
-  if (s_lampState) {
-    int adjustedLampFlash = s_lampFlashPeriod / 50;
-
-    if (s_lampFlashPeriod != 0 && adjustedLampFlash == 0) adjustedLampFlash = 1;
-    if (adjustedLampFlash > 250) adjustedLampFlash = 250;
 
-    // Only turn on the lamp if there's no flash, because if there's a flash
-    // then the lamp will be turned on by the ApplyFlashToLamps function
-    if (s_lampFlashPeriod == 0) LampStates[lampCol] &= ~(lampBit);
-    LampFlashPeriod[lampNum] = adjustedLampFlash;
+  if (s_lampState) {
+    // A flashing lamp is turned on and off by RPU_ApplyFlashToLamps
+    // (if there's no group left for it, it's just left on)
+    boolean lampFlashing = false;
+    if (s_lampFlashPeriod > 0) {
+      unsigned short phaseOffset = 0;
+      if (s_lampFlashOffset) {
+        long fullPeriod = 2 * (long)s_lampFlashPeriod;
+        phaseOffset = (unsigned short)(((s_lampFlashOffset % fullPeriod) + fullPeriod) % fullPeriod);
+      }
+      lampFlashing = AddLampToFlashGroup(lampNum, lampCol, lampBit, s_lampFlashPeriod, phaseOffset);
+    } else {
+      RemoveLampFromFlashGroup(lampNum, lampCol, lampBit);
+    }
+    if (!lampFlashing) LampStates[lampCol] &= ~(lampBit);
   } else {
     LampStates[lampCol] |= lampBit;
-    LampFlashPeriod[lampNum] = 0;
+    RemoveLampFromFlashGroup(lampNum, lampCol, lampBit);
   }
 
   if (s_lampDim & 0x01) {
@@ -2203,6 +3544,9 @@ void RPU_SetLampState(int lampNum, byte s_lampState, byte s_lampDim, int s_lampF
     LampDim2[lampCol] &= ~lampBit;
   }
 
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+  SetLampPWMPattern(lampNum, lampCol, lampBit, s_lampDim ? DimmedLampPWMLevel(s_lampDim) : LampPWMLevel[lampNum]);
+#endif
 }
 
 byte RPU_ReadLampState(int lampNum) {
@@ -2223,48 +3567,393 @@ byte RPU_ReadLampDim(int lampNum) {
   return lampDim;
 }
 
-int RPU_ReadLampFlash(int lampNum) {
-  if (lampNum >= RPU_MAX_LAMPS || lampNum < 0) return 0;
+int RPU_ReadLampFlash(int lampNum) {
+  if (lampNum >= RPU_MAX_LAMPS || lampNum < 0) return 0;
+  if (LampFlashGroupNum[lampNum] == LAMP_FLASH_GROUP_NONE) return 0;
+
+  return LampFlashGroups[LampFlashGroupNum[lampNum]].period;
+}
+
+unsigned short RPU_GetLampFlashGroupOverflows() {
+  return LampFlashGroupOverflows;
+}
+
+// Flash groups own their lamps, so every buffer (including
+// frames that are still waiting to be shown) gets the change
+void ShowFlashGroup(LampFlashGroup *group) {
+  for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+    byte lampMask = group->lampMask[lampBank];
+    if (lampMask == 0) continue;
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+    for (byte bufferNum = 0; bufferNum < LAMP_NUM_FRAME_BUFFERS; bufferNum++) {
+      if (group->lampsOn) LampBuffers[bufferNum][lampBank] &= ~lampMask;
+      else LampBuffers[bufferNum][lampBank] |= lampMask;
+    }
+#else
+    if (group->lampsOn) LampStates[lampBank] &= ~lampMask;
+    else LampStates[lampBank] |= lampMask;
+#endif
+  }
+}
+
+void RPU_ApplyFlashToLamps(unsigned long curTime) {
+  for (byte groupNum = 0; groupNum < RPU_NUM_LAMP_FLASH_GROUPS; groupNum++) {
+    LampFlashGroup *group = &LampFlashGroups[groupNum];
+    if (group->numLamps == 0) continue;
+    if (!group->needsSync && (long)(curTime - group->nextToggle) < 0) continue;
+
+    // Crossed a half-period boundary - this is the only
+    // place that divides
+    unsigned long shiftedTime = curTime + group->phaseOffset;
+    unsigned long halfPeriods = shiftedTime / group->period;
+    group->nextToggle = curTime + (group->period - (shiftedTime - halfPeriods * group->period));
+    group->lampsOn = (halfPeriods % 2) ? true : false;
+    group->needsSync = false;
+
+    ShowFlashGroup(group);
+  }
+}
+
+void RPU_FlashAllLamps(unsigned long curTime) {
+  for (int count = 0; count < RPU_MAX_LAMPS; count++) {
+    RPU_SetLampState(count, 1, 0, 500);
+  }
+
+  RPU_ApplyFlashToLamps(curTime);
+}
+
+void RPU_TurnOffAllLamps() {
+  for (int count = 0; count < RPU_MAX_LAMPS; count++) {
+    RPU_SetLampState(count, 0, 0, 0);
+  }
+}
+
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+// RPU_MPU_ARCHITECTURE >= 10
+// Lamp writes go to a back buffer until RPU_CommitLampFrame. The
+// frame starts as a copy of the last one (or all off, except for
+// flashing lamps, if clearFrame is set).
+void RPU_BeginLampFrame(boolean clearFrame) {
+  if (LampFrameOpen) return;
+
+  noInterrupts();
+  for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+    LampBackBuffer[lampBank] = clearFrame ? 0xFF : LampStates[lampBank];
+  }
+  LampStates = LampBackBuffer;
+  interrupts();
+
+  if (clearFrame) {
+    for (byte groupNum = 0; groupNum < RPU_NUM_LAMP_FLASH_GROUPS; groupNum++) {
+      if (LampFlashGroups[groupNum].numLamps && !LampFlashGroups[groupNum].needsSync) ShowFlashGroup(&LampFlashGroups[groupNum]);
+    }
+  }
+  LampFrameOpen = true;
+}
+
+// RPU_MPU_ARCHITECTURE >= 10
+// A full commit is swapped in by the interrupt at the start of
+// the next strobe cycle, so the frame is never shown half done
+// (a newer commit replaces one that hasn't been shown yet).
+// With changedBanksOnly, only the banks that differ from the
+// last frame are copied straight into the shown buffer - cheaper,
+// and each bank changes at once, but a change can land mid-cycle.
+void RPU_CommitLampFrame(boolean changedBanksOnly) {
+  if (!LampFrameOpen) return;
+  LampFrameOpen = false;
+
+  noInterrupts();
+  if (changedBanksOnly && !LampFramePending) {
+    for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+      if (LampFrontBuffer[lampBank] != LampBackBuffer[lampBank]) LampFrontBuffer[lampBank] = LampBackBuffer[lampBank];
+    }
+    LampStates = LampFrontBuffer;
+  } else {
+    volatile byte *committedFrame = LampBackBuffer;
+    LampBackBuffer = LampSpareBuffer;
+    LampSpareBuffer = committedFrame;
+    LampStates = committedFrame;
+    LampFramePending = true;
+  }
+  interrupts();
+}
+#endif
+
+// Mode layer is LampLayers[0], override is LampLayers[1]
+LampLayer *GetLampLayer(byte layerNum) {
+  if (layerNum == RPU_LAMP_LAYER_MODE) return &LampLayers[0];
+  if (layerNum == RPU_LAMP_LAYER_OVERRIDE) return &LampLayers[1];
+  return NULL;
+}
+
+// lampState is RPU_LAYER_LAMP_OFF, _ON or _FLASH (at the layer's
+// flash period). Setting a lamp to what it already is costs a
+// couple of compares.
+void RPU_SetLayerLamp(byte layerNum, byte lampNum, byte lampState) {
+  LampLayer *layer = GetLampLayer(layerNum);
+  if (layer == NULL || lampNum >= RPU_MAX_LAMPS) return;
+  byte lampBank = lampNum / 8;
+  byte lampBit = BitShiftValues[lampNum % 8];
+
+  byte ownerMask = layer->ownerMask[lampBank] | lampBit;
+  byte onMask = (lampState != RPU_LAYER_LAMP_OFF) ? (layer->onMask[lampBank] | lampBit) : (layer->onMask[lampBank] & ~lampBit);
+  byte flashMask = (lampState == RPU_LAYER_LAMP_FLASH) ? (layer->flashMask[lampBank] | lampBit) : (layer->flashMask[lampBank] & ~lampBit);
+  if (ownerMask == layer->ownerMask[lampBank] && onMask == layer->onMask[lampBank] && flashMask == layer->flashMask[lampBank]) return;
+
+  layer->ownerMask[lampBank] = ownerMask;
+  layer->onMask[lampBank] = onMask;
+  layer->flashMask[lampBank] = flashMask;
+  layer->changedBanks |= (1 << lampBank);
+}
+
+// Hands the lamp back to the layers below
+void RPU_ReleaseLayerLamp(byte layerNum, byte lampNum) {
+  LampLayer *layer = GetLampLayer(layerNum);
+  if (layer == NULL || lampNum >= RPU_MAX_LAMPS) return;
+  byte lampBank = lampNum / 8;
+  byte lampBit = BitShiftValues[lampNum % 8];
+  if (!(layer->ownerMask[lampBank] & lampBit)) return;
+
+  layer->ownerMask[lampBank] &= ~lampBit;
+  layer->onMask[lampBank] &= ~lampBit;
+  layer->flashMask[lampBank] &= ~lampBit;
+  layer->changedBanks |= (1 << lampBank);
+}
+
+// Drops everything the layer owns (for when a mode ends)
+void RPU_ClearLampLayer(byte layerNum) {
+  LampLayer *layer = GetLampLayer(layerNum);
+  if (layer == NULL) return;
+  for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+    if (layer->ownerMask[lampBank] == 0) continue;
+    layer->ownerMask[lampBank] = 0;
+    layer->onMask[lampBank] = 0;
+    layer->flashMask[lampBank] = 0;
+    layer->changedBanks |= (1 << lampBank);
+  }
+}
+
+void RPU_SetLampLayerFlashPeriod(byte layerNum, unsigned short flashPeriod) {
+  LampLayer *layer = GetLampLayer(layerNum);
+  if (layer == NULL || flashPeriod == 0) return;
+  layer->flashPeriod = flashPeriod;
+}
+
+// Higher priority overlays win. The base layer is always at the
+// bottom, and overlays with the same priority keep the default order
+// (mode, animation, override).
+void RPU_SetLampLayerPriority(byte layerNum, byte priority) {
+  if (layerNum < RPU_LAMP_LAYER_MODE || layerNum > RPU_LAMP_LAYER_OVERRIDE) return;
+  LampOverlayPriority[layerNum - RPU_LAMP_LAYER_MODE] = priority;
+
+  byte overlayOrder[LAMP_NUM_OVERLAYS];
+  for (byte overlay = 0; overlay < LAMP_NUM_OVERLAYS; overlay++) {
+    byte position = overlay;
+    while (position > 0 && LampOverlayPriority[overlayOrder[position - 1]] > LampOverlayPriority[overlay]) {
+      overlayOrder[position] = overlayOrder[position - 1];
+      position -= 1;
+    }
+    overlayOrder[position] = overlay;
+  }
+
+  noInterrupts();
+  for (byte position = 0; position < LAMP_NUM_OVERLAYS; position++) {
+    byte overlay = overlayOrder[position];
+    if (overlay == 1) {
+      LampOverlayOnMasks[position] = LampAnimationOnMask;
+      LampOverlayOffMasks[position] = LampAnimationOffMask;
+    } else {
+      byte layerCount = (overlay == 0) ? 0 : 1;
+      LampOverlayOnMasks[position] = LampLayerOnMask[layerCount];
+      LampOverlayOffMasks[position] = LampLayerOffMask[layerCount];
+    }
+  }
+  interrupts();
+}
+
+#if (RPU_MPU_ARCHITECTURE<10) || (RPU_OS_HARDWARE_REV>=200)
+// No interrupt compositor here, so the overlays are written into the
+// lamp states, lowest priority first, after the game has set its lamps
+// (RPU_SetLampState leaves the lamps they own alone)
+void ApplyLampOverlays() {
+  for (byte position = 0; position < LAMP_NUM_OVERLAYS; position++) {
+    volatile byte *onMasks = LampOverlayOnMasks[position];
+    volatile byte *offMasks = LampOverlayOffMasks[position];
+    for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+      byte lampsOn = onMasks[lampBank];
+      byte lampsOff = offMasks[lampBank];
+      if ((lampsOn | lampsOff) == 0) continue;
+
+      byte lampBit = 0x01;
+      for (byte bitNum = 0; bitNum < 8; bitNum++) {
+        if ((lampsOn | lampsOff) & lampBit) RemoveLampFromFlashGroup(lampBank * 8 + bitNum, lampBank, lampBit);
+        lampBit *= 2;
+      }
+      LampStates[lampBank] = (LampStates[lampBank] | lampsOff) & ~lampsOn;
+    }
+  }
+}
+#endif
+
+// Blends the banks that changed since last time into the overlays
+void RPU_UpdateLampLayers(unsigned long curTime) {
+  for (byte layerCount = 0; layerCount < LAMP_NUM_COMPOSITOR_LAYERS; layerCount++) {
+    LampLayer *layer = &LampLayers[layerCount];
+
+    if ((long)(curTime - layer->nextFlashToggle) >= 0) {
+      layer->flashOn = (layer->flashOn) ? false : true;
+      layer->nextFlashToggle = curTime + layer->flashPeriod;
+      for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+        if (layer->flashMask[lampBank]) layer->changedBanks |= (1 << lampBank);
+      }
+    }
+    if (layer->changedBanks == 0) continue;
+
+    for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+      if (!(layer->changedBanks & (1 << lampBank))) continue;
+      byte lampsOn = layer->onMask[lampBank];
+      if (!layer->flashOn) lampsOn &= ~layer->flashMask[lampBank];
+      byte lampsOff = layer->ownerMask[lampBank] & ~lampsOn;
+      // On beats off in the interrupt, so growing both masks before
+      // shrinking them means a lamp never falls through to the layer
+      // below while it changes
+      LampLayerOnMask[layerCount][lampBank] |= lampsOn;
+      LampLayerOffMask[layerCount][lampBank] |= lampsOff;
+      LampLayerOnMask[layerCount][lampBank] = lampsOn;
+      LampLayerOffMask[layerCount][lampBank] = lampsOff;
+    }
+    layer->changedBanks = 0;
+  }
+
+#if (RPU_MPU_ARCHITECTURE<10) || (RPU_OS_HARDWARE_REV>=200)
+  ApplyLampOverlays();
+#endif
+}
+
+// Draws LampAnimationStep into the animation overlay and moves on to
+// the next step (a one-shot animation ends once its last step has had
+// its time)
+void RenderLampAnimationStep() {
+  if (LampAnimationStep >= LampAnimationNumSteps) {
+    LampAnimationActive = false;
+    for (byte lampBank = 0; lampBank < LAMP_ANIMATION_BANKS; lampBank++) {
+      LampAnimationOnMask[lampBank] = 0x00;
+      LampAnimationOffMask[lampBank] = 0x00;
+    }
+    return;
+  }
+
+  byte frameStep = LampAnimationStep;
+  if (LampAnimationFlags & RPU_LAMP_ANIMATION_REVERSE) frameStep = (LampAnimationNumSteps - 1) - frameStep;
+  const byte *frame = LampAnimationFrames + frameStep * LAMP_ANIMATION_BANKS;
+  const byte *trail = NULL;
+  if (LampAnimationSubOffset) {
+    byte trailStep = frameStep + LampAnimationSubOffset;
+    if (trailStep >= LampAnimationNumSteps) trailStep -= LampAnimationNumSteps;
+    trail = LampAnimationFrames + trailStep * LAMP_ANIMATION_BANKS;
+  }
+
+  for (byte lampBank = 0; lampBank < LAMP_ANIMATION_BANKS; lampBank++) {
+    byte lampsOn = pgm_read_byte(frame + lampBank);
+    byte lampsOff = trail ? (pgm_read_byte(trail + lampBank) & ~LampAnimationKeepMask[lampBank]) : 0x00;
+    LampAnimationOnMask[lampBank] = (LampAnimationOnMask[lampBank] & ~lampsOff) | lampsOn;
+    LampAnimationOffMask[lampBank] = (LampAnimationOffMask[lampBank] | lampsOff) & ~lampsOn;
+  }
+
+  LampAnimationStep += 1;
+  if (LampAnimationStep >= LampAnimationNumSteps && !(LampAnimationFlags & RPU_LAMP_ANIMATION_ONE_SHOT)) LampAnimationStep = 0;
+}
+
+// animationFrames is a PROGMEM table of numSteps x 8 bytes (a set bit
+// turns the lamp on). Each step, the lamps in the step subOffset ahead
+// are turned off first (the trail). The starting step comes from
+// baseTime, the same as (baseTime / stepMS) % numSteps, and the next
+// step comes when that one would have ended. Starting the animation
+// that's already running does nothing, so this can be called every loop.
+void RPU_StartLampAnimation(const byte *animationFrames, byte numSteps, unsigned short stepMS, unsigned long baseTime, byte subOffset, byte flags) {
+  if (animationFrames == NULL || numSteps == 0 || stepMS == 0) return;
+  if (LampAnimationActive && animationFrames == LampAnimationFrames && numSteps == LampAnimationNumSteps &&
+      stepMS == LampAnimationStepMS && subOffset == LampAnimationSubOffset && flags == LampAnimationFlags) return;
+
+  byte startStep = (baseTime / stepMS) % numSteps;
+  unsigned short startPhase = baseTime % stepMS;
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+  unsigned long stepCounts = (unsigned long)stepMS * LAMP_ANIMATION_COUNTS_PER_MS;
+  if (stepCounts < LAMP_ANIMATION_TICK_COUNTS) stepCounts = LAMP_ANIMATION_TICK_COUNTS;
+#endif
 
-  return LampFlashPeriod[lampNum] * 50;
+  noInterrupts();
+  LampAnimationFrames = animationFrames;
+  LampAnimationNumSteps = numSteps;
+  LampAnimationStepMS = stepMS;
+  LampAnimationSubOffset = subOffset % numSteps;
+  LampAnimationFlags = flags;
+  LampAnimationStep = startStep;
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+  // The first step is drawn on the next tick, with startPhase
+  // of it already gone
+  LampAnimationStepCounts = stepCounts;
+  LampAnimationCounts = (stepCounts - LAMP_ANIMATION_TICK_COUNTS) + (unsigned long)startPhase * LAMP_ANIMATION_COUNTS_PER_MS;
+#else
+  // The clock starts on the next RPU_Update
+  LampAnimationStartTime = 0;
+  LampAnimationStartPhase = startPhase;
+  LampAnimationFirstStep = startStep;
+#endif
+  for (byte lampBank = 0; lampBank < LAMP_ANIMATION_BANKS; lampBank++) {
+    LampAnimationOnMask[lampBank] = 0x00;
+    LampAnimationOffMask[lampBank] = 0x00;
+  }
+  LampAnimationActive = true;
+  interrupts();
 }
 
-void RPU_ApplyFlashToLamps(unsigned long curTime) {
-  int curLampByte = 0;
-  byte curLampBit = 0;
-  int curLampNum = 0;
-
-  for (curLampByte = 0; curLampByte < RPU_NUM_LAMP_BANKS; curLampByte++) {
-    curLampBit = 0x01;
-    for (byte curBit = 0; curBit < 8; curBit++) {
-      if ( LampFlashPeriod[curLampNum] != 0 ) {
-        unsigned long adjustedLampFlash = (unsigned long)LampFlashPeriod[curLampNum] * (unsigned long)50;
-        if ((curTime / adjustedLampFlash) % 2) {
-          LampStates[curLampByte] &= ~(curLampBit);
-        } else {
-          LampStates[curLampByte] |= (curLampBit);
-        }
-      }
+void RPU_StopLampAnimation() {
+  if (!LampAnimationActive) return;
 
-      curLampBit *= 2;
-      curLampNum += 1;
-    }
+  noInterrupts();
+  LampAnimationActive = false;
+  for (byte lampBank = 0; lampBank < LAMP_ANIMATION_BANKS; lampBank++) {
+    LampAnimationOnMask[lampBank] = 0x00;
+    LampAnimationOffMask[lampBank] = 0x00;
   }
+  interrupts();
 }
 
-void RPU_FlashAllLamps(unsigned long curTime) {
-  for (int count = 0; count < RPU_MAX_LAMPS; count++) {
-    RPU_SetLampState(count, 1, 0, 500);
-  }
+boolean RPU_LampAnimationRunning() {
+  return LampAnimationActive;
+}
 
-  RPU_ApplyFlashToLamps(curTime);
+// Lamps in the keep mask are never turned off by the trail
+void RPU_SetLampAnimationKeepMask(byte lampBank, byte keepMask) {
+  if (lampBank >= LAMP_ANIMATION_BANKS) return;
+  LampAnimationKeepMask[lampBank] = keepMask;
 }
 
-void RPU_TurnOffAllLamps() {
-  for (int count = 0; count < RPU_MAX_LAMPS; count++) {
-    RPU_SetLampState(count, 0, 0, 0);
-  }
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+// RPU_MPU_ARCHITECTURE >= 10 (called from the ISR every lamp strobe)
+void AdvanceLampAnimation() {
+  LampAnimationCounts += LAMP_ANIMATION_TICK_COUNTS;
+  if (LampAnimationCounts < LampAnimationStepCounts) return;
+  LampAnimationCounts -= LampAnimationStepCounts;
+  RenderLampAnimationStep();
+}
+#else
+// No interrupt player here, so the overlay is drawn for the current
+// time (called by RPU_Update) and RPU_UpdateLampLayers writes it into
+// the lamp states
+void RPU_UpdateLampAnimation(unsigned long curTime) {
+  if (!LampAnimationActive) return;
+  if (LampAnimationStartTime == 0) LampAnimationStartTime = curTime;
+
+  unsigned long stepsDone = (curTime - LampAnimationStartTime + LampAnimationStartPhase) / LampAnimationStepMS;
+  unsigned long curStep = LampAnimationFirstStep + stepsDone;
+  if (!(LampAnimationFlags & RPU_LAMP_ANIMATION_ONE_SHOT)) curStep %= LampAnimationNumSteps;
+  else if (curStep > LampAnimationNumSteps) curStep = LampAnimationNumSteps;
+  LampAnimationStep = (byte)curStep;
+  RenderLampAnimationStep();
 }
+#endif
 
 
 
@@ -2278,18 +3967,33 @@ void RPU_TurnOffAllLamps() {
 
 void RPU_ClearVariables() {
   // Reset solenoid stack
-  SolenoidStackFirst = 0;
-  SolenoidStackLast = 0;
+  SolenoidStack.Clear();
 
   // Reset switch stack
-  SwitchStackFirst = 0;
-  SwitchStackLast = 0;
+  SwitchStack.Clear();
+  PrioritySwitchStack.Clear();
+  PrioritySwitchesSpilled = false;
+
+#ifdef RPU_ISR_PROFILER
+  // Starts each phase's minimum at 0xFFFF (it would stay at 0 otherwise)
+  RPU_ResetISRProfile();
+#endif
+
+#if (RPU_MPU_ARCHITECTURE > 9 && RPU_OS_HARDWARE_REV<200)
+  for (byte count = 0; count < RPU_NUM_SOLENOIDS; count++) {
+    SolenoidMaxDuty[count] = 100;
+    SolenoidMinRefireTicks[count] = 0;
+    SolenoidPowerGroup[count] = 0;
+  }
+  for (byte count = 0; count < RPU_NUM_SOLENOID_POWER_GROUPS; count++) {
+    PowerGroupMaxActive[count] = 0xFF;
+  }
+#endif
 
 #if (RPU_MPU_ARCHITECTURE > 9)
   GameOverLine = true;
   // Reset sound stack
-  SoundStackFirst = 0;
-  SoundStackLast = 0;
+  SoundStack.Clear();
 #endif
 
   CurrentDisplayDigit = 0;
@@ -2300,12 +4004,27 @@ void RPU_ClearVariables() {
       DisplayDigits[displayCount][digitCount] = 0;
     }
     DisplayDigitEnable[displayCount] = 0x00;
+#if (RPU_MPU_ARCHITECTURE<15)
+    DisplayCacheOptions[displayCount] = 0;
+    DisplayEffects[displayCount].effectType = RPU_DISPLAY_EFFECT_NONE;
+#endif
   }
 #if (RPU_MPU_ARCHITECTURE>=13)
   DisplayCommas = 0x00;
 #endif
 
   // Turn off all lamp states
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+  LampFramePending = false;
+  LampFrameOpen = false;
+  LampFrontBuffer = LampBuffers[0];
+  LampSpareBuffer = LampBuffers[1];
+  LampBackBuffer = LampBuffers[2];
+  LampStates = LampFrontBuffer;
+  for (byte bufferNum = 0; bufferNum < LAMP_NUM_FRAME_BUFFERS; bufferNum++) {
+    for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) LampBuffers[bufferNum][lampBank] = 0xFF;
+  }
+#endif
   for (int lampBankCounter = 0; lampBankCounter < RPU_NUM_LAMP_BANKS; lampBankCounter++) {
     LampStates[lampBankCounter] = 0xFF;
     LampDim1[lampBankCounter] = 0x00;
@@ -2317,7 +4036,42 @@ void RPU_ClearVariables() {
   }
 
   for (int lampFlashCount = 0; lampFlashCount < RPU_MAX_LAMPS; lampFlashCount++) {
-    LampFlashPeriod[lampFlashCount] = 0;
+    LampFlashGroupNum[lampFlashCount] = LAMP_FLASH_GROUP_NONE;
+  }
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+  for (int lampCount = 0; lampCount < RPU_MAX_LAMPS; lampCount++) {
+    LampPWMLevel[lampCount] = RPU_LAMP_PWM_FULL;
+    LampShownPWMLevel[lampCount] = RPU_LAMP_PWM_FULL;
+  }
+  for (byte slot = 0; slot < LAMP_PWM_FRAME_PASSES; slot++) {
+    for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) LampPWMOffSlots[slot][lampBank] = 0x00;
+  }
+#endif
+  for (byte layerCount = 0; layerCount < LAMP_NUM_COMPOSITOR_LAYERS; layerCount++) {
+    LampLayers[layerCount].flashPeriod = 250;
+    LampLayers[layerCount].nextFlashToggle = 0;
+    LampLayers[layerCount].flashOn = false;
+    LampLayers[layerCount].changedBanks = 0;
+    for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+      LampLayers[layerCount].ownerMask[lampBank] = 0x00;
+      LampLayers[layerCount].onMask[lampBank] = 0x00;
+      LampLayers[layerCount].flashMask[lampBank] = 0x00;
+      LampLayerOnMask[layerCount][lampBank] = 0x00;
+      LampLayerOffMask[layerCount][lampBank] = 0x00;
+    }
+  }
+  for (byte layerNum = RPU_LAMP_LAYER_MODE; layerNum <= RPU_LAMP_LAYER_OVERRIDE; layerNum++) {
+    RPU_SetLampLayerPriority(layerNum, LAMP_DEFAULT_PRIORITY(layerNum - RPU_LAMP_LAYER_MODE));
+  }
+  LampAnimationActive = false;
+  for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) {
+    if (lampBank < LAMP_ANIMATION_BANKS) LampAnimationKeepMask[lampBank] = 0x00;
+    LampAnimationOnMask[lampBank] = 0x00;
+    LampAnimationOffMask[lampBank] = 0x00;
+  }
+  for (byte groupNum = 0; groupNum < RPU_NUM_LAMP_FLASH_GROUPS; groupNum++) {
+    LampFlashGroups[groupNum].numLamps = 0;
+    for (byte lampBank = 0; lampBank < RPU_NUM_LAMP_BANKS; lampBank++) LampFlashGroups[groupNum].lampMask[lampBank] = 0;
   }
 
   // Reset all the switch values
@@ -2328,57 +4082,26 @@ void RPU_ClearVariables() {
     SwitchesMinus1[switchCount] = 0xFF;
     SwitchesNow[switchCount] = 0xFF;
     SwitchInverter[switchCount] = 0x00;
-#ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
-    ImmediateSolenoidSwitchMask[switchCount] = 0x00;
+#if (RPU_MPU_ARCHITECTURE>=10)
+    SwitchesDebounced[switchCount] = 0xFF;
+    for (byte plane = 0; plane < 3; plane++) {
+      SwitchDebounceCount[plane][switchCount] = 0x00;
+      SwitchClosedSamples[plane][switchCount] = ((SWITCH_DEBOUNCE_DEFAULT_SAMPLES >> plane) & 0x01) ? 0xFF : 0x00;
+      SwitchOpenSamples[plane][switchCount] = ((SWITCH_DEBOUNCE_DEFAULT_SAMPLES >> plane) & 0x01) ? 0xFF : 0x00;
+    }
 #endif
   }
 
 #ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
-  for (byte count = 0; count < MAX_IMMEDIATE_STREAMLINED_SOLENOIDS; count++) {
-    ImmediateSolenoidSwitchByte[count] = 0x00;
-    ImmediateSolenoidSwitchFlag[count] = 0x00;
-  }
-
-  if (GameSwitches) {
-    for (byte count = 0; count < NumGameSwitches; count++) {
-      if (GameSwitches[count].switchNum < MAX_NUM_SWITCHES) {
-        ImmediateSolenoidSwitchMask[GameSwitches[count].switchNum / 8] |= (0x01 << (GameSwitches[count].switchNum % 8));
-        ImmediateSolenoidSwitchByte[count] = GameSwitches[count].switchNum / 8;
-        ImmediateSolenoidSwitchFlag[count] = (0x01 << (GameSwitches[count].switchNum % 8));
-      }
-    }
-/*
-    if (DEBUG_MESSAGES) {
-      char buf[256];
-      for (byte count = 0; count < NUM_SWITCH_BYTES; count++) {
-        sprintf(buf, "Switch mask byte %d = 0x%02X\n", count, ImmediateSolenoidSwitchMask[count]);
-        Serial.write(buf);
-      }
-      for (byte count = 0; count < NumGameSwitches; count++) {
-        sprintf(buf, "Triggered sol switch=%d, byte=%d, mask=0x%02X\n", GameSwitches[count].switchNum, ImmediateSolenoidSwitchByte[count], ImmediateSolenoidSwitchFlag[count]);
-        Serial.write(buf);
-      }
-    }
-*/    
-
-  }
+  BuildImmediateSolenoidMasks();
 #endif
 
-  for (byte count = 0; count < TIMED_SOLENOID_STACK_SIZE; count++) {
-    TimedSolenoidStack[count].inUse = 0;
-    TimedSolenoidStack[count].pushTime = 0;
-    TimedSolenoidStack[count].solenoidNumber = 0;
-    TimedSolenoidStack[count].numPushes = 0;
-    TimedSolenoidStack[count].disableOverride = 0;
-  }
+  TimedSolenoidStack.count = 0;
+  TimedSolenoidStack.overflows = 0;
 
 #if (RPU_MPU_ARCHITECTURE > 9)
-  for (byte count = 0; count < TIMED_SOUND_STACK_SIZE; count++) {
-    TimedSoundStack[count].inUse = 0;
-    TimedSoundStack[count].pushTime = 0;
-    TimedSoundStack[count].soundNumber = 0;
-    TimedSoundStack[count].numPushes = 0;
-  }
+  TimedSoundStack.count = 0;
+  TimedSoundStack.overflows = 0;
 #endif
 
 }
@@ -2404,39 +4127,39 @@ void RPU_PlaySoundSAndT(byte soundByte) {
   noInterrupts();
 
   // Get the current value of U11:PortB - current solenoids
-  oldSolenoidControlByte = RPU_DataRead(ADDRESS_U11_B);
+  oldSolenoidControlByte = ReadPIAShadow(ADDRESS_U11_B);
   soundLowerNibble = (oldSolenoidControlByte & 0xF0) | (soundByte & 0x0F);
   soundUpperNibble = (oldSolenoidControlByte & 0xF0) | (soundByte / 16);
 
   // Put 1s on momentary solenoid lines
-  RPU_DataWrite(ADDRESS_U11_B, oldSolenoidControlByte | 0x0F);
+  WritePIARegister(ADDRESS_U11_B, oldSolenoidControlByte | 0x0F);
 
   // Put sound latch low
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, 0x34);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, 0x34);
 
   // Let the strobe stay low for a moment
   delayMicroseconds(32);
 
   // Put sound latch high
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, 0x3C);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, 0x3C);
 
   // put the new byte on U11:PortB (the lower nibble is currently loaded)
-  RPU_DataWrite(ADDRESS_U11_B, soundLowerNibble);
+  WritePIARegister(ADDRESS_U11_B, soundLowerNibble);
 
   // wait 138 microseconds
   delayMicroseconds(138);
 
   // put the new byte on U11:PortB (the uppper nibble is currently loaded)
-  RPU_DataWrite(ADDRESS_U11_B, soundUpperNibble);
+  WritePIARegister(ADDRESS_U11_B, soundUpperNibble);
 
   // wait 76 microseconds
   delayMicroseconds(145);
 
   // Restore the original solenoid byte
-  RPU_DataWrite(ADDRESS_U11_B, oldSolenoidControlByte);
+  WritePIARegister(ADDRESS_U11_B, oldSolenoidControlByte);
 
   // Put sound latch low
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, 0x34);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, 0x34);
 
   interrupts();
 }
@@ -2496,42 +4219,42 @@ void RPU_PlaySoundDash51(byte soundByte) {
   noInterrupts();
 
   // Get the current value of U11:PortB - current solenoids
-  oldSolenoidControlByte = RPU_DataRead(ADDRESS_U11_B);
-  oldDisplayByte = RPU_DataRead(ADDRESS_U11_A);
+  oldSolenoidControlByte = ReadPIAShadow(ADDRESS_U11_B);
+  oldDisplayByte = ReadPIAShadow(ADDRESS_U11_A);
   soundLowerNibble = (oldSolenoidControlByte & 0xF0) | (soundByte & 0x0F);
   displayWithSoundBit4 = oldDisplayByte;
   if (soundByte & 0x10) displayWithSoundBit4 |= 0x02;
   else displayWithSoundBit4 &= 0xFD;
 
   // Put 1s on momentary solenoid lines
-  RPU_DataWrite(ADDRESS_U11_B, oldSolenoidControlByte | 0x0F);
+  WritePIARegister(ADDRESS_U11_B, oldSolenoidControlByte | 0x0F);
 
   // Put sound latch low
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, 0x34);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, 0x34);
 
   // Let the strobe stay low for a moment
   delayMicroseconds(68);
 
   // put bit 4 on Display Enable 7
-  RPU_DataWrite(ADDRESS_U11_A, displayWithSoundBit4);
+  WritePIARegister(ADDRESS_U11_A, displayWithSoundBit4);
 
   // Put sound latch high
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, 0x3C);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, 0x3C);
 
   // put the new byte on U11:PortB (the lower nibble is currently loaded)
-  RPU_DataWrite(ADDRESS_U11_B, soundLowerNibble);
+  WritePIARegister(ADDRESS_U11_B, soundLowerNibble);
 
   // wait 180 microseconds
   delayMicroseconds(180);
 
   // Restore the original solenoid byte
-  RPU_DataWrite(ADDRESS_U11_B, oldSolenoidControlByte);
+  WritePIARegister(ADDRESS_U11_B, oldSolenoidControlByte);
 
   // Restore the original display byte
-  RPU_DataWrite(ADDRESS_U11_A, oldDisplayByte);
+  WritePIARegister(ADDRESS_U11_A, oldDisplayByte);
 
   // Put sound latch low
-  RPU_DataWrite(ADDRESS_U11_B_CONTROL, 0x34);
+  WritePIARegister(ADDRESS_U11_B_CONTROL, 0x34);
 
   interrupts();
 }
@@ -2566,89 +4289,58 @@ void RPU_SetSoundValueLimits(unsigned short lowerLimit, unsigned short upperLimi
   SoundUpperLimit = upperLimit;
 }
 
-// RPU_OS_USE_WTYPE_1_SOUND or RPU_OS_USE_WTYPE_2_SOUND
-int SpaceLeftOnSoundStack() {
-  if (SoundStackFirst >= SOUND_STACK_SIZE || SoundStackLast >= SOUND_STACK_SIZE) return 0;
-  if (SoundStackLast >= SoundStackFirst) return ((SOUND_STACK_SIZE - 1) - (SoundStackLast - SoundStackFirst));
-  return (SoundStackFirst - SoundStackLast) - 1;
-}
-
 // RPU_OS_USE_WTYPE_1_SOUND or RPU_OS_USE_WTYPE_2_SOUND
 void RPU_PushToSoundStack(unsigned short soundNumber, byte numPushes) {
 #if (RPU_OS_HARDWARE_REV==200)
   RPU_LISYSendSoundCommand(soundNumber/256);
 #else 
-  // If the solenoid stack last index is out of range, then it's an error - return
-  if (SpaceLeftOnSoundStack() == 0) return;
   if (soundNumber < SoundLowerLimit || soundNumber > SoundUpperLimit) return;
 
   for (int count = 0; count < numPushes; count++) {
-    SoundStack[SoundStackLast] = soundNumber;
-
-    SoundStackLast += 1;
-    if (SoundStackLast == SOUND_STACK_SIZE) {
-      // If the end index is off the end, then wrap
-      SoundStackLast = 0;
-    }
-    // If the stack is now full, return
-    if (SpaceLeftOnSoundStack() == 0) return;
+    // If the stack is full, return
+    if (!SoundStack.Push(soundNumber)) return;
   }
 #endif  
 }
 
 // RPU_OS_USE_WTYPE_1_SOUND or RPU_OS_USE_WTYPE_2_SOUND
 unsigned short PullFirstFromSoundStack() {
-  // If first and last are equal, there's nothing on the stack
-  if (SoundStackFirst == SoundStackLast) {
-    return SOUND_STACK_EMPTY;
-  }
-
-  unsigned short retVal = SoundStack[SoundStackFirst];
-
-  SoundStackFirst += 1;
-  if (SoundStackFirst >= SOUND_STACK_SIZE) SoundStackFirst = 0;
-
+  unsigned short retVal;
+  if (!SoundStack.Pull(&retVal)) return SOUND_STACK_EMPTY;
   return retVal;
 }
 
 // RPU_OS_USE_WTYPE_1_SOUND or RPU_OS_USE_WTYPE_2_SOUND
 boolean RPU_PushToTimedSoundStack(unsigned short soundNumber, byte numPushes, unsigned long whenToPlay) {
-  for (int count = 0; count < TIMED_SOUND_STACK_SIZE; count++) {
-    if (!TimedSoundStack[count].inUse) {
-      TimedSoundStack[count].inUse = true;
-      TimedSoundStack[count].pushTime = whenToPlay;
-      TimedSoundStack[count].soundNumber = soundNumber;
-      TimedSoundStack[count].numPushes = numPushes;
-      return true;
-    }
-  }
-  return false;
+  return PushToTimedStack(&TimedSoundStack, soundNumber, numPushes, whenToPlay, 0);
 }
 
 // RPU_OS_USE_WTYPE_1_SOUND or RPU_OS_USE_WTYPE_2_SOUND
 void RPU_UpdateTimedSoundStack(unsigned long curTime) {
-  for (int count = 0; count < TIMED_SOUND_STACK_SIZE; count++) {
-    if (TimedSoundStack[count].inUse && TimedSoundStack[count].pushTime < curTime) {
-      RPU_PushToSoundStack(TimedSoundStack[count].soundNumber, TimedSoundStack[count].numPushes);
-      TimedSoundStack[count].inUse = false;
-    }
+  TimedStackEntry *dueEntry;
+  while ( (dueEntry = PullDueFromTimedStack(&TimedSoundStack, curTime)) != NULL ) {
+    RPU_PushToSoundStack(dueEntry->itemNumber, dueEntry->numPushes);
   }
 }
+
+unsigned short RPU_GetTimedSoundStackOverflows() {
+  return TimedSoundStack.overflows;
+}
 #endif
 
 #ifdef RPU_OS_USE_WTYPE_11_SOUND
 void RPU_PlayW11Sound(byte soundNum) {
-  RPU_DataWrite(PIA_SOUND_11_PORT_A, soundNum);
+  WritePIARegister(PIA_SOUND_11_PORT_A, soundNum);
   // Strobe CA2
-  RPU_DataWrite(PIA_SOUND_11_CONTROL_A, 0x34);
-  RPU_DataWrite(PIA_SOUND_11_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_SOUND_11_CONTROL_A, 0x34);
+  WritePIARegister(PIA_SOUND_11_CONTROL_A, 0x3C);
 }
 
 void RPU_PlayW11Music(byte songNum) {
-  RPU_DataWrite(PIA_WIDGET_PORT_B, songNum);
+  WritePIARegister(PIA_WIDGET_PORT_B, songNum);
   // Strobe CA2
-  RPU_DataWrite(PIA_WIDGET_CONTROL_B, 0x34);
-  RPU_DataWrite(PIA_WIDGET_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_WIDGET_CONTROL_B, 0x34);
+  WritePIARegister(PIA_WIDGET_CONTROL_B, 0x3C);
 }
 #endif
 
@@ -2764,31 +4456,34 @@ volatile byte InsideZeroCrossingInterrupt = 0;
 // for ARCH 1 (B/S)
 // RPU_MPU_ARCHITECTURE < 10
 ISR(TIMER1_COMPA_vect) {    //This is the interrupt request
+#ifdef RPU_ISR_PROFILER
+  unsigned short phaseStart = ISR_PROFILE_CLOCK();
+#endif
   // Backup U10A
-  byte backupU10A = RPU_DataRead(ADDRESS_U10_A);
+  byte backupU10A = ReadPIAShadow(ADDRESS_U10_A);
 
   // Disable lamp decoders & strobe latch
-  RPU_DataWrite(ADDRESS_U10_A, 0xFF);
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) | 0x08);
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) & 0xF7);
+  WritePIARegister(ADDRESS_U10_A, 0xFF);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) | 0x08);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) & 0xF7);
 #ifdef RPU_OS_USE_AUX_LAMPS
   // Also park the aux lamp board
-  RPU_DataWrite(ADDRESS_U11_A_CONTROL, RPU_DataRead(ADDRESS_U11_A_CONTROL) | 0x08);
-  RPU_DataWrite(ADDRESS_U11_A_CONTROL, RPU_DataRead(ADDRESS_U11_A_CONTROL) & 0xF7);
+  WritePIARegister(ADDRESS_U11_A_CONTROL, ReadPIAShadow(ADDRESS_U11_A_CONTROL) | 0x08);
+  WritePIARegister(ADDRESS_U11_A_CONTROL, ReadPIAShadow(ADDRESS_U11_A_CONTROL) & 0xF7);
 #endif
 
   // Blank Displays
-  RPU_DataWrite(ADDRESS_U10_A_CONTROL, RPU_DataRead(ADDRESS_U10_A_CONTROL) & 0xF7);
+  WritePIARegister(ADDRESS_U10_A_CONTROL, ReadPIAShadow(ADDRESS_U10_A_CONTROL) & 0xF7);
   // Set all 5 display latch strobes high
-  RPU_DataWrite(ADDRESS_U11_A, (RPU_DataRead(ADDRESS_U11_A)) | 0x01);
-  RPU_DataWrite(ADDRESS_U10_A, 0x0F);
+  WritePIARegister(ADDRESS_U11_A, ReadPIAShadow(ADDRESS_U11_A) | 0x01);
+  WritePIARegister(ADDRESS_U10_A, 0x0F);
 
   byte displayStrobeMask = 0x01;
   byte displayDigitsMask;
 #ifdef RPU_OS_USE_7_DIGIT_DISPLAYS
   displayDigitsMask = (0x02 << CurrentDisplayDigit);
 #else
-  displayDigitsMask = RPU_DataRead(ADDRESS_U11_A) & 0x02;
+  displayDigitsMask = ReadPIAShadow(ADDRESS_U11_A) & 0x02;
   displayDigitsMask |= (0x04 << CurrentDisplayDigit);
 #endif
 
@@ -2813,10 +4508,10 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request
     // The strobe for the four score displays is high here because then the strobes
     // are NOR'd with U10:CA2 (which mutes the signals during other actions).
     // Only one strobe is low (from the above line.
-    RPU_DataWrite(ADDRESS_U10_A, displayDataByte);
+    WritePIARegister(ADDRESS_U10_A, displayDataByte);
     if (displayCount == 4) {
       // Strobe #5 latch on U11A:b0
-      RPU_DataWrite(ADDRESS_U11_A, displayDigitsMask & 0xFE);
+      WritePIARegister(ADDRESS_U11_A, displayDigitsMask & 0xFE);
     }
 
     // Right now the "Display Latch Strobe" is high
@@ -2826,16 +4521,16 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request
     if (displayCount < 4) {
       displayDataByte |= 0x0F;
       // Need to delay a little to make sure the strobe is low (high on the port) for long enough
-      RPU_DataWrite(ADDRESS_U10_A, displayDataByte);
+      WritePIARegister(ADDRESS_U10_A, displayDataByte);
     } else {
-      RPU_DataWrite(ADDRESS_U11_A, displayDigitsMask | 0x01);
+      WritePIARegister(ADDRESS_U11_A, displayDigitsMask | 0x01);
     }
 
     displayStrobeMask *= 2;
   }
 
   // While the data is being strobed, we need to enable the current digit
-  RPU_DataWrite(ADDRESS_U11_A, displayDigitsMask | 0x01);
+  WritePIARegister(ADDRESS_U11_A, displayDigitsMask | 0x01);
 
   CurrentDisplayDigit = CurrentDisplayDigit + 1;
   if (CurrentDisplayDigit >= RPU_OS_NUM_DIGITS) {
@@ -2844,11 +4539,15 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request
   }
 
   // Stop Blanking (current digits are all latched and ready)
-  RPU_DataWrite(ADDRESS_U10_A_CONTROL, RPU_DataRead(ADDRESS_U10_A_CONTROL) | 0x08);
+  WritePIARegister(ADDRESS_U10_A_CONTROL, ReadPIAShadow(ADDRESS_U10_A_CONTROL) | 0x08);
 
   // Restore 10A from backup
-  RPU_DataWrite(ADDRESS_U10_A, backupU10A);
+  WritePIARegister(ADDRESS_U10_A, backupU10A);
 
+#ifdef RPU_ISR_PROFILER
+  EndISRPhase(RPU_ISR_PHASE_DISPLAY, &phaseStart);
+  if (TIFR1 & (1<<OCF1A)) ISROverruns += 1;
+#endif
 }
 
 // RPU_MPU_ARCHITECTURE < 10
@@ -2883,21 +4582,27 @@ void InterruptService3() {
   if ((u10BControl & 0x80) && (InsideZeroCrossingInterrupt == 0)) {
 
     InsideZeroCrossingInterrupt = InsideZeroCrossingInterrupt + 1;
+#ifdef RPU_ISR_PROFILER
+    // The display interrupt can run inside this one, so these
+    // phase times include any display refreshes they overlap
+    unsigned short zeroCrossingStart = ISR_PROFILE_CLOCK();
+    unsigned short phaseStart = zeroCrossingStart;
+#endif
     // Read U10B to clear interrupt
     RPU_DataRead(ADDRESS_U10_B);
 
-    byte u10BControlLatest = RPU_DataRead(ADDRESS_U10_B_CONTROL);
+    byte u10BControlLatest = ReadPIAShadow(ADDRESS_U10_B_CONTROL);
 
     // Backup contents of U10A
-    byte backup10A = RPU_DataRead(ADDRESS_U10_A);
+    byte backup10A = ReadPIAShadow(ADDRESS_U10_A);
 
     // Latch 0xFF separately without interrupt clear
-    RPU_DataWrite(ADDRESS_U10_A, 0xFF);
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) | 0x08);
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) & 0xF7);
+    WritePIARegister(ADDRESS_U10_A, 0xFF);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) | 0x08);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) & 0xF7);
 
     // Turn off U10BControl interrupts
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, 0x30);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, 0x30);
 
     // Copy old switch values
     byte switchCount;
@@ -2909,16 +4614,16 @@ void InterruptService3() {
       // Enable switch strobe
 #if defined(RPU_USE_EXTENDED_SWITCHES_ON_PB4) or defined(RPU_USE_EXTENDED_SWITCHES_ON_PB7)
       if (switchCount < NUM_SWITCH_BYTES_ON_U10_PORT_A) {
-        RPU_DataWrite(ADDRESS_U10_A, 0x01 << switchCount);
+        WritePIARegister(ADDRESS_U10_A, 0x01 << switchCount);
       } else {
         RPU_SetContinuousSolenoidBit(true, ST5_CONTINUOUS_SOLENOID_BIT);
       }
 #else
-      RPU_DataWrite(ADDRESS_U10_A, 0x01 << switchCount);
+      WritePIARegister(ADDRESS_U10_A, 0x01 << switchCount);
 #endif
 
       // Turn off U10:CB2 if it's on (because it strobes the last bank of dip switches
-      RPU_DataWrite(ADDRESS_U10_B_CONTROL, 0x34);
+      WritePIARegister(ADDRESS_U10_B_CONTROL, 0x34);
 
       // Delay for switch capacitors to charge
       delayMicroseconds(RPU_OS_SWITCH_DELAY_IN_MICROSECONDS);
@@ -2927,7 +4632,7 @@ void InterruptService3() {
       tempSwitchesNow[switchCount] = RPU_DataRead(ADDRESS_U10_B) ^ SwitchInverter[switchCount];
 
       //Unset the strobe
-      RPU_DataWrite(ADDRESS_U10_A, 0x00);
+      WritePIARegister(ADDRESS_U10_A, 0x00);
 #if defined(RPU_USE_EXTENDED_SWITCHES_ON_PB4) or defined(RPU_USE_EXTENDED_SWITCHES_ON_PB7)
       RPU_SetContinuousSolenoidBit(false, ST5_CONTINUOUS_SOLENOID_BIT);
 #endif
@@ -2941,7 +4646,7 @@ void InterruptService3() {
       
       noInterrupts();
     }
-    RPU_DataWrite(ADDRESS_U10_A, backup10A);
+    WritePIARegister(ADDRESS_U10_A, backup10A);
 
 #ifndef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
 
@@ -2995,7 +4700,7 @@ void InterruptService3() {
                   if (validSwitchCount < NumGamePrioritySwitches && immediateSolenoidFired == false) {
                     PushToFrontOfSolenoidStack(GameSwitches[validSwitchCount].solenoid, GameSwitches[validSwitchCount].solenoidHoldTime);
                   } else {
-                    RPU_PushToSolenoidStack(GameSwitches[validSwitchCount].solenoid, GameSwitches[validSwitchCount].solenoidHoldTime);
+                    PushToSolenoidStack(GameSwitches[validSwitchCount].solenoid, GameSwitches[validSwitchCount].solenoidHoldTime);
                   }
                 } // End if this is a real solenoid
               } // End if this is a switch in the switch table
@@ -3043,7 +4748,7 @@ void InterruptService3() {
               if (immediateTrigger < NumGamePrioritySwitches && immediateSolenoidFired == false) {
                 PushToFrontOfSolenoidStack(GameSwitches[immediateTrigger].solenoid, GameSwitches[immediateTrigger].solenoidHoldTime);
               } else {
-                RPU_PushToSolenoidStack(GameSwitches[immediateTrigger].solenoid, GameSwitches[immediateTrigger].solenoidHoldTime);
+                PushToSolenoidStack(GameSwitches[immediateTrigger].solenoid, GameSwitches[immediateTrigger].solenoidHoldTime);
               }
             }
           }
@@ -3064,6 +4769,9 @@ void InterruptService3() {
 #endif
 
     }
+#ifdef RPU_ISR_PROFILER
+    EndISRPhase(RPU_ISR_PHASE_SWITCHES, &phaseStart);
+#endif
 
     if (NumCyclesBeforeRevertingSolenoidByte != 0) {
       NumCyclesBeforeRevertingSolenoidByte -= 1;
@@ -3077,11 +4785,14 @@ void InterruptService3() {
     byte momentarySolenoidAtStart = PullFirstFromSolenoidStack();
     if (momentarySolenoidAtStart != SOLENOID_STACK_EMPTY) {
       CurrentSolenoidByte = (CurrentSolenoidByte & 0xF0) | momentarySolenoidAtStart;
-      RPU_DataWrite(ADDRESS_U11_B, CurrentSolenoidByte);
+      WritePIARegister(ADDRESS_U11_B, CurrentSolenoidByte);
     } else {
       CurrentSolenoidByte = (CurrentSolenoidByte & 0xF0) | SOL_NONE;
-      RPU_DataWrite(ADDRESS_U11_B, CurrentSolenoidByte);
+      WritePIARegister(ADDRESS_U11_B, CurrentSolenoidByte);
     }
+#ifdef RPU_ISR_PROFILER
+    EndISRPhase(RPU_ISR_PHASE_SOLENOIDS, &phaseStart);
+#endif
 
     for (int lampByteCount = 0; lampByteCount < 8; lampByteCount++) {
       for (byte nibbleCount = 0; nibbleCount < 2; nibbleCount++) {
@@ -3092,21 +4803,21 @@ void InterruptService3() {
         byte lampData = 0xF0 + (lampByteCount * 2) + nibbleCount;
 
         interrupts();
-        RPU_DataWrite(ADDRESS_U10_A, 0xFF);
+        WritePIARegister(ADDRESS_U10_A, 0xFF);
         noInterrupts();
 
         // Latch address & strobe
-        RPU_DataWrite(ADDRESS_U10_A, lampData);
+        WritePIARegister(ADDRESS_U10_A, lampData);
 #ifdef RPU_SLOW_DOWN_LAMP_STROBE
         delayMicroseconds(2);
 #endif
 
-        RPU_DataWrite(ADDRESS_U10_B_CONTROL, 0x38);
+        WritePIARegister(ADDRESS_U10_B_CONTROL, 0x38);
 #ifdef RPU_SLOW_DOWN_LAMP_STROBE
         delayMicroseconds(2);
 #endif
 
-        RPU_DataWrite(ADDRESS_U10_B_CONTROL, 0x30);
+        WritePIARegister(ADDRESS_U10_B_CONTROL, 0x30);
 #ifdef RPU_SLOW_DOWN_LAMP_STROBE
         delayMicroseconds(2);
 #endif
@@ -3120,7 +4831,7 @@ void InterruptService3() {
         if (numberOfU10Interrupts % DimDivisor1) lampOutput |= (LampDim1[lampByteCount] * nibbleOffset);
         if (numberOfU10Interrupts % DimDivisor2) lampOutput |= (LampDim2[lampByteCount] * nibbleOffset);
 
-        RPU_DataWrite(ADDRESS_U10_A, lampOutput | 0x0F);
+        WritePIARegister(ADDRESS_U10_A, lampOutput | 0x0F);
 #ifdef RPU_SLOW_DOWN_LAMP_STROBE
         delayMicroseconds(2);
 #endif
@@ -3131,9 +4842,9 @@ void InterruptService3() {
 #ifdef RPU_OS_USE_AUX_LAMPS
     // Latch 0xFF separately without interrupt clear
     // to park 0xFF in main lamp board
-    RPU_DataWrite(ADDRESS_U10_A, 0xFF);
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) | 0x08);
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) & 0xF7);
+    WritePIARegister(ADDRESS_U10_A, 0xFF);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) | 0x08);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) & 0xF7);
 
     // For the first four bits of lamps, we're going to look at LampStates[7] again
     // and use those top 4 bits that we didn't use before. Then we're going
@@ -3154,13 +4865,13 @@ void InterruptService3() {
         lampOutput += auxBankNum;
 
         interrupts();
-        RPU_DataWrite(ADDRESS_U10_A, 0xFF);
+        WritePIARegister(ADDRESS_U10_A, 0xFF);
         noInterrupts();
 
-        RPU_DataWrite(ADDRESS_U10_A, lampOutput | 0xF0);
-        RPU_DataWrite(ADDRESS_U11_A_CONTROL, RPU_DataRead(ADDRESS_U11_A_CONTROL) | 0x08);
-        RPU_DataWrite(ADDRESS_U11_A_CONTROL, RPU_DataRead(ADDRESS_U11_A_CONTROL) & 0xF7);
-        RPU_DataWrite(ADDRESS_U10_A, lampOutput);
+        WritePIARegister(ADDRESS_U10_A, lampOutput | 0xF0);
+        WritePIARegister(ADDRESS_U11_A_CONTROL, ReadPIAShadow(ADDRESS_U11_A_CONTROL) | 0x08);
+        WritePIARegister(ADDRESS_U11_A_CONTROL, ReadPIAShadow(ADDRESS_U11_A_CONTROL) & 0xF7);
+        WritePIARegister(ADDRESS_U10_A, lampOutput);
 
         auxBankNum += 1;
       }
@@ -3168,20 +4879,26 @@ void InterruptService3() {
 #endif
 
     // Latch 0xFF separately without interrupt clear
-    RPU_DataWrite(ADDRESS_U10_A, 0xFF);
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) | 0x08);
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, RPU_DataRead(ADDRESS_U10_B_CONTROL) & 0xF7);
+    WritePIARegister(ADDRESS_U10_A, 0xFF);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) | 0x08);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, ReadPIAShadow(ADDRESS_U10_B_CONTROL) & 0xF7);
 
     interrupts();
     noInterrupts();
 
+#ifdef RPU_ISR_PROFILER
+    EndISRPhase(RPU_ISR_PHASE_LAMPS, &phaseStart);
+#endif
     InsideZeroCrossingInterrupt = 0;
-    RPU_DataWrite(ADDRESS_U10_A, backup10A);
-    RPU_DataWrite(ADDRESS_U10_B_CONTROL, u10BControlLatest);
+    WritePIARegister(ADDRESS_U10_A, backup10A);
+    WritePIARegister(ADDRESS_U10_B_CONTROL, u10BControlLatest);
 
     // Read U10B to clear interrupt
     RPU_DataRead(ADDRESS_U10_B);
     numberOfU10Interrupts += 1;
+#ifdef RPU_ISR_PROFILER
+    RecordISRPhase(RPU_ISR_PHASE_TOTAL, ISR_PROFILE_CLOCK() - zeroCrossingStart);
+#endif
   }
 }
 
@@ -3294,9 +5011,9 @@ boolean CheckCreditResetSwitchArch1(byte creditResetSwitch) {
 
   byte strobeNum = 0x01 << (creditResetSwitch / 8);
   byte switchNum = 0x01 << (creditResetSwitch % 8);
-  RPU_DataWrite(ADDRESS_U10_A, strobeNum);
+  WritePIARegister(ADDRESS_U10_A, strobeNum);
   // Turn off U10:CB2 if it's on (because it strobes the last bank of dip switches
-  RPU_DataWrite(ADDRESS_U10_B_CONTROL, 0x34);
+  WritePIARegister(ADDRESS_U10_B_CONTROL, 0x34);
 
   // Delay for switch capacitors to charge
   delayMicroseconds(RPU_OS_SWITCH_DELAY_IN_MICROSECONDS);
@@ -3305,7 +5022,7 @@ boolean CheckCreditResetSwitchArch1(byte creditResetSwitch) {
   byte curSwitchByte = RPU_DataRead(ADDRESS_U10_B);
 
   //Unset the strobe
-  RPU_DataWrite(ADDRESS_U10_A, 0x00);
+  WritePIARegister(ADDRESS_U10_A, 0x00);
 
   if (curSwitchByte & switchNum) {
     return true;
@@ -3551,19 +5268,21 @@ unsigned long RPU_InitializeMPUArch1(unsigned long initOptions, byte creditReset
 #if (RPU_MPU_ARCHITECTURE>=10)
 // RPU_MPU_ARCHITECTURE >= 10
 boolean CheckSwitchStack(byte switchNum) {
-  for (byte stackIndex = SwitchStackFirst; stackIndex != SwitchStackLast; stackIndex++) {
-    if (stackIndex >= SWITCH_STACK_SIZE) stackIndex = 0;
-    if (SwitchStack[stackIndex] == switchNum) return true;
+  SwitchStackEntry *stackEntry;
+  for (byte stackPosition = 0; (stackEntry = PrioritySwitchStack.Peek(stackPosition)) != NULL; stackPosition++) {
+    if (stackEntry->switchNum == switchNum) return true;
+  }
+  for (byte stackPosition = 0; (stackEntry = SwitchStack.Peek(stackPosition)) != NULL; stackPosition++) {
+    if (stackEntry->switchNum == switchNum) return true;
   }
   return false;
 }
 
 
-volatile unsigned long LampPass = 0;
+volatile byte LampPass = 0;
 volatile byte LampStrobe = 0;
 volatile byte DisplayStrobe = 0;
 volatile byte InterruptPass = 0;
-boolean NeedToTurnOffTriggeredSolenoids = true;
 #if (RPU_OS_NUM_DIGITS==6)
 byte BlankingBit[16] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x01, 0x02, 0x01, 0x02, 0x04, 0x08, 0x010, 0x20, 0x01, 0x02};
 #elif (RPU_OS_NUM_DIGITS==7)
@@ -3571,24 +5290,197 @@ byte BlankingBit[16] = {0x01, 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x02, 0x
 #endif
 volatile byte UpDownPassCounter = 0;
 
-// INTERRUPT HANDLER
-// RPU_MPU_ARCHITECTURE >= 10 and RPU_OS_HARDWARE_REV < 200
 #if (RPU_OS_HARDWARE_REV<200)
-ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz)
+// Bus work for each interrupt is done in batches. The addresses
+// never change - the interrupt only fills in the data to write.
+// Display: up/down switch, then the strobe and digit writes
+#define DISPLAY_BUS_OP_UP_DOWN    0
+#if (RPU_MPU_ARCHITECTURE==15)
+#define NUM_DISPLAY_BUS_OPS       5
+RPU_BusOperation DisplayBusOps[NUM_DISPLAY_BUS_OPS] = {
+  {PIA_DISPLAY_CONTROL_B, 0, RPU_BUS_READ}, {PIA_DISPLAY_PORT_A, 0, RPU_BUS_WRITE},
+  {PIA_ALPHA_DISPLAY_PORT_A, 0, RPU_BUS_WRITE}, {PIA_ALPHA_DISPLAY_PORT_B, 0, RPU_BUS_WRITE},
+  {PIA_DISPLAY_PORT_B, 0, RPU_BUS_WRITE}
+};
+#elif (RPU_MPU_ARCHITECTURE==13)
+#define NUM_DISPLAY_BUS_OPS       3
+RPU_BusOperation DisplayBusOps[NUM_DISPLAY_BUS_OPS] = {
+  {PIA_DISPLAY_CONTROL_B, 0, RPU_BUS_READ}, {PIA_DISPLAY_PORT_A, 0, RPU_BUS_WRITE},
+  {PIA_DISPLAY_PORT_B, 0, RPU_BUS_WRITE}
+};
+#else
+#define NUM_DISPLAY_BUS_OPS       4
+RPU_BusOperation DisplayBusOps[NUM_DISPLAY_BUS_OPS] = {
+  {PIA_DISPLAY_CONTROL_B, 0, RPU_BUS_READ}, {PIA_DISPLAY_PORT_A, 0, RPU_BUS_WRITE},
+  {PIA_DISPLAY_PORT_B, 0xFF, RPU_BUS_WRITE}, {PIA_DISPLAY_PORT_B, 0, RPU_BUS_WRITE}
+};
+#endif
 
-  byte displayControlPortB = RPU_DataRead(PIA_DISPLAY_CONTROL_B);
-  if (displayControlPortB & 0x80) {
-    UpDownSwitch = true;
-    UpDownPassCounter = 0;
-    // Clear the interrupt
-    RPU_DataRead(PIA_DISPLAY_PORT_B);
-  } else {
-    UpDownPassCounter += 1;
-    if (UpDownPassCounter == 50) {
-      UpDownSwitch = false;
-      UpDownPassCounter = 0;
+// Lamps & switches: lamp strobe and data, coin door, then each
+// switch column strobe (held up to settle), its read, and strobe off
+#define SCAN_BUS_OP_LAMP_STROBE   0
+#define SCAN_BUS_OP_LAMP_DATA     1
+#define SCAN_BUS_OP_COIN_DOOR     2
+#define SCAN_BUS_OP_FIRST_COLUMN  3
+#define NUM_SCAN_BUS_OPS          20
+RPU_BusOperation ScanBusOps[NUM_SCAN_BUS_OPS] = {
+  {PIA_LAMPS_PORT_B, 0, RPU_BUS_WRITE}, {PIA_LAMPS_PORT_A, 0, RPU_BUS_WRITE},
+  {PIA_DISPLAY_CONTROL_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x01, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x02, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x04, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x08, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x10, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x20, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x40, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x80, RPU_BUS_WRITE | RPU_BUS_SETTLE}, {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ},
+  {PIA_SWITCH_PORT_B, 0x00, RPU_BUS_WRITE}
+};
+
+// Solenoids: both ports
+RPU_BusOperation SolenoidBusOps[2] = {
+#if (RPU_MPU_ARCHITECTURE==15)
+  {PIA_SOLENOID_PORT_A, 0, RPU_BUS_WRITE}, {PIA_SOLENOID_11_PORT_B, 0, RPU_BUS_WRITE}
+#else
+  {PIA_SOLENOID_PORT_A, 0, RPU_BUS_WRITE}, {PIA_SOLENOID_PORT_B, 0, RPU_BUS_WRITE}
+#endif
+};
+
+// RPU_MPU_ARCHITECTURE >= 10
+// Debounce one switch column (SwitchesNow has just been read) and add
+// any closures (or requested openings) to the switch stack
+void DebounceSwitchColumn(byte switchCol, unsigned long scanTime) {
+  byte debounced = SwitchesDebounced[switchCol];
+  byte changing = SwitchesNow[switchCol] ^ debounced;
+
+  // Count the samples in a row that disagree with the debounced
+  // state (any sample that agrees clears the count)
+  byte count0 = SwitchDebounceCount[0][switchCol];
+  byte count1 = SwitchDebounceCount[1][switchCol];
+  byte count2 = SwitchDebounceCount[2][switchCol];
+  count2 = (count2 ^ (count1 & count0)) & changing;
+  count1 = (count1 ^ count0) & changing;
+  count0 = (~count0) & changing;
+
+  // Open switches need closedSamples to close, closed switches need openSamples to open
+  byte limit0 = (SwitchClosedSamples[0][switchCol] & ~debounced) | (SwitchOpenSamples[0][switchCol] & debounced);
+  byte limit1 = (SwitchClosedSamples[1][switchCol] & ~debounced) | (SwitchOpenSamples[1][switchCol] & debounced);
+  byte limit2 = (SwitchClosedSamples[2][switchCol] & ~debounced) | (SwitchOpenSamples[2][switchCol] & debounced);
+  byte toggled = changing & ~((count0 ^ limit0) | (count1 ^ limit1) | (count2 ^ limit2));
+
+  debounced ^= toggled;
+  SwitchesDebounced[switchCol] = debounced;
+  SwitchDebounceCount[0][switchCol] = count0 & ~toggled;
+  SwitchDebounceCount[1][switchCol] = count1 & ~toggled;
+  SwitchDebounceCount[2][switchCol] = count2 & ~toggled;
+
+  byte validClosures = toggled & debounced;
+  byte validOpens = toggled & ~debounced & SwitchOpenEventMask[switchCol];
+
+#ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
+  // Pops & slings fire right here rather than waiting for loop()
+  // to see the switch (it's still pushed below for scoring)
+  byte immediateClosures = validClosures & ImmediateSolenoidSwitchMask[switchCol];
+  if (immediateClosures && SolenoidStackEnabled) {
+    for (byte immediateTrigger = 0; immediateTrigger < NumImmediateSolenoids; immediateTrigger++) {
+      if (ImmediateSolenoidSwitchByte[immediateTrigger] == switchCol && (ImmediateSolenoidSwitchFlag[immediateTrigger]&immediateClosures)) {
+        byte immediateSolenoid = GameSwitches[immediateTrigger].solenoid;
+        if ((scanTime - ImmediateSolenoidLastFired[immediateSolenoid]) >= ImmediateSolenoidHoldoff[immediateSolenoid]) {
+          PushToFrontOfSolenoidStack(immediateSolenoid, GameSwitches[immediateTrigger].solenoidHoldTime);
+        }
+      }
+    }
+  }
+#endif
+
+  if (validClosures || validOpens) {
+    // Loop on bits of switch byte
+    for (byte bitCount = 0; bitCount < 8; bitCount++) {
+      byte validSwitchNum = switchCol * 8 + bitCount;
+      // If this switch bit is closed
+      if (validClosures & 0x01) {
+        PushToSwitchStack(validSwitchNum, scanTime);
+      } else if (validOpens & 0x01) {
+        PushToSwitchStack(validSwitchNum | SWITCH_STACK_OPENED_FLAG, scanTime);
+      }
+      validClosures = validClosures >> 1;
+      validOpens = validOpens >> 1;
     }
   }
+}
+
+#ifdef RPU_SPLIT_SWITCH_SCAN
+// Split switch scan - instead of strobing all eight columns (and
+// waiting for each to settle) every other tick, every tick reads a
+// few columns. Each column is strobed, left to settle while the
+// interrupt does its other work (or until the next tick), then read
+// and debounced. With 4 columns a tick, each column is still sampled
+// every other tick.
+#ifndef RPU_SWITCH_SCAN_COLUMNS_PER_TICK
+#define RPU_SWITCH_SCAN_COLUMNS_PER_TICK    4
+#endif
+// Timer 1 counts CPU clocks (no prescaler)
+#define SWITCH_SETTLE_TIMER_COUNTS  (RPU_BUS_SETTLE_MICROSECONDS * (F_CPU / 1000000UL))
+byte SwitchScanColumn = 0;
+unsigned short SwitchScanStrobeCount = 0;
+// Which tick the last strobe belongs to - TCNT1 restarts every tick,
+// so its count only means something next to a count from the same tick
+byte SwitchScanTick = 0;
+byte SwitchScanStrobeTick = 0;
+RPU_BusOperation SwitchScanBusOps[2] = {
+  {PIA_SWITCH_PORT_A, 0, RPU_BUS_READ}, {PIA_SWITCH_PORT_B, 0x01, RPU_BUS_WRITE}
+};
+
+// RPU_MPU_ARCHITECTURE >= 10
+// Reads the column that's strobed now and strobes the next one
+void ScanSwitchColumn() {
+  // Only waits if the column was strobed less than the settle time
+  // ago in this tick - a strobe from an earlier tick has had at least
+  // the rest of that tick, whatever the two counts say
+  if (SwitchScanStrobeTick == SwitchScanTick) {
+    while ((unsigned short)(TCNT1 - SwitchScanStrobeCount) < SWITCH_SETTLE_TIMER_COUNTS);
+  }
+
+  byte switchCol = SwitchScanColumn;
+  SwitchScanColumn = (switchCol + 1) & 0x07;
+  SwitchScanBusOps[1].data = 0x01 << SwitchScanColumn;
+  RPU_DataTransaction(SwitchScanBusOps, 2);
+  SwitchScanStrobeCount = TCNT1;
+  SwitchScanStrobeTick = SwitchScanTick;
+  if (TIFR1 & (1<<OCF1A)) {
+    // A late tick - the count has restarted (perhaps just after it
+    // was read), so this strobe belongs to the next tick
+    SwitchScanStrobeCount = TCNT1;
+    SwitchScanStrobeTick += 1;
+  }
+
+  if (switchCol < NUM_SWITCH_BYTES) {
+    SwitchesNow[switchCol] = SwitchScanBusOps[0].data;
+    DebounceSwitchColumn(switchCol, millis());
+  }
+}
+#endif
+
+// INTERRUPT HANDLER
+// RPU_MPU_ARCHITECTURE >= 10 and RPU_OS_HARDWARE_REV < 200
+ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz)
+
+#ifdef RPU_ISR_PROFILER
+  // Timer 1 restarts from zero on the compare match, so it
+  // reads how long the interrupt took to get started
+  unsigned short phaseStart = ISR_PROFILE_CLOCK();
+  unsigned short switchCounts = 0;
+  RecordISRPhase(RPU_ISR_PHASE_LATENCY, phaseStart);
+#endif
+
+#ifdef RPU_SPLIT_SWITCH_SCAN
+  // This column has been settling since the end of the last tick
+  SwitchScanTick += 1;
+  ScanSwitchColumn();
+#ifdef RPU_ISR_PROFILER
+  AddToISRPhase(&switchCounts, &phaseStart);
+#endif
+#endif
 
 #if (RPU_MPU_ARCHITECTURE==15)
   // Create display data
@@ -3609,10 +5501,11 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz
     if (DisplayDigitEnable[3]&blankingBit) digit2 = DisplayDigits[3][DisplayStrobe - 9];
   }
   // Show current display digit
-  RPU_DataWrite(PIA_DISPLAY_PORT_A, BoardLEDs | DisplayStrobe);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_PORT_A, (digit1 >> 7) & 0x7F);
-  RPU_DataWrite(PIA_ALPHA_DISPLAY_PORT_B, digit1 & 0x7F);
-  RPU_DataWrite(PIA_DISPLAY_PORT_B, digit2 & 0x7F);
+  DisplayBusOps[1].data = BoardLEDs | DisplayStrobe;
+  DisplayBusOps[2].data = (digit1 >> 7) & 0x7F;
+  DisplayBusOps[3].data = digit1 & 0x7F;
+  DisplayBusOps[4].data = digit2 & 0x7F;
+  RPU_DataTransaction(DisplayBusOps, NUM_DISPLAY_BUS_OPS);
 #elif (RPU_MPU_ARCHITECTURE==13)
   // Create display data
   byte digit1 = 0x0F, digit2 = 0x0F;
@@ -3651,14 +5544,15 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz
 
   }
   // Show current display digit
-  RPU_DataWrite(PIA_DISPLAY_PORT_A, BoardLEDs | DisplayStrobe);
-  RPU_DataWrite(PIA_DISPLAY_PORT_B, digit1 * 16 | (digit2 & 0x0F));
+  DisplayBusOps[1].data = BoardLEDs | DisplayStrobe;
+  DisplayBusOps[2].data = digit1 * 16 | (digit2 & 0x0F);
+  RPU_DataTransaction(DisplayBusOps, NUM_DISPLAY_BUS_OPS);
 
   // show commas
-  byte commaByte = RPU_DataRead(PIA_SOUND_COMMA_PORT_B) & 0x3F;
+  byte commaByte = ReadPIAShadow(PIA_SOUND_COMMA_PORT_B) & 0x3F;
   if (comma12) commaByte |= 0x80;
   if (comma34) commaByte |= 0x40;
-  RPU_DataWrite(PIA_SOUND_COMMA_PORT_B, commaByte);
+  WritePIARegister(PIA_SOUND_COMMA_PORT_B, commaByte);
 
 #else
   // Create display data
@@ -3677,110 +5571,205 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz
   }
   // Show current display digit
   //  if (RPU_DataRead(PIA_DISPLAY_CONTROL_B) & 0x80) SawInterruptOnDisplayPortB1 = true;
-  RPU_DataWrite(PIA_DISPLAY_PORT_A, /*BoardLEDs | */DisplayStrobe);
-  RPU_DataWrite(PIA_DISPLAY_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_DISPLAY_PORT_B, digit1 * 16 | (digit2 & 0x0F));
+  DisplayBusOps[1].data = /*BoardLEDs | */DisplayStrobe;
+  DisplayBusOps[3].data = digit1 * 16 | (digit2 & 0x0F);
+  RPU_DataTransaction(DisplayBusOps, NUM_DISPLAY_BUS_OPS);
 
 #endif
 
+  if (DisplayBusOps[DISPLAY_BUS_OP_UP_DOWN].data & 0x80) {
+    UpDownSwitch = true;
+    UpDownPassCounter = 0;
+    // Clear the interrupt
+    RPU_DataRead(PIA_DISPLAY_PORT_B);
+  } else {
+    UpDownPassCounter += 1;
+    if (UpDownPassCounter == 50) {
+      UpDownSwitch = false;
+      UpDownPassCounter = 0;
+    }
+  }
+
   DisplayStrobe += 1;
   if (DisplayStrobe >= 16) DisplayStrobe = 0;
+#ifdef RPU_ISR_PROFILER
+  EndISRPhase(RPU_ISR_PHASE_DISPLAY, &phaseStart);
+#endif
+
+#if defined(RPU_SPLIT_SWITCH_SCAN) && (RPU_SWITCH_SCAN_COLUMNS_PER_TICK==4)
+  ScanSwitchColumn();
+#ifdef RPU_ISR_PROFILER
+  AddToISRPhase(&switchCounts, &phaseStart);
+#endif
+#endif
 
   if (InterruptPass == 0) {
 
-    // Show lamps
-    byte curLampByte = LampStates[LampStrobe];
-    if (LampPass % DimDivisor1) curLampByte |= LampDim1[LampStrobe];
-    if (LampPass % DimDivisor2) curLampByte |= LampDim2[LampStrobe];
-    RPU_DataWrite(PIA_LAMPS_PORT_B, 0x01 << (LampStrobe));
-    RPU_DataWrite(PIA_LAMPS_PORT_A, curLampByte);
+    // A committed lamp frame is only swapped in at the top of a strobe cycle
+    if (LampStrobe == 0 && LampFramePending) {
+      volatile byte *shownFrame = LampSpareBuffer;
+      LampSpareBuffer = LampFrontBuffer;
+      LampFrontBuffer = shownFrame;
+      LampFramePending = false;
+    }
+
+    if (LampAnimationActive) AdvanceLampAnimation();
+
+    // Show lamps - the base layer, then the overlays in priority
+    // order, then the lamps dimmed out of this pass
+    byte curLampByte = LampFrontBuffer[LampStrobe];
+    for (byte position = 0; position < LAMP_NUM_OVERLAYS; position++) {
+      curLampByte = (curLampByte | LampOverlayOffMasks[position][LampStrobe]) & ~LampOverlayOnMasks[position][LampStrobe];
+    }
+    curLampByte |= LampPWMOffSlots[LampPass][LampStrobe];
+    ScanBusOps[SCAN_BUS_OP_LAMP_STROBE].data = 0x01 << (LampStrobe);
+    ScanBusOps[SCAN_BUS_OP_LAMP_DATA].data = curLampByte;
 
     LampStrobe += 1;
     if ((LampStrobe) >= RPU_NUM_LAMP_BANKS) {
       LampStrobe = 0;
       LampPass += 1;
+      if (LampPass >= LAMP_PWM_FRAME_PASSES) LampPass = 0;
+    }
+#ifdef RPU_ISR_PROFILER
+    // The lamp writes share a batch with the switch
+    // scan, so the bus time counts as switch time
+    EndISRPhase(RPU_ISR_PHASE_LAMPS, &phaseStart);
+#endif
+
+#ifdef RPU_SPLIT_SWITCH_SCAN
+    // Show lamps and read the coin door (switches are scanned a few columns a tick)
+    RPU_DataTransaction(ScanBusOps, SCAN_BUS_OP_FIRST_COLUMN);
+#if (RPU_SWITCH_SCAN_COLUMNS_PER_TICK==4)
+    // Halfway between the other two reads, so neither column is
+    // read straight after its strobe
+    ScanSwitchColumn();
+#endif
+#else
+    // Show lamps, read the coin door and scan the switch columns
+    RPU_DataTransaction(ScanBusOps, NUM_SCAN_BUS_OPS);
+    for (byte switchCol = 0; switchCol < 8; switchCol++) {
+      SwitchesNow[switchCol] = ScanBusOps[SCAN_BUS_OP_FIRST_COLUMN + 1 + switchCol * 2].data;
     }
+#endif
+
+    // All events from this scan get the same timestamp
+    unsigned long scanTime = millis();
 
     // Check coin door switches
-    byte displayControlPortA = RPU_DataRead(PIA_DISPLAY_CONTROL_A);
-    if (displayControlPortA & 0x80) {
+    if (ScanBusOps[SCAN_BUS_OP_COIN_DOOR].data & 0x80) {
       // If the diagnostic switch isn't on the stack already, put it there
-      if (!CheckSwitchStack(SW_SELF_TEST_SWITCH)) PushToSwitchStack(SW_SELF_TEST_SWITCH);
+      if (!CheckSwitchStack(SW_SELF_TEST_SWITCH)) PushToSwitchStack(SW_SELF_TEST_SWITCH, scanTime);
       // Clear the interrupt
       RPU_DataRead(PIA_DISPLAY_PORT_A);
     }
 
-    // Check switches
-    byte switchColStrobe = 1;
-    for (byte switchCol = 0; switchCol < 8; switchCol++) {
-      // Cycle the debouncing variables
-      SwitchesMinus2[switchCol] = SwitchesMinus1[switchCol];
-      SwitchesMinus1[switchCol] = SwitchesNow[switchCol];
-      // Turn on the strobe
-      RPU_DataWrite(PIA_SWITCH_PORT_B, switchColStrobe);
-      // Hold it up for 30 us
-      delayMicroseconds(12);
-      // Read switch input
-      SwitchesNow[switchCol] = RPU_DataRead(PIA_SWITCH_PORT_A);
-      switchColStrobe *= 2;
+#ifndef RPU_SPLIT_SWITCH_SCAN
+    // Debounce and add any closures (or requested openings) to the switch stack
+    for (byte switchCol = 0; switchCol < NUM_SWITCH_BYTES; switchCol++) {
+      DebounceSwitchColumn(switchCol, scanTime);
+    }
+#endif
+#ifdef RPU_ISR_PROFILER
+    AddToISRPhase(&switchCounts, &phaseStart);
+#endif
+
+  } else {
+    // Start whatever was held back by the governor, then
+    // the next queued pulse (a coil that's already running
+    // is extended if the new pulse is longer)
+    unsigned long solBits = SolenoidPendingBits;
+    for (byte solCount = 0; solBits; solCount++, solBits >>= 1) {
+      if ((solBits & 0x01) && SolenoidWithinBudget(solCount)) {
+        StartSolenoidPulse(solCount, SolenoidPendingTicks[solCount]);
+        SolenoidPendingTicks[solCount] = 0;
+        SolenoidPendingBits &= ~(1UL << solCount);
+      }
+    }
+    byte pulseTicks;
+    byte solenoidOn = PullFirstFromSolenoidStack(&pulseTicks);
+    if (solenoidOn < RPU_NUM_SOLENOIDS) {
+      if (!(SolenoidPendingBits & (1UL << solenoidOn)) && SolenoidWithinBudget(solenoidOn)) {
+        StartSolenoidPulse(solenoidOn, pulseTicks);
+      } else {
+        // Over budget - defer it (repeat requests merge)
+        if (pulseTicks > SolenoidPendingTicks[solenoidOn]) SolenoidPendingTicks[solenoidOn] = pulseTicks;
+        SolenoidPendingBits |= (1UL << solenoidOn);
+        SolenoidDeferrals += 1;
+      }
     }
-    RPU_DataWrite(PIA_SWITCH_PORT_B, 0);
 
-    // If there are any closures, add them to the switch stack
-    for (byte switchCol = 0; switchCol < NUM_SWITCH_BYTES; switchCol++) {
-      byte validClosures = (SwitchesNow[switchCol] & SwitchesMinus1[switchCol]) & ~SwitchesMinus2[switchCol];
-      // If there is a valid switch closure (off, on, on)
-      if (validClosures) {
-        // Loop on bits of switch byte
-        for (byte bitCount = 0; bitCount < 8; bitCount++) {
-          // If this switch bit is closed
-          if (validClosures & 0x01) {
-            byte validSwitchNum = switchCol * 8 + bitCount;
-            PushToSwitchStack(validSwitchNum);
+    // Everything running gets this tick, then counts down
+    unsigned long pulsedSolenoids = SolenoidPulseBits;
+    solBits = pulsedSolenoids | SolenoidCoolingBits;
+    if (solBits) {
+#ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
+      unsigned long pulseTime = millis();
+#endif
+      for (byte solCount = 0; solBits; solCount++, solBits >>= 1) {
+        if (!(solBits & 0x01)) continue;
+        byte maxDuty = SolenoidMaxDuty[solCount];
+        if (SolenoidPulseTicks[solCount]) {
+#ifdef RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
+          // The holdoff counts from the end of any pulse (including ball search)
+          ImmediateSolenoidLastFired[solCount] = pulseTime;
+#endif
+          if (maxDuty < 100) SolenoidHeat[solCount] += (100 - maxDuty);
+          SolenoidPulseTicks[solCount] -= 1;
+          if (SolenoidPulseTicks[solCount] == 0) {
+            SolenoidPulseBits &= ~(1UL << solCount);
+            if (SolenoidPowerGroup[solCount]) PowerGroupActive[SolenoidPowerGroup[solCount]] -= 1;
           }
-          validClosures = validClosures >> 1;
+        } else if (SolenoidHeat[solCount] > maxDuty) {
+          SolenoidHeat[solCount] -= maxDuty;
+        } else {
+          SolenoidHeat[solCount] = 0;
         }
+        if (SolenoidRefireTicksLeft[solCount]) SolenoidRefireTicksLeft[solCount] -= 1;
+        if (SolenoidRefireTicksLeft[solCount] || SolenoidHeat[solCount]) SolenoidCoolingBits |= (1UL << solCount);
+        else SolenoidCoolingBits &= ~(1UL << solCount);
       }
     }
 
-  } else {
-    // See if any solenoids need to be switched
-    byte solenoidOn = PullFirstFromSolenoidStack();
-    byte portA = ContinuousSolenoidBits & 0xFF;
-    byte portB = ContinuousSolenoidBits / 256;
-    if (solenoidOn != SOLENOID_STACK_EMPTY) {
-      if (solenoidOn < 16) {
-        unsigned short newSolenoidBytes = (1 << solenoidOn);
-        portA |= (newSolenoidBytes & 0xFF);
-        portB |= (newSolenoidBytes / 256);
-        if (NeedToTurnOffTriggeredSolenoids) {
-          RPU_DataWrite(PIA_LAMPS_CONTROL_B, 0x3C);
-          RPU_DataWrite(PIA_LAMPS_CONTROL_A, 0x3C);
-          RPU_DataWrite(PIA_SWITCH_CONTROL_B, 0x3C);
-          RPU_DataWrite(PIA_SWITCH_CONTROL_A, 0x3C);
-          RPU_DataWrite(PIA_SOLENOID_CONTROL_A, 0x3C);
-          RPU_DataWrite(PIA_DISPLAY_CONTROL_B, 0x3D);
-          NeedToTurnOffTriggeredSolenoids = false;
+    unsigned short continuousBits = ContinuousSolenoidBits;
+    if (ContinuousSolenoidPWMBits) {
+      SolenoidPWMPhase = (SolenoidPWMPhase + 1) & 0x07;
+      for (byte solCount = 0; solCount < 16; solCount++) {
+        if ((ContinuousSolenoidPWMBits & (1 << solCount)) && !((ContinuousSolenoidPWM[solCount] >> SolenoidPWMPhase) & 0x01)) {
+          continuousBits &= ~(1 << solCount);
         }
-      } else {
-        if (solenoidOn == 16) RPU_DataWrite(PIA_LAMPS_CONTROL_B, 0x34);
-        if (solenoidOn == 17) RPU_DataWrite(PIA_LAMPS_CONTROL_A, 0x34);
-        if (solenoidOn == 18) RPU_DataWrite(PIA_SWITCH_CONTROL_B, 0x34);
-        if (solenoidOn == 19) RPU_DataWrite(PIA_SWITCH_CONTROL_A, 0x34);
-        if (solenoidOn == 20) RPU_DataWrite(PIA_SOLENOID_CONTROL_A, 0x34);
-        if (solenoidOn == 21) RPU_DataWrite(PIA_DISPLAY_CONTROL_B, 0x35);
-        NeedToTurnOffTriggeredSolenoids = true;
       }
-    } else if (NeedToTurnOffTriggeredSolenoids) {
-      NeedToTurnOffTriggeredSolenoids = false;
-      RPU_DataWrite(PIA_LAMPS_CONTROL_B, 0x3C);
-      RPU_DataWrite(PIA_LAMPS_CONTROL_A, 0x3C);
-      RPU_DataWrite(PIA_SWITCH_CONTROL_B, 0x3C);
-      RPU_DataWrite(PIA_SWITCH_CONTROL_A, 0x3C);
-      RPU_DataWrite(PIA_SOLENOID_CONTROL_A, 0x3C);
-      RPU_DataWrite(PIA_DISPLAY_CONTROL_B, 0x3D);
     }
 
+    byte portA = (continuousBits | pulsedSolenoids) & 0xFF;
+    byte portB = ((continuousBits | pulsedSolenoids) / 256) & 0xFF;
+
+#if defined(RPU_SPLIT_SWITCH_SCAN) && (RPU_SWITCH_SCAN_COLUMNS_PER_TICK==4)
+    // Between the solenoid bookkeeping and the solenoid writes
+#ifdef RPU_ISR_PROFILER
+    unsigned short solenoidCounts = 0;
+    AddToISRPhase(&solenoidCounts, &phaseStart);
+#endif
+    ScanSwitchColumn();
+#ifdef RPU_ISR_PROFILER
+    AddToISRPhase(&switchCounts, &phaseStart);
+    // The solenoid phase carries on with the time it had so far
+    phaseStart -= solenoidCounts;
+#endif
+#endif
+
+    // Only touch the control registers for special solenoids that changed
+    byte specialSolenoids = (pulsedSolenoids >> 16) & 0x3F;
+    byte specialChanged = specialSolenoids ^ SpecialSolenoidsOn;
+    if (specialChanged) {
+      if (specialChanged & 0x01) WritePIARegister(PIA_LAMPS_CONTROL_B, (specialSolenoids & 0x01) ? 0x34 : 0x3C);
+      if (specialChanged & 0x02) WritePIARegister(PIA_LAMPS_CONTROL_A, (specialSolenoids & 0x02) ? 0x34 : 0x3C);
+      if (specialChanged & 0x04) WritePIARegister(PIA_SWITCH_CONTROL_B, (specialSolenoids & 0x04) ? 0x34 : 0x3C);
+      if (specialChanged & 0x08) WritePIARegister(PIA_SWITCH_CONTROL_A, (specialSolenoids & 0x08) ? 0x34 : 0x3C);
+      if (specialChanged & 0x10) WritePIARegister(PIA_SOLENOID_CONTROL_A, (specialSolenoids & 0x10) ? 0x34 : 0x3C);
+      if (specialChanged & 0x20) WritePIARegister(PIA_DISPLAY_CONTROL_B, (specialSolenoids & 0x20) ? 0x35 : 0x3D);
+      SpecialSolenoidsOn = specialSolenoids;
+    }
 
 #if defined(RPU_OS_USE_WTYPE_1_SOUND)
     // See if any sounds need to be added
@@ -3793,23 +5782,42 @@ ISR(TIMER1_COMPA_vect) {    //This is the interrupt request (running at 965.3 Hz
 #elif defined(RPU_OS_USE_WTYPE_2_SOUND)
     unsigned short soundOn = PullFirstFromSoundStack();
     if (soundOn != SOUND_STACK_EMPTY) {
-      RPU_DataWrite(PIA_SOUND_COMMA_PORT_A, (~soundOn) & 0x7F);
+      WritePIARegister(PIA_SOUND_COMMA_PORT_A, (~soundOn) & 0x7F);
     } else {
-      RPU_DataWrite(PIA_SOUND_COMMA_PORT_A, 0x7F);
+      WritePIARegister(PIA_SOUND_COMMA_PORT_A, 0x7F);
     }
 #endif
 
-    RPU_DataWrite(PIA_SOLENOID_PORT_A, portA);
-#if (RPU_MPU_ARCHITECTURE==15)
-    RPU_DataWrite(PIA_SOLENOID_11_PORT_B, portB);
-#else
-    RPU_DataWrite(PIA_SOLENOID_PORT_B, portB);
+    SolenoidBusOps[0].data = portA;
+    SolenoidBusOps[1].data = portB;
+    RPU_DataTransaction(SolenoidBusOps, 2);
+    // Batched writes skip WritePIARegister - of those, only the
+    // solenoid ports are ever read back
+    PIAShadowRegisters[PIA_SHADOW_INDEX(PIA_SOLENOID_PORT_A)] = portA;
+    PIAShadowRegisters[PIA_SHADOW_INDEX(PIA_SOLENOID_PORT_B)] = portB;
+#ifdef RPU_ISR_PROFILER
+    EndISRPhase(RPU_ISR_PHASE_SOLENOIDS, &phaseStart);
 #endif
   }
 
+#if defined(RPU_SPLIT_SWITCH_SCAN) && (RPU_SWITCH_SCAN_COLUMNS_PER_TICK>=2)
+  // Left strobed to settle until the next tick
+  ScanSwitchColumn();
+#endif
+
   //  RPU_DataWrite(PIA_SOLENOID_11_PORT_B, InterruptPass);
   InterruptPass ^= 1;
 
+#ifdef RPU_ISR_PROFILER
+#ifdef RPU_SPLIT_SWITCH_SCAN
+  AddToISRPhase(&switchCounts, &phaseStart);
+#endif
+  if (switchCounts) RecordISRPhase(RPU_ISR_PHASE_SWITCHES, switchCounts);
+  // Total from the compare match, including the latency
+  RecordISRPhase(RPU_ISR_PHASE_TOTAL, ISR_PROFILE_CLOCK());
+  // If the next compare match has already happened, a tick was late
+  if (TIFR1 & (1<<OCF1A)) ISROverruns += 1;
+#endif
 }
 #endif
 
@@ -3849,16 +5857,16 @@ boolean CheckCreditResetSwitchArch10(byte creditResetButton) {
   byte strobeLine = 0x01 << (creditResetButton / 8);
   byte returnLine = 0x01 << (creditResetButton % 8);
 
-  RPU_DataWrite(PIA_SWITCH_CONTROL_A, 0x38);
-  RPU_DataWrite(PIA_SWITCH_PORT_A, 0x00);
-  RPU_DataWrite(PIA_SWITCH_CONTROL_A, 0x3C);
+  WritePIARegister(PIA_SWITCH_CONTROL_A, 0x38);
+  WritePIARegister(PIA_SWITCH_PORT_A, 0x00);
+  WritePIARegister(PIA_SWITCH_CONTROL_A, 0x3C);
 
-  RPU_DataWrite(PIA_SWITCH_CONTROL_B, 0x38);
-  RPU_DataWrite(PIA_SWITCH_PORT_B, 0xFF);
-  RPU_DataWrite(PIA_SWITCH_CONTROL_B, 0x3C);
-  RPU_DataWrite(PIA_SWITCH_PORT_B, 0x00);
+  WritePIARegister(PIA_SWITCH_CONTROL_B, 0x38);
+  WritePIARegister(PIA_SWITCH_PORT_B, 0xFF);
+  WritePIARegister(PIA_SWITCH_CONTROL_B, 0x3C);
+  WritePIARegister(PIA_SWITCH_PORT_B, 0x00);
 
-  RPU_DataWrite(PIA_SWITCH_PORT_B, strobeLine);
+  WritePIARegister(PIA_SWITCH_PORT_B, strobeLine);
   // Hold it up for 30 us
   delayMicroseconds(12);
 
@@ -3871,7 +5879,7 @@ boolean CheckCreditResetSwitchArch10(byte creditResetButton) {
     Serial.write(buf);
   }
 */  
-  RPU_DataWrite(PIA_SWITCH_PORT_B, 0);
+  WritePIARegister(PIA_SWITCH_PORT_B, 0);
 
   if (switchValues & returnLine) return true;
   return false;
@@ -3924,7 +5932,7 @@ unsigned long RPU_InitializeMPUArch10(unsigned long initOptions, byte creditRese
   }
   // Make sure PIA IV (solenoid) CB2 is off so that solenoids are off
   RPU_SetAddressPinsDirection(RPU_PINS_OUTPUT);
-  RPU_DataWrite(PIA_SOLENOID_CONTROL_B, 0x30);
+  WritePIARegister(PIA_SOLENOID_CONTROL_B, 0x30);
   GameOverLine = true;
 
   delay(1000);
@@ -4066,26 +6074,24 @@ struct LISYExpectation {
   unsigned long SendTime;
 };
 
-struct LISYExpectation LISYExpectQueue[LISY_EXPECT_QUEUE_SIZE];
-byte LISYExpectHead = 0;
-byte LISYExpectTail = 0;
+RPU_Ring<LISYExpectation, LISY_EXPECT_QUEUE_SIZE> LISYExpectQueue;
 unsigned long LISYLastTimeSoundSent = 0;
 
 // Push an expected response type and timestamp onto the queue
 void RPU_LISYPushExpectation(byte responseType, unsigned long currentTime) {
-  byte nextHead = (LISYExpectHead + 1) % LISY_EXPECT_QUEUE_SIZE;
-  if (nextHead != LISYExpectTail) { // Prevent overflow
-    LISYExpectQueue[LISYExpectHead].ResponseType = responseType;
-    LISYExpectQueue[LISYExpectHead].SendTime = currentTime;
-    LISYExpectHead = nextHead;
-  }
+  LISYExpectation *expectation = LISYExpectQueue.Reserve();
+  if (expectation == NULL) return; // Prevent overflow
+  expectation->ResponseType = responseType;
+  expectation->SendTime = currentTime;
+  LISYExpectQueue.Publish();
 }
 
 // Pop the oldest expected response type
 byte RPU_LISYPopExpectation() {
-  if (LISYExpectHead == LISYExpectTail) return LISY_RESPONSE_IDLE; // Queue empty
-  byte expected = LISYExpectQueue[LISYExpectTail].ResponseType;
-  LISYExpectTail = (LISYExpectTail + 1) % LISY_EXPECT_QUEUE_SIZE;
+  LISYExpectation *oldest = LISYExpectQueue.Front();
+  if (oldest == NULL) return LISY_RESPONSE_IDLE; // Queue empty
+  byte expected = oldest->ResponseType;
+  LISYExpectQueue.Release();
   return expected;
 }
 
@@ -4416,9 +6422,10 @@ void RPU_LISYReadAllSwitches() {
 
 void RPU_LISYProcessIncoming(unsigned long currentTime) {
   // 1. Prune dead expectations older than 50ms to recover from lost bytes
-  while (LISYExpectHead != LISYExpectTail) {
-    if (currentTime - LISYExpectQueue[LISYExpectTail].SendTime > 50) {
-      LISYExpectTail = (LISYExpectTail + 1) % LISY_EXPECT_QUEUE_SIZE;
+  LISYExpectation *oldest;
+  while ((oldest = LISYExpectQueue.Front()) != NULL) {
+    if (currentTime - oldest->SendTime > 50) {
+      LISYExpectQueue.Release();
     } else {
       // The oldest item is valid, so all subsequent ones are too
       break; 
@@ -4430,7 +6437,7 @@ void RPU_LISYProcessIncoming(unsigned long currentTime) {
     uint8_t response = LISYOutputSerial.read();
     
     // Discard unexpected bytes immediately to keep the queue aligned
-    if (LISYExpectHead == LISYExpectTail) {
+    if (LISYExpectQueue.IsEmpty()) {
       continue;
     }
     
@@ -4451,6 +6458,9 @@ void RPU_LISYProcessIncoming(unsigned long currentTime) {
           else if (switchId==64) PushToSwitchStack(SW_SELF_TEST_SWITCH);
           LISYSwitchStates[switchId] = 1;
         } else {
+          if (switchId<64 && (SwitchOpenEventMask[switchId/8] & (0x01<<(switchId%8)))) {
+            PushToSwitchStack(switchId | SWITCH_STACK_OPENED_FLAG);
+          }
           LISYSwitchStates[switchId] = 0;
         }
       }
@@ -4572,11 +6582,22 @@ unsigned long LastSwitchReport = 0;
 
 void RPU_Update(unsigned long currentTime) {
 
+#ifdef RPU_SWITCH_RECORDER
+  UpdateSwitchReplay(currentTime);
+#endif
+
   if (RPU_MPU_ARCHITECTURE == 1) {
     RPU_DataRead(0);
   }
 
   RPU_ApplyFlashToLamps(currentTime);
+#if (RPU_MPU_ARCHITECTURE<10) || (RPU_OS_HARDWARE_REV>=200)
+  RPU_UpdateLampAnimation(currentTime);
+#endif
+  RPU_UpdateLampLayers(currentTime);
+#if (RPU_MPU_ARCHITECTURE<15)
+  RPU_UpdateDisplayEffects(currentTime);
+#endif
   RPU_UpdateTimedSolenoidStack(currentTime);
 #if (RPU_MPU_ARCHITECTURE>=10) && (defined(RPU_OS_USE_WTYPE_1_SOUND) || defined(RPU_OS_USE_WTYPE_2_SOUND))
   RPU_UpdateTimedSoundStack(currentTime);
@@ -4592,6 +6613,54 @@ void RPU_Update(unsigned long currentTime) {
 
 
 
+template <typename EntryType, byte Capacity>
+void ReadRingStats(RPU_Ring<EntryType, Capacity> *ring, RPU_QueueStats *queueStats) {
+  queueStats->capacity = Capacity;
+  queueStats->count = ring->Count();
+  queueStats->highWater = ring->highWater;
+  queueStats->overflows = ring->overflows;
+  queueStats->spills = 0;
+}
+
+boolean RPU_GetQueueStats(byte queueNum, RPU_QueueStats *queueStats) {
+  boolean queueFound = true;
+
+  // The interrupt pushes and pulls, so everything is read at once
+  noInterrupts();
+  if (queueNum == RPU_QUEUE_SWITCH) ReadRingStats(&SwitchStack, queueStats);
+  else if (queueNum == RPU_QUEUE_PRIORITY_SWITCH) {
+    ReadRingStats(&PrioritySwitchStack, queueStats);
+    queueStats->spills = PrioritySwitchSpills;
+  }
+  else if (queueNum == RPU_QUEUE_SOLENOID) ReadRingStats(&SolenoidStack, queueStats);
+#if (RPU_MPU_ARCHITECTURE>=10)
+  else if (queueNum == RPU_QUEUE_SOUND) ReadRingStats(&SoundStack, queueStats);
+#endif
+#if (RPU_OS_HARDWARE_REV==200)
+  else if (queueNum == RPU_QUEUE_LISY_EXPECT) ReadRingStats(&LISYExpectQueue, queueStats);
+#endif
+  else queueFound = false;
+  interrupts();
+
+  return queueFound;
+}
+
+void RPU_ResetQueueStats() {
+  noInterrupts();
+  SwitchStack.ResetStats();
+  PrioritySwitchStack.ResetStats();
+  PrioritySwitchSpills = 0;
+  SolenoidStack.ResetStats();
+#if (RPU_MPU_ARCHITECTURE>=10)
+  SoundStack.ResetStats();
+#endif
+#if (RPU_OS_HARDWARE_REV==200)
+  LISYExpectQueue.ResetStats();
+#endif
+  interrupts();
+}
+
+
 // This function should eventually support auto-detect and initialize the appropriate
 // ISRs for the detected architecture.
 unsigned long RPU_InitializeMPU(unsigned long initOptions, byte creditResetSwitch) {
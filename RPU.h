@@ -30,6 +30,39 @@ struct PlayfieldAndCabinetSwitch {
   byte solenoidHoldTime;
 };
 
+// Number of consecutive scans (1-7, scans are ~2 ms apart on
+// RPU_MPU_ARCHITECTURE >= 10) a switch must read differently before
+// it's considered closed / open. Switches without a profile use 2.
+struct SwitchDebounceProfile {
+  byte switchNum;
+  byte closedSamples;
+  byte openSamples;
+};
+#define SWITCH_DEBOUNCE_DEFAULT_SAMPLES   2
+#define SWITCH_DEBOUNCE_MAX_SAMPLES       7
+
+// A switch event as detected by the interrupt. Opened events are
+// only generated for switches enabled with RPU_SetSwitchOpenEvents
+// (and are skipped by RPU_PullFirstFromSwitchStack). eventTime is the
+// millis() value of the scan that found the debounced edge, so
+// game code doesn't have to stamp it with the (later) loop time.
+// column and row are the matrix position (0xFF for the self test
+// switch, which doesn't live in the matrix).
+struct RPU_SwitchEvent {
+  byte switchNum;
+  byte column;
+  byte row;
+  byte eventType;
+  unsigned long eventTime;
+};
+#define SWITCH_EVENT_CLOSED   0
+#define SWITCH_EVENT_OPENED   1
+
+// Packed BCD score (one digit per nibble, 8 digits)
+typedef unsigned long RPU_BCDScore;
+#define RPU_BCD_SCORE_DIGITS  8
+#define RPU_BCD_SCORE_MAX     0x99999999UL
+
 #define SW_SELF_TEST_SWITCH 0x7F
 #define SOL_NONE 0x0F
 #define SWITCH_STACK_EMPTY  0xFF
@@ -75,12 +108,21 @@ struct PlayfieldAndCabinetSwitch {
 unsigned long RPU_InitializeMPU(  
   unsigned long initOptions = RPU_CMD_BOOT_ORIGINAL_IF_CREDIT_RESET | RPU_CMD_BOOT_ORIGINAL_IF_NOT_SWITCH_CLOSED | RPU_CMD_PERFORM_MPU_TEST, 
   byte creditResetSwitch = 0xFF );
-void RPU_SetupGameSwitches(int s_numSwitches, int s_numPrioritySwitches, PlayfieldAndCabinetSwitch *s_gameSwitchArray);
+void RPU_SetupGameSwitches(int s_numSwitches, int s_numPrioritySwitches, PlayfieldAndCabinetSwitch *s_gameSwitchArray, int s_numDebounceProfiles = 0, SwitchDebounceProfile *s_debounceProfiles = NULL);
 byte RPU_GetDipSwitches(byte index);
 
 //   Swtiches
 byte RPU_PullFirstFromSwitchStack();
+byte RPU_PullFirstSwitchEvent(RPU_SwitchEvent *switchEvent); // returns switch number or SWITCH_STACK_EMPTY
 boolean RPU_SetSwitchInversion(byte switchNum);
+boolean RPU_SetSwitchOpenEvents(byte switchNum, boolean reportOpens = true);
+// Priority switches (tilt, slam, outhole, credit/reset...) are queued
+// apart from the rest and pulled first, so a burst of playfield
+// switches can't delay or drop them. Self test always is one. Their
+// lane holds 16 events - past that they queue behind the other
+// switches (still in order) until the backlog clears.
+boolean RPU_SetSwitchPriority(byte switchNum, boolean priority = true);
+boolean RPU_SetSwitchDebounce(byte switchNum, byte closedSamples, byte openSamples);
 boolean RPU_ReadSingleSwitchState(byte switchNum);
 void RPU_PushToSwitchStack(byte switchNumber);
 boolean RPU_GetUpDownSwitchState(); // This always returns true for RPU_MPU_ARCHITECTURE==1 (no up/down switch)
@@ -102,16 +144,46 @@ void RPU_EnableSolenoidStack();
 boolean RPU_IsSolenoidStackEnabled();
 boolean RPU_PushToTimedSolenoidStack(byte solenoidNumber, byte numPushes, unsigned long whenToFire, boolean disableOverride = false);
 void RPU_UpdateTimedSolenoidStack(unsigned long curTime);
+unsigned short RPU_GetTimedSolenoidStackOverflows();
 void RPU_SetSolenoidDefaultPulse(byte solenoidNumber, byte pulseTimeMS);
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+void RPU_SetSolenoidLimits(byte solenoidNumber, byte maxDutyPercent, unsigned short minRefireMS = 0, byte powerGroup = 0);
+void RPU_SetSolenoidPowerGroupLimit(byte powerGroup, byte maxSimultaneous);
+unsigned short RPU_GetSolenoidDeferrals();
+void RPU_SetContinuousSolenoidPWM(byte solNum, byte pattern);
+#endif
+#if defined(RPU_STREAMLINED_IMMEDIATE_SOLENOIDS) && (RPU_MPU_ARCHITECTURE>=10)
+void RPU_SetImmediateSolenoidHoldoff(byte solenoidNumber, byte holdoffMS);
+#endif
 
 //   Displays
 byte RPU_SetDisplay(int displayNumber, unsigned long value, boolean blankByMagnitude=false, byte minDigits=2, boolean showCommasByMagnitude=false);
+RPU_BCDScore RPU_BCDFromBinary(unsigned long value);
+unsigned long RPU_BCDToBinary(RPU_BCDScore bcdValue);
+RPU_BCDScore RPU_BCDAdd(RPU_BCDScore bcdValue1, RPU_BCDScore bcdValue2);
+RPU_BCDScore RPU_BCDMultiply(RPU_BCDScore bcdValue, byte multiplier);
+byte RPU_BCDMagnitude(RPU_BCDScore bcdValue);
+#if (RPU_MPU_ARCHITECTURE<15)
+byte RPU_SetDisplayBCD(int displayNumber, RPU_BCDScore value, boolean blankByMagnitude=false, byte minDigits=2, boolean showCommasByMagnitude=false);
+#endif
 void RPU_SetDisplayBlank(int displayNumber, byte bitMask);
 void RPU_SetDisplayCredits(int value, boolean displayOn = true, boolean showBothDigits=true);
 void RPU_SetDisplayMatch(int value, boolean displayOn = true, boolean showBothDigits=true);
 void RPU_SetDisplayBallInPlay(int value, boolean displayOn = true, boolean showBothDigits=true);
 void RPU_SetDisplayFlash(int displayNumber, unsigned long value, unsigned long curTime, int period=500, byte minDigits=2);
 void RPU_SetDisplayFlashCredits(unsigned long curTime, int period=100);
+#if (RPU_MPU_ARCHITECTURE<15)
+#define RPU_DISPLAY_EFFECT_NONE     0
+#define RPU_DISPLAY_EFFECT_FLASH    1   /* value blinks, on for odd frames */
+#define RPU_DISPLAY_EFFECT_DASH     2   /* blanking sweeps across the value */
+#define RPU_DISPLAY_EFFECT_SCROLL   3   /* value too big for the display scrolls through */
+#define RPU_DISPLAY_EFFECT_FLYBY    4   /* value flies in from the right */
+#define RPU_DISPLAY_EFFECT_BOUNCE   5   /* short value moves back and forth */
+void RPU_StartDisplayEffect(byte displayNumber, byte effectType, unsigned long value, unsigned long startTime, unsigned short rate, byte minDigits=2);
+void RPU_StopDisplayEffect(byte displayNumber);
+byte RPU_GetDisplayEffect(byte displayNumber);
+void RPU_UpdateDisplayEffects(unsigned long curTime); // called by RPU_Update
+#endif
 void RPU_CycleAllDisplays(unsigned long curTime, byte digitNum=0, byte digitValue=0xFF); // Self-test function
 byte RPU_GetDisplayBlank(int displayNumber);
 #if (RPU_MPU_ARCHITECTURE==15)
@@ -122,14 +194,63 @@ void RPU_SetDisplayRefreshConstant(int intervalConstant);
 #endif
 
 //   Lamps
-void RPU_SetLampState(int lampNum, byte s_lampState, byte s_lampDim=0, int s_lampFlashPeriod=0);
+// s_lampFlashPeriod is the time (ms) the lamp spends on, then off.
+// s_lampFlashOffset shifts the flash by that many ms, so a row of
+// lamps with increasing offsets will chase.
+void RPU_SetLampState(int lampNum, byte s_lampState, byte s_lampDim=0, int s_lampFlashPeriod=0, int s_lampFlashOffset=0);
 void RPU_ApplyFlashToLamps(unsigned long curTime);
 void RPU_FlashAllLamps(unsigned long curTime); // Self-test function
 void RPU_TurnOffAllLamps();
+// Lamp animations are stepped by the interrupt on arch >= 10 (PIA
+// bus), and by RPU_Update everywhere else
+#define RPU_LAMP_ANIMATION_REVERSE    0x01
+#define RPU_LAMP_ANIMATION_ONE_SHOT   0x02
+void RPU_StartLampAnimation(const byte *animationFrames, byte numSteps, unsigned short stepMS, unsigned long baseTime=0, byte subOffset=0, byte flags=0);
+void RPU_StopLampAnimation();
+boolean RPU_LampAnimationRunning();
+void RPU_SetLampAnimationKeepMask(byte lampBank, byte keepMask);
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+void RPU_BeginLampFrame(boolean clearFrame=false);
+void RPU_CommitLampFrame(boolean changedBanksOnly=false);
+#else
+void RPU_UpdateLampAnimation(unsigned long curTime); // called by RPU_Update
+#endif
+
+// Lamp layers, in their default priority order (the base layer is
+// the ordinary RPU_SetLampState lamps and is always lowest, the
+// animation layer is the lamp animation player). Setting a layer lamp
+// takes it from the layers below until it's released.
+#define RPU_LAMP_LAYER_BASE       0
+#define RPU_LAMP_LAYER_MODE       1
+#define RPU_LAMP_LAYER_ANIMATION  2
+#define RPU_LAMP_LAYER_OVERRIDE   3
+#define RPU_LAYER_LAMP_OFF        0
+#define RPU_LAYER_LAMP_ON         1
+#define RPU_LAYER_LAMP_FLASH      2
+void RPU_SetLayerLamp(byte layerNum, byte lampNum, byte lampState);
+void RPU_ReleaseLayerLamp(byte layerNum, byte lampNum);
+void RPU_ClearLampLayer(byte layerNum);
+void RPU_SetLampLayerFlashPeriod(byte layerNum, unsigned short flashPeriod);
+void RPU_SetLampLayerPriority(byte layerNum, byte priority); // mode, animation and override default to 1, 2, 3 - higher wins
+void RPU_UpdateLampLayers(unsigned long curTime); // called by RPU_Update
 void RPU_SetDimDivisor(byte level=1, byte divisor=2); // 2 means 50% duty cycle, 3 means 33%, 4 means 25%...
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+// Lamp PWM levels - not bit-angle modulation, just 7 fixed duty
+// patterns. A lamp is lit for this share of the lamp passes.
+#define RPU_LAMP_PWM_OFF             0
+#define RPU_LAMP_PWM_QUARTER         1
+#define RPU_LAMP_PWM_THIRD           2
+#define RPU_LAMP_PWM_HALF            3
+#define RPU_LAMP_PWM_TWO_THIRDS      4
+#define RPU_LAMP_PWM_THREE_QUARTERS  5
+#define RPU_LAMP_PWM_FULL            6
+void RPU_SetLampPWMLevel(int lampNum, byte pwmLevel); // 0-6, dim levels from RPU_SetLampState override this
+byte RPU_ReadLampPWMLevel(int lampNum);
+#endif
 byte RPU_ReadLampState(int lampNum);
 byte RPU_ReadLampDim(int lampNum);
 int RPU_ReadLampFlash(int lampNum);
+unsigned short RPU_GetLampFlashGroupOverflows();
 
 // Sound Functions
 #ifdef RPU_OS_USE_S_AND_T
@@ -157,6 +278,7 @@ void RPU_SetSoundValueLimits(unsigned short lowerLimit, unsigned short upperLimi
 void RPU_PushToSoundStack(unsigned short soundNumber, byte numPushes);
 boolean RPU_PushToTimedSoundStack(unsigned short soundNumber, byte numPushes, unsigned long whenToPlay);
 void RPU_UpdateTimedSoundStack(unsigned long curTime);
+unsigned short RPU_GetTimedSoundStackOverflows();
 #endif
 #ifdef RPU_OS_USE_WTYPE_11_SOUND
 void RPU_PlayW11Sound(byte soundNum);
@@ -166,6 +288,88 @@ void RPU_PlayW11Music(byte songNum);
 
 //   General Utility
 byte RPU_DataRead(int address);
+
+// A list of bus accesses run back to back - reads come back in data
+#define RPU_BUS_WRITE     0x00
+#define RPU_BUS_READ      0x01
+#define RPU_BUS_SETTLE    0x02  /* wait RPU_BUS_SETTLE_MICROSECONDS after this access */
+#ifndef RPU_BUS_SETTLE_MICROSECONDS
+#define RPU_BUS_SETTLE_MICROSECONDS   12
+#endif
+struct RPU_BusOperation {
+  unsigned short address;
+  byte data;
+  byte flags;
+};
+void RPU_DataTransaction(RPU_BusOperation *operations, byte numOperations);
+
+// How full the switch, solenoid and sound stacks (and LISY's queue of
+// expected responses) have got, and how many pushes they've turned away.
+// The switch stack's two lanes are counted separately. A full priority
+// lane spills into the ordinary one (counted in spills), and a priority
+// switch that finds that full too takes an ordinary switch's place, so
+// its overflows are only priority switches that were actually dropped.
+#define RPU_QUEUE_SWITCH          0
+#define RPU_QUEUE_SOLENOID        1
+#define RPU_QUEUE_SOUND           2
+#define RPU_QUEUE_LISY_EXPECT     3
+#define RPU_QUEUE_PRIORITY_SWITCH 4
+#define RPU_NUM_QUEUES            5
+struct RPU_QueueStats {
+  byte capacity;
+  byte count;
+  byte highWater;
+  unsigned short overflows;
+  unsigned short spills;
+};
+boolean RPU_GetQueueStats(byte queueNum, RPU_QueueStats *queueStats); // false if the queue isn't in this build
+void RPU_ResetQueueStats();
+
+#ifdef RPU_ISR_PROFILER
+// How long each part of the interrupt takes (and how long after the
+// timer the interrupt starts). Times are in microseconds, buckets hold
+// counts of samples under 16, 32, 64, 128 & 256 us, and 256 us or over.
+#define RPU_ISR_PHASE_LATENCY     0
+#define RPU_ISR_PHASE_DISPLAY     1
+#define RPU_ISR_PHASE_LAMPS       2
+#define RPU_ISR_PHASE_SWITCHES    3
+#define RPU_ISR_PHASE_SOLENOIDS   4
+#define RPU_ISR_PHASE_TOTAL       5
+#define RPU_ISR_NUM_PHASES        6
+#define RPU_ISR_PROFILE_BUCKETS   6
+struct RPU_ISRPhaseProfile {
+  unsigned short minTime;
+  unsigned short maxTime;
+  unsigned long samples;
+  unsigned long buckets[RPU_ISR_PROFILE_BUCKETS];
+};
+boolean RPU_GetISRProfile(byte phase, RPU_ISRPhaseProfile *profile);
+unsigned long RPU_GetISROverruns();
+void RPU_ResetISRProfile();
+#endif
+#ifdef RPU_SWITCH_RECORDER
+// Switch logs - every event pulled from the switch stack, as a 4 byte
+// header ('R', 'S', 'W', version), the state of switches 0-63 when
+// recording started (8 bytes, a set bit is closed) and then 3 bytes
+// per event: the switch number (with 0x80 set for an opened event)
+// and the milliseconds since the previous event (low byte first). A
+// gap too long for 16 bits is split with RPU_SWITCH_LOG_GAP records.
+#define RPU_SWITCH_LOG_VERSION      1
+#define RPU_SWITCH_LOG_HEADER_SIZE  4
+#define RPU_SWITCH_LOG_STATE_SIZE   8
+#define RPU_SWITCH_LOG_RECORD_SIZE  3
+#define RPU_SWITCH_LOG_OPENED_FLAG  0x80
+#define RPU_SWITCH_LOG_GAP          0xFF
+void RPU_SetSwitchRecorder(Print *switchLog); // NULL stops recording
+// Looks for a log header in what's arrived on switchLog so far (so it
+// can be polled) and if it's there, echoes it back and replays the log
+// from RPU_Update. speedMultiple 1 is real time, N is N times faster
+// and 0 hands over each event as soon as the switch stack is empty.
+// While it runs, RPU_ReadSingleSwitchState answers from the log.
+boolean RPU_StartSwitchReplay(Stream *switchLog, byte speedMultiple = 1);
+void RPU_StopSwitchReplay();
+boolean RPU_SwitchReplayRunning();
+#endif
 void RPU_Update(unsigned long currentTime);
 #if RPU_MPU_ARCHITECTURE>9
 void RPU_SetBoardLEDs(boolean LED1, boolean LED2, byte BCDValue = 0xFF);
@@ -0,0 +1,249 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+#include <Arduino.h>
+#include "RPU_Config.h"
+#include "RPU.h"
+#include "RPUBenchmark.h"
+
+#ifdef RPU_BENCHMARK
+
+#if !defined(__AVR__)
+// Host build (see host/README.md)
+#include "HostArduino.h"
+#endif
+
+// Internal to RPU.cpp - the loop never calls these, but the
+// interrupt does, so they're part of what a push costs
+byte PullFirstFromSolenoidStack(byte *pulseTicks);
+#define SOLENOID_STACK_EMPTY 0xFF
+#if defined(RPU_OS_USE_WTYPE_1_SOUND) || defined(RPU_OS_USE_WTYPE_2_SOUND)
+unsigned short PullFirstFromSoundStack();
+#define SOUND_STACK_EMPTY 0x0000
+#endif
+
+// The smallest switch matrix and solenoid count of any architecture
+#define BENCHMARK_NUM_SWITCHES    40
+#define BENCHMARK_NUM_SOLENOIDS   15
+#define BENCHMARK_FLASHING_LAMPS  8
+
+typedef void (*BenchmarkCall)(unsigned short iteration);
+
+const char *BenchmarkNames[RPU_NUM_BENCHMARKS] = {
+  "SetLampState",
+  "ReadSwitchState",
+  "SetDisplay",
+  "SetDisplayBlank",
+  "ApplyFlashToLamps",
+  "PullEmptySwitch",
+  "SwitchPushPull",
+  "SolenoidPushPull",
+  "SoundPushPull"
+};
+
+const char *GetRPUBenchmarkName(byte benchmarkNum) {
+  if (benchmarkNum >= RPU_NUM_BENCHMARKS) return "";
+  return BenchmarkNames[benchmarkNum];
+}
+
+// Each call gets arguments that move around the way a game's do
+void BenchmarkNothing(unsigned short iteration) {
+  (void)iteration;
+}
+
+void BenchmarkSetLampState(unsigned short iteration) {
+  RPU_SetLampState(iteration % RPU_MAX_LAMPS, iteration & 0x01, 0, (iteration & 0x02) ? 250 : 0);
+}
+
+void BenchmarkReadSwitchState(unsigned short iteration) {
+  RPU_ReadSingleSwitchState(iteration % BENCHMARK_NUM_SWITCHES);
+}
+
+void BenchmarkSetDisplay(unsigned short iteration) {
+  RPU_SetDisplay(iteration % 4, (unsigned long)iteration * 1230, true, 2);
+}
+
+void BenchmarkSetDisplayBlank(unsigned short iteration) {
+  RPU_SetDisplayBlank(iteration % 4, RPU_OS_ALL_DIGITS_MASK >> (iteration % RPU_OS_NUM_DIGITS));
+}
+
+void BenchmarkApplyFlashToLamps(unsigned short iteration) {
+  RPU_ApplyFlashToLamps((unsigned long)iteration * 7);
+}
+
+void BenchmarkPullEmptySwitch(unsigned short iteration) {
+  (void)iteration;
+  RPU_PullFirstFromSwitchStack();
+}
+
+// The stacks are timed a push and a pull at a time so they stay at the
+// same depth. The interrupt is kept out of each pair (SREG puts it back
+// the way it was, as TimeBenchmarkCall may already have it off), or it
+// could take the entry - and fire a coil or play a sound with it.
+void BenchmarkSwitchStack(unsigned short iteration) {
+  byte oldSREG = SREG;
+  cli();
+  RPU_PushToSwitchStack(iteration % BENCHMARK_NUM_SWITCHES);
+  RPU_PullFirstFromSwitchStack();
+  SREG = oldSREG;
+}
+
+void BenchmarkSolenoidStack(unsigned short iteration) {
+  byte oldSREG = SREG;
+  cli();
+  RPU_PushToSolenoidStack(iteration % BENCHMARK_NUM_SOLENOIDS, 4, true);
+  PullFirstFromSolenoidStack(NULL);
+  SREG = oldSREG;
+}
+
+#if defined(RPU_OS_USE_WTYPE_1_SOUND) || defined(RPU_OS_USE_WTYPE_2_SOUND)
+void BenchmarkSoundStack(unsigned short iteration) {
+  byte oldSREG = SREG;
+  cli();
+#if defined(RPU_OS_USE_WTYPE_2_SOUND)
+  RPU_PushToSoundStack(1 + (iteration % 0x7F), 1);
+#else
+  RPU_PushToSoundStack((1 + (iteration % 0x1F)) * 256, 1);
+#endif
+  PullFirstFromSoundStack();
+  SREG = oldSREG;
+}
+#endif
+
+BenchmarkCall BenchmarkCalls[RPU_NUM_BENCHMARKS] = {
+  BenchmarkSetLampState,
+  BenchmarkReadSwitchState,
+  BenchmarkSetDisplay,
+  BenchmarkSetDisplayBlank,
+  BenchmarkApplyFlashToLamps,
+  BenchmarkPullEmptySwitch,
+  BenchmarkSwitchStack,
+  BenchmarkSolenoidStack,
+#if defined(RPU_OS_USE_WTYPE_1_SOUND) || defined(RPU_OS_USE_WTYPE_2_SOUND)
+  BenchmarkSoundStack
+#else
+  NULL
+#endif
+};
+
+// Total time for numCalls calls, in tenths per call
+#if defined(__AVR__) && (RPU_MPU_ARCHITECTURE>=10)
+// Timer 1 counts every CPU clock (and restarts at OCR1A), so each
+// call is timed on its own with interrupts off
+unsigned long TimeBenchmarkCall(BenchmarkCall benchmarkCall, unsigned short numCalls) {
+  unsigned long totalCycles = 0;
+  for (unsigned short callCount = 0; callCount < numCalls; callCount++) {
+    noInterrupts();
+    unsigned short startCount = TCNT1;
+    benchmarkCall(callCount);
+    unsigned short endCount = TCNT1;
+    interrupts();
+    if (endCount >= startCount) totalCycles += (endCount - startCount);
+    else totalCycles += (endCount + OCR1A + 1) - startCount;
+  }
+  return (totalCycles * 10) / numCalls;
+}
+#elif defined(__AVR__)
+// Timer 1 is prescaled here, so the whole run is timed with micros()
+// (and includes the interrupts that land between the calls)
+unsigned long TimeBenchmarkCall(BenchmarkCall benchmarkCall, unsigned short numCalls) {
+  unsigned long startTime = micros();
+  for (unsigned short callCount = 0; callCount < numCalls; callCount++) benchmarkCall(callCount);
+  unsigned long elapsed = micros() - startTime;
+  return (elapsed * (F_CPU / 100000UL)) / numCalls;
+}
+#else
+unsigned long TimeBenchmarkCall(BenchmarkCall benchmarkCall, unsigned short numCalls) {
+  unsigned long long startTime = HostNanoseconds();
+  for (unsigned short callCount = 0; callCount < numCalls; callCount++) benchmarkCall(callCount);
+  return (unsigned long)(((HostNanoseconds() - startTime) * 10) / numCalls);
+}
+#endif
+
+void ClearBenchmarkState() {
+  RPU_TurnOffAllLamps();
+  for (byte displayCount = 0; displayCount < 4; displayCount++) RPU_SetDisplayBlank(displayCount, 0x00);
+  while (RPU_PullFirstFromSwitchStack() != SWITCH_STACK_EMPTY);
+  noInterrupts();
+  while (PullFirstFromSolenoidStack(NULL) != SOLENOID_STACK_EMPTY);
+#if defined(RPU_OS_USE_WTYPE_1_SOUND) || defined(RPU_OS_USE_WTYPE_2_SOUND)
+  while (PullFirstFromSoundStack() != SOUND_STACK_EMPTY);
+#endif
+  interrupts();
+}
+
+void RunRPUBenchmarks(unsigned short numCalls, unsigned long *times) {
+  if (numCalls == 0) numCalls = 1;
+  ClearBenchmarkState();
+
+  // Call overhead, taken off every result
+  unsigned long overhead = TimeBenchmarkCall(BenchmarkNothing, numCalls);
+
+  for (byte benchmarkNum = 0; benchmarkNum < RPU_NUM_BENCHMARKS; benchmarkNum++) {
+    times[benchmarkNum] = 0;
+    if (BenchmarkCalls[benchmarkNum] == NULL) continue;
+
+    // ApplyFlashToLamps has nothing to do without flashing lamps
+    if (benchmarkNum == RPU_BENCHMARK_APPLY_FLASH_TO_LAMPS) {
+      for (byte lampCount = 0; lampCount < BENCHMARK_FLASHING_LAMPS; lampCount++) {
+        RPU_SetLampState(lampCount * (RPU_MAX_LAMPS / BENCHMARK_FLASHING_LAMPS), 1, 0, 100 + 50 * lampCount);
+      }
+    }
+
+    unsigned long callTime = TimeBenchmarkCall(BenchmarkCalls[benchmarkNum], numCalls);
+    times[benchmarkNum] = (callTime > overhead) ? (callTime - overhead) : 1;
+    ClearBenchmarkState();
+  }
+}
+
+byte ReportRPUBenchmarks(Print *report, const unsigned long *times, const unsigned long *baseline, byte tolerancePercent) {
+  char buf[80];
+  byte numSlower = 0;
+
+#if defined(__AVR__)
+  report->write("RPU benchmarks (cycles per call)\n");
+#else
+  report->write("RPU benchmarks (ns per call)\n");
+#endif
+  for (byte benchmarkNum = 0; benchmarkNum < RPU_NUM_BENCHMARKS; benchmarkNum++) {
+    if (times[benchmarkNum] == 0) continue;
+    sprintf(buf, "  %-18s %6lu.%lu", BenchmarkNames[benchmarkNum], times[benchmarkNum] / 10, times[benchmarkNum] % 10);
+    report->write(buf);
+
+    if (baseline && baseline[benchmarkNum]) {
+      long change = (long)((((long long)times[benchmarkNum] - (long long)baseline[benchmarkNum]) * 100) / (long long)baseline[benchmarkNum]);
+      boolean slower = (change > (long)tolerancePercent) ? true : false;
+      if (slower) numSlower += 1;
+      sprintf(buf, "   base %6lu.%lu  %+4ld%%%s", baseline[benchmarkNum] / 10, baseline[benchmarkNum] % 10, change, slower ? "  SLOWER" : "");
+      report->write(buf);
+    }
+    report->write("\n");
+  }
+
+  // In the form RPU_BENCHMARK_BASELINE takes
+  report->write("Baseline: {");
+  for (byte benchmarkNum = 0; benchmarkNum < RPU_NUM_BENCHMARKS; benchmarkNum++) {
+    sprintf(buf, (benchmarkNum < (RPU_NUM_BENCHMARKS - 1)) ? "%lu, " : "%lu}\n", times[benchmarkNum]);
+    report->write(buf);
+  }
+  if (numSlower) {
+    sprintf(buf, "%d calls more than %d%% slower than the baseline\n", numSlower, tolerancePercent);
+    report->write(buf);
+  }
+  return numSlower;
+}
+
+#endif
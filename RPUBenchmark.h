@@ -0,0 +1,47 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RPU_BENCHMARK_H
+#define RPU_BENCHMARK_H
+
+// Micro-benchmarks of the RPU calls game code makes every loop (built
+// with RPU_BENCHMARK). Times are CPU cycles per call on the Arduino and
+// nanoseconds per call on the host build, kept in tenths.
+#define RPU_BENCHMARK_SET_LAMP_STATE        0
+#define RPU_BENCHMARK_READ_SWITCH_STATE     1
+#define RPU_BENCHMARK_SET_DISPLAY           2
+#define RPU_BENCHMARK_SET_DISPLAY_BLANK     3
+#define RPU_BENCHMARK_APPLY_FLASH_TO_LAMPS  4
+#define RPU_BENCHMARK_PULL_EMPTY_SWITCH     5
+#define RPU_BENCHMARK_SWITCH_STACK          6
+#define RPU_BENCHMARK_SOLENOID_STACK        7
+#define RPU_BENCHMARK_SOUND_STACK           8
+#define RPU_NUM_BENCHMARKS                  9
+
+// Paste the "Baseline" line of a report on the Arduino here, and later
+// runs flag calls that have got slower (0 is no baseline)
+#define RPU_BENCHMARK_BASELINE  {0, 0, 0, 0, 0, 0, 0, 0, 0}
+
+const char *GetRPUBenchmarkName(byte benchmarkNum);
+// Runs each call numCalls times, leaving the average time of each in
+// times (a benchmark that isn't built for this config gets 0). Lamps,
+// displays and the stacks are left cleared.
+void RunRPUBenchmarks(unsigned short numCalls, unsigned long *times);
+// Prints the times and their change from baseline (NULL for none) and
+// returns how many are more than tolerancePercent slower
+byte ReportRPUBenchmarks(Print *report, const unsigned long *times, const unsigned long *baseline, byte tolerancePercent);
+
+#endif
@@ -65,6 +65,23 @@
 //#define RPU_OS_USE_6_DIGIT_CREDIT_DISPLAY_WITH_7_DIGIT_DISPLAYS
 //#define RPU_USE_EXTENDED_SWITCHES_ON_PB4
 //#define RPU_USE_EXTENDED_SWITCHES_ON_PB7
+
+// Fire the coils registered with RPU_SetupGameSwitches (pops & slings)
+// straight from the switch interrupt instead of waiting for loop()
+#define RPU_STREAMLINED_IMMEDIATE_SOLENOIDS
+// (Arch >= 10) Scan a few switch columns every interrupt, letting each
+// one settle while the interrupt does other work, instead of all
+// eight (with a 12us wait each) every other interrupt
+//#define RPU_SPLIT_SWITCH_SCAN
+// Time each part of the interrupt (for tuning - adds a little to every
+// interrupt). Results are in RPU_GetISRProfile and a self-test page.
+//#define RPU_ISR_PROFILER
+// Record every switch event the game pulls to a serial port, or replay
+// a recorded log in their place (see RPU_SetSwitchRecorder)
+//#define RPU_SWITCH_RECORDER
+// Time the lamp, switch, display and stack calls at power on and report
+// them over Serial against RPU_BENCHMARK_BASELINE (see RPUBenchmark.h)
+//#define RPU_BENCHMARK
 #define RPU_OS_USE_WTYPE_1_SOUND
 //#define RPU_OS_USE_WTYPE_2_SOUND
 //#define RPU_OS_USE_W11_SOUND
@@ -0,0 +1,144 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef RPU_RING_H
+#define RPU_RING_H
+
+// Single-producer/single-consumer ring used for the RPU's queues.
+//
+// first and last count up freely (wrapping at 256) and are masked down
+// to an index, so the capacity has to be a power of two no bigger than
+// 128, every slot can be used, and nothing checks for the end of the
+// array. Only the producer moves last and only the consumer moves first,
+// and each is a single byte, so the interrupt can be either side without
+// interrupts being turned off. If both the loop and the interrupt push,
+// the loop has to push with interrupts off.
+//
+// The producer fills the slot from Reserve() and then Publish()es it;
+// the consumer reads the slot from Front() and then Release()s it. The
+// barrier between the two stops the compiler moving the entry across
+// the index update, which is all a single core AVR needs.
+
+#define RPU_RING_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+template <typename EntryType, byte Capacity>
+struct RPU_Ring {
+  static_assert(Capacity && Capacity <= 128 && (Capacity & (Capacity - 1)) == 0, "RPU_Ring capacity must be a power of two up to 128");
+
+  EntryType entries[Capacity];
+  volatile byte first;
+  volatile byte last;
+  // Pushes turned away because the ring was full, and the most entries
+  // it has held (both kept by the producer)
+  volatile unsigned short overflows;
+  volatile byte highWater;
+
+  byte Count() {
+    return (byte)(last - first);
+  }
+
+  boolean IsEmpty() {
+    return (first == last) ? true : false;
+  }
+
+  // Producer side
+  EntryType *Reserve() {
+    if ((byte)(last - first) >= Capacity) {
+      overflows += 1;
+      return NULL;
+    }
+    RPU_RING_BARRIER();
+    return &entries[last & (Capacity - 1)];
+  }
+
+  void Publish() {
+    RPU_RING_BARRIER();
+    last = last + 1;
+    byte count = (byte)(last - first);
+    if (count > highWater) highWater = count;
+  }
+
+  boolean Push(EntryType entry) {
+    EntryType *slot = Reserve();
+    if (slot == NULL) return false;
+    *slot = entry;
+    Publish();
+    return true;
+  }
+
+  // The entry pushed last (the producer's own, so it's safe to read)
+  EntryType *Back() {
+    if (first == last) return NULL;
+    return &entries[(byte)(last - 1) & (Capacity - 1)];
+  }
+
+  // Consumer side
+  EntryType *Front() {
+    if (first == last) return NULL;
+    RPU_RING_BARRIER();
+    return &entries[first & (Capacity - 1)];
+  }
+
+  void Release() {
+    RPU_RING_BARRIER();
+    first = first + 1;
+  }
+
+  boolean Pull(EntryType *entry) {
+    EntryType *slot = Front();
+    if (slot == NULL) return false;
+    *entry = *slot;
+    Release();
+    return true;
+  }
+
+  // Entries from the front (0) back, for searching the ring from the
+  // consumer side, or from the producer while the consumer can't run
+  EntryType *Peek(byte position) {
+    if (position >= (byte)(last - first)) return NULL;
+    return &entries[(byte)(first + position) & (Capacity - 1)];
+  }
+
+  // Puts an entry in front of the rest. This moves first, so it's only
+  // safe from the consumer (or with the producer held off).
+  EntryType *ReserveFront() {
+    if ((byte)(last - first) >= Capacity) {
+      overflows += 1;
+      return NULL;
+    }
+    RPU_RING_BARRIER();
+    return &entries[(byte)(first - 1) & (Capacity - 1)];
+  }
+
+  void PublishFront() {
+    RPU_RING_BARRIER();
+    first = first - 1;
+    byte count = (byte)(last - first);
+    if (count > highWater) highWater = count;
+  }
+
+  // Drops everything queued (consumer side)
+  void Clear() {
+    first = last;
+  }
+
+  void ResetStats() {
+    overflows = 0;
+    highWater = (byte)(last - first);
+  }
+};
+
+#endif
@@ -360,6 +360,45 @@ int RunBaseSelfTest(int curState, boolean curStateChanged, unsigned long Current
     cpcSelectorStartByte = RPU_CPC_CHUTE_2_SELECTION_BYTE;
   } else if (curState==MACHINE_STATE_ADJUST_CPC_CHUTE_3) {
     cpcSelectorStartByte = RPU_CPC_CHUTE_3_SELECTION_BYTE;
+#ifdef RPU_ISR_PROFILER
+  } else if (curState==MACHINE_STATE_TEST_ISR_PROFILE) {
+    // Ball in play shows the phase (reset picks the next one, double-click clears)
+    // 1: max us, 2: min us, 3: overruns, 4: share of samples in each bucket (in tenths)
+    if (curStateChanged) {
+      CurValue = RPU_ISR_PHASE_TOTAL;
+      LastSolTestTime = 0;
+    }
+    if (curSwitch==resetSwitch) {
+      if (RPU_GetUpDownSwitchState()) {
+        CurValue += 1;
+        if (CurValue>=RPU_ISR_NUM_PHASES) CurValue = 0;
+      } else {
+        if (CurValue>0) CurValue -= 1;
+        else CurValue = RPU_ISR_NUM_PHASES - 1;
+      }
+      LastSolTestTime = 0;
+    }
+    if (resetDoubleClick) {
+      RPU_ResetISRProfile();
+      LastSolTestTime = 0;
+    }
+    if (LastSolTestTime==0 || (CurrentTime-LastSolTestTime)>500) {
+      RPU_ISRPhaseProfile profile;
+      RPU_GetISRProfile(CurValue, &profile);
+      RPU_SetDisplayBallInPlay(CurValue);
+      RPU_SetDisplay(0, profile.maxTime, true);
+      RPU_SetDisplay(1, profile.minTime, true);
+      RPU_SetDisplay(2, RPU_GetISROverruns(), true);
+      unsigned long histogram = 0;
+      for (byte bucketCount=0; bucketCount<RPU_ISR_PROFILE_BUCKETS; bucketCount++) {
+        unsigned long tenths = (profile.samples>=10) ? (profile.buckets[bucketCount]/(profile.samples/10)) : 0;
+        if (tenths>9) tenths = 9;
+        histogram = histogram*10 + tenths;
+      }
+      RPU_SetDisplay(3, histogram, true, RPU_ISR_PROFILE_BUCKETS);
+      LastSolTestTime = CurrentTime;
+    }
+#endif
   }
 
   if (savedScoreStartByte) {
@@ -20,6 +20,8 @@
 
 #ifndef SELF_TEST_H
 
+#include "RPU_Config.h"
+
 #define MACHINE_STATE_TEST_SOUNDS         -1
 #define MACHINE_STATE_TEST_SWITCHES       -2
 #define MACHINE_STATE_TEST_SOLENOIDS      -3
@@ -40,8 +42,14 @@
 #define MACHINE_STATE_ADJUST_CPC_CHUTE_1        -18
 #define MACHINE_STATE_ADJUST_CPC_CHUTE_2        -19
 #define MACHINE_STATE_ADJUST_CPC_CHUTE_3        -20
+#ifdef RPU_ISR_PROFILER
+#define MACHINE_STATE_TEST_ISR_PROFILE    -21
+// This define is set to the last test, so the extended settings will know when to take over
+#define MACHINE_STATE_TEST_DONE           -21
+#else
 // This define is set to the last test, so the extended settings will know when to take over
 #define MACHINE_STATE_TEST_DONE           -20
+#endif
 
 unsigned long GetLastSelfTestChangedTime();
 void SetLastSelfTestChangedTime(unsigned long setSelfTestChange);
@@ -1,3 +1,56 @@
+// MachineState (negative - self-test modes, positive - game play)
+#define MACHINE_STATE_ATTRACT         0
+#define MACHINE_STATE_INIT_GAMEPLAY   1
+#define MACHINE_STATE_INIT_NEW_BALL   2
+#define MACHINE_STATE_NORMAL_GAMEPLAY 4
+#define MACHINE_STATE_COUNTDOWN_BONUS 99
+#define MACHINE_STATE_BALL_OVER       100
+#define MACHINE_STATE_MATCH_MODE      110
+
+// The adjustments count down from the end of the self-test
+// states (MACHINE_STATE_TEST_DONE is in SelfTestAndAudit.h)
+#define MACHINE_STATE_ADJUST_FREEPLAY             (MACHINE_STATE_TEST_DONE-1)
+#define MACHINE_STATE_ADJUST_BALL_SAVE            (MACHINE_STATE_TEST_DONE-2)
+#define MACHINE_STATE_ADJUST_SOUND_SELECTOR       (MACHINE_STATE_TEST_DONE-3)
+#define MACHINE_STATE_ADJUST_MUSIC_VOLUME         (MACHINE_STATE_TEST_DONE-4)
+#define MACHINE_STATE_ADJUST_SFX_VOLUME           (MACHINE_STATE_TEST_DONE-5)
+#define MACHINE_STATE_ADJUST_CALLOUTS_VOLUME      (MACHINE_STATE_TEST_DONE-6)
+#define MACHINE_STATE_ADJUST_TOURNAMENT_SCORING   (MACHINE_STATE_TEST_DONE-7)
+#define MACHINE_STATE_ADJUST_TILT_WARNING         (MACHINE_STATE_TEST_DONE-8)
+#define MACHINE_STATE_ADJUST_AWARD_OVERRIDE       (MACHINE_STATE_TEST_DONE-9)
+#define MACHINE_STATE_ADJUST_BALLS_OVERRIDE       (MACHINE_STATE_TEST_DONE-10)
+#define MACHINE_STATE_ADJUST_SCROLLING_SCORES     (MACHINE_STATE_TEST_DONE-11)
+#define MACHINE_STATE_ADJUST_EXTRA_BALL_AWARD     (MACHINE_STATE_TEST_DONE-12)
+#define MACHINE_STATE_ADJUST_SPECIAL_AWARD        (MACHINE_STATE_TEST_DONE-13)
+#define MACHINE_STATE_ADJUST_GOALS_UNTIL_WIZARD   (MACHINE_STATE_TEST_DONE-14)
+#define MACHINE_STATE_ADJUST_WIZARD_TIME          (MACHINE_STATE_TEST_DONE-15)
+#define MACHINE_STATE_ADJUST_IDLE_MODE            (MACHINE_STATE_TEST_DONE-16)
+#define MACHINE_STATE_ADJUST_COMBOS_TO_FINISH     (MACHINE_STATE_TEST_DONE-17)
+#define MACHINE_STATE_ADJUST_SPINNER_ACCELERATORS (MACHINE_STATE_TEST_DONE-18)
+#define MACHINE_STATE_ADJUST_ALLOW_RESET          (MACHINE_STATE_TEST_DONE-19)
+#define MACHINE_STATE_ADJUST_DONE                 (MACHINE_STATE_TEST_DONE-20)
+
+// The lower 4 bits of the Game Mode are modes, the upper 4 are for frenzies
+// and other flags that carry through different modes
+#define GAME_MODE_SKILL_SHOT                        0
+#define GAME_MODE_UNSTRUCTURED_PLAY                 1
+#define GAME_MODE_BATTLE_START                      2
+#define GAME_MODE_BATTLE                            3
+#define GAME_MODE_BATTLE_ADD_ENEMY                  4
+#define GAME_MODE_BATTLE_WON                        5
+#define GAME_MODE_BATTLE_LOST                       6
+#define GAME_MODE_INVASION_START                    7
+#define GAME_MODE_INVASION                          8
+#define GAME_MODE_INVASION_WON                      9
+#define GAME_MODE_INVASION_LOST                     10
+#define GAME_MODE_WIZARD_START                      11
+#define GAME_MODE_WIZARD_WAIT_FOR_BALL              12
+#define GAME_MODE_WIZARD                            13
+#define GAME_MODE_WIZARD_FINISHED_100               14
+#define GAME_MODE_WIZARD_FINISHED_50                15
+#define GAME_MODE_WIZARD_FINISHED_10                16
+#define GAME_MODE_WIZARD_END_BALL_COLLECT           17
+#define GAME_BASE_MODE                              0x1F
 
 #define LAMP_SHOOT_AGAIN            0
 #define LAMP_CIRCLE_S1              1
@@ -148,7 +201,7 @@
 
 
 #define LAMP_ANIMATION_STEPS  16
-byte LampAnimations[4][LAMP_ANIMATION_STEPS][8] = {
+const byte LampAnimations[4][LAMP_ANIMATION_STEPS][8] PROGMEM = {
   // Radar
   {
 {0x00, 0x08, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00},
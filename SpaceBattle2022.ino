@@ -9,6 +9,7 @@
 
 #include "RPU_Config.h"
 #include "RPU.h"
+#include "RPU_Ring.h"
 #include "SpaceBattle2022.h"
 #include "SelfTestAndAudit.h"
 #include <EEPROM.h>
@@ -21,6 +22,10 @@
 SendOnlyWavTrigger wTrig;             // Our WAV Trigger object
 #endif
 
+#ifdef RPU_BENCHMARK
+#include "RPUBenchmark.h"
+#endif
+
 #define SPACE_BATTLE_MAJOR_VERSION  2022
 #define SPACE_BATTLE_MINOR_VERSION  2
 #define DEBUG_MESSAGES  1
@@ -41,57 +46,52 @@ void PlayBackgroundSong(unsigned int songNum, unsigned long backgroundSongNumSec
 //  positive - game play
 char MachineState = 0;
 boolean MachineStateChanged = true;
-#define MACHINE_STATE_ATTRACT         0
-#define MACHINE_STATE_INIT_GAMEPLAY   1
-#define MACHINE_STATE_INIT_NEW_BALL   2
-#define MACHINE_STATE_NORMAL_GAMEPLAY 4
-#define MACHINE_STATE_COUNTDOWN_BONUS 99
-#define MACHINE_STATE_BALL_OVER       100
-#define MACHINE_STATE_MATCH_MODE      110
-
-#define MACHINE_STATE_ADJUST_FREEPLAY             -21
-#define MACHINE_STATE_ADJUST_BALL_SAVE            -22
-#define MACHINE_STATE_ADJUST_SOUND_SELECTOR       -23
-#define MACHINE_STATE_ADJUST_MUSIC_VOLUME         -24
-#define MACHINE_STATE_ADJUST_SFX_VOLUME           -25
-#define MACHINE_STATE_ADJUST_CALLOUTS_VOLUME      -26
-#define MACHINE_STATE_ADJUST_TOURNAMENT_SCORING   -27
-#define MACHINE_STATE_ADJUST_TILT_WARNING         -28
-#define MACHINE_STATE_ADJUST_AWARD_OVERRIDE       -29
-#define MACHINE_STATE_ADJUST_BALLS_OVERRIDE       -30
-#define MACHINE_STATE_ADJUST_SCROLLING_SCORES     -31
-#define MACHINE_STATE_ADJUST_EXTRA_BALL_AWARD     -32
-#define MACHINE_STATE_ADJUST_SPECIAL_AWARD        -33
-#define MACHINE_STATE_ADJUST_GOALS_UNTIL_WIZARD   -34
-#define MACHINE_STATE_ADJUST_WIZARD_TIME          -35
-#define MACHINE_STATE_ADJUST_IDLE_MODE            -36
-#define MACHINE_STATE_ADJUST_COMBOS_TO_FINISH     -37
-#define MACHINE_STATE_ADJUST_SPINNER_ACCELERATORS -38
-#define MACHINE_STATE_ADJUST_ALLOW_RESET          -39
-#define MACHINE_STATE_ADJUST_DONE                 -40
-
-// The lower 4 bits of the Game Mode are modes, the upper 4 are for frenzies
-// and other flags that carry through different modes
-#define GAME_MODE_SKILL_SHOT                        0
-#define GAME_MODE_UNSTRUCTURED_PLAY                 1
-#define GAME_MODE_BATTLE_START                      2
-#define GAME_MODE_BATTLE                            3
-#define GAME_MODE_BATTLE_ADD_ENEMY                  4
-#define GAME_MODE_BATTLE_WON                        5
-#define GAME_MODE_BATTLE_LOST                       6
-#define GAME_MODE_INVASION_START                    7
-#define GAME_MODE_INVASION                          8
-#define GAME_MODE_INVASION_WON                      9
-#define GAME_MODE_INVASION_LOST                     10
-#define GAME_MODE_WIZARD_START                      11
-#define GAME_MODE_WIZARD_WAIT_FOR_BALL              12
-#define GAME_MODE_WIZARD                            13
-#define GAME_MODE_WIZARD_FINISHED_100               14
-#define GAME_MODE_WIZARD_FINISHED_50                15
-#define GAME_MODE_WIZARD_FINISHED_10                16
-#define GAME_MODE_WIZARD_END_BALL_COLLECT           17
-#define GAME_BASE_MODE                              0x1F
 
+#ifdef RPU_SWITCH_RECORDER
+// Switch logs (see RPU_SetSwitchRecorder) go over their own port so
+// they don't mix with the debug messages. A log that's sent to it in
+// the first SWITCH_LOG_REPLAY_WAIT_MS after power on is replayed,
+// otherwise the game's switches are recorded to it.
+#define SWITCH_LOG_SERIAL           Serial2
+#define SWITCH_LOG_BAUD             115200
+#define SWITCH_LOG_REPLAY_WAIT_MS   2000
+#endif
+
+// Loop profiler - times the stages of loop() with micros() and reports
+// each stage's average & max, the loop rate, and the worst loop in each
+// machine state over Serial every LOOP_PROFILE_REPORT_MS. Stages inside
+// other stages (switches, lamps, displays) are also counted in them.
+// The board's BCD LEDs show the worst loop (in ms) of each quarter second.
+//#define LOOP_PROFILER
+#ifdef LOOP_PROFILER
+#define LOOP_STAGE_WHOLE_LOOP       0
+#define LOOP_STAGE_MACHINE_STATE    1
+#define LOOP_STAGE_SWITCHES         2
+#define LOOP_STAGE_GAME_MODE        3
+#define LOOP_STAGE_LAMPS            4
+#define LOOP_STAGE_DISPLAYS         5
+#define LOOP_STAGE_RPU_UPDATE       6
+#define LOOP_STAGE_SOUND_QUEUE      7
+#define LOOP_STAGE_NOTIFICATIONS    8
+#define LOOP_STAGE_BOARD_LEDS       9
+#define NUM_LOOP_STAGES             10
+#define NUM_LOOP_PROFILE_STATES     8
+#define LOOP_PROFILE_REPORT_MS      5000
+
+struct LoopStageProfile {
+  unsigned long totalMicros;
+  unsigned long maxMicros;
+  unsigned long samples;
+};
+LoopStageProfile LoopStages[NUM_LOOP_STAGES];
+unsigned long WorstLoopByState[NUM_LOOP_PROFILE_STATES];
+
+#define LOOP_STAGE_BEGIN(stageStart)        unsigned long stageStart = micros()
+#define LOOP_STAGE_END(stage, stageStart)   EndLoopStage(stage, &stageStart)
+#else
+#define LOOP_STAGE_BEGIN(stageStart)
+#define LOOP_STAGE_END(stage, stageStart)
+#endif
 
 #define EEPROM_BALL_SAVE_BYTE           100
 #define EEPROM_FREE_PLAY_BYTE           101
@@ -336,6 +336,8 @@ boolean AllowResetAfterBallOne = true;
 unsigned long CurrentScores[4];
 unsigned long BallFirstSwitchHitTime = 0;
 unsigned long BallTimeInTrough = 0;
+unsigned long OutholeClosedTime = 0;
+unsigned long SaucerClosedTime = 0;
 unsigned long GameModeStartTime = 0;
 unsigned long GameModeEndTime = 0;
 unsigned long LastTiltWarningTime = 0;
@@ -382,6 +384,24 @@ byte CombosToFinishGoal = 6;
 #define NUM_BALL_SEARCH_SOLENOIDS   8
 byte BallSearchSolenoidToTry;
 byte BallSearchSols[NUM_BALL_SEARCH_SOLENOIDS] = {SOL_BOTTOM_LEFT_POP, SOL_SAUCER, SOL_UPPER_LEFT_POP, SOL_UPPER_RIGHT_POP, SOL_CENTER_POP, SOL_BOTTOM_RIGHT_POP, SOL_RIGHT_SLING, SOL_LEFT_SLING};
+
+// Coils fired directly by the switch interrupt. The other pops & slings
+// are on the special solenoid lines, which the hardware fires on its own.
+#define NUM_SWITCHES_WITH_TRIGGERS          1
+#define NUM_PRIORITY_SWITCHES_WITH_TRIGGERS 1
+PlayfieldAndCabinetSwitch SolenoidAssociatedSwitches[NUM_SWITCHES_WITH_TRIGGERS] = {
+  { SW_BOTTOM_RIGHT_POP, SOL_BOTTOM_RIGHT_POP, 10}
+};
+
+// Spinners close for a single scan at full speed, while the
+// saucer and outhole rattle as the ball settles
+#define NUM_SWITCH_DEBOUNCE_PROFILES  4
+SwitchDebounceProfile SwitchDebounceProfiles[NUM_SWITCH_DEBOUNCE_PROFILES] = {
+  {SW_LEFT_SPINNER, 1, 2},
+  {SW_RIGHT_SPINNER, 1, 2},
+  {SW_SAUCER, 6, 6},
+  {SW_OUTHOLE, 7, 7}
+};
 byte GoalsUntilWizard;
 byte WizardModeTime;
 
@@ -610,6 +630,44 @@ void setup() {
   RPU_DisableSolenoidStack();
   RPU_SetDisableFlippers(true);
 
+  // The outhole and saucer report when the ball leaves too,
+  // so gameplay knows when the ball got there
+  RPU_SetSwitchOpenEvents(SW_OUTHOLE);
+  RPU_SetSwitchOpenEvents(SW_SAUCER);
+  // Cabinet switches and the outhole can't wait behind (or be
+  // pushed out by) a burst of pops and spinners
+  RPU_SetSwitchPriority(SW_PLUMB_TILT);
+  RPU_SetSwitchPriority(SW_ROLL_TILT);
+  RPU_SetSwitchPriority(SW_PLAYFIELD_TILT);
+  RPU_SetSwitchPriority(SW_SLAM);
+  RPU_SetSwitchPriority(SW_CREDIT_RESET);
+  RPU_SetSwitchPriority(SW_COIN_1);
+  RPU_SetSwitchPriority(SW_COIN_2);
+  RPU_SetSwitchPriority(SW_COIN_3);
+  RPU_SetSwitchPriority(SW_OUTHOLE);
+  RPU_SetupGameSwitches(NUM_SWITCHES_WITH_TRIGGERS, NUM_PRIORITY_SWITCHES_WITH_TRIGGERS, SolenoidAssociatedSwitches, NUM_SWITCH_DEBOUNCE_PROFILES, SwitchDebounceProfiles);
+#if defined(RPU_STREAMLINED_IMMEDIATE_SOLENOIDS) && (RPU_MPU_ARCHITECTURE>=10)
+  RPU_SetImmediateSolenoidHoldoff(SOL_BOTTOM_RIGHT_POP, 100);
+#endif
+
+#ifdef RPU_BENCHMARK
+  // Times the RPU calls before the game starts using them (and
+  // before the switch recorder is attached, so it isn't timed and
+  // the benchmark's switch events don't end up in the log)
+  Serial.begin(57600);
+  unsigned long benchmarkTimes[RPU_NUM_BENCHMARKS];
+  const unsigned long benchmarkBaseline[RPU_NUM_BENCHMARKS] = RPU_BENCHMARK_BASELINE;
+  RunRPUBenchmarks(1000, benchmarkTimes);
+  ReportRPUBenchmarks(&Serial, benchmarkTimes, benchmarkBaseline, 10);
+#endif
+
+#ifdef RPU_SWITCH_RECORDER
+  SWITCH_LOG_SERIAL.begin(SWITCH_LOG_BAUD);
+  unsigned long replayWaitStart = millis();
+  while (!RPU_StartSwitchReplay(&SWITCH_LOG_SERIAL) && (millis() - replayWaitStart) < SWITCH_LOG_REPLAY_WAIT_MS);
+  if (!RPU_SwitchReplayRunning()) RPU_SetSwitchRecorder(&SWITCH_LOG_SERIAL);
+#endif
+
   if (DEBUG_MESSAGES) {
     char buf[256];
     sprintf(buf, "initResult = 0x%08lX\n", initResult);
@@ -641,10 +699,31 @@ void setup() {
   PlaySoundEffectWhenPossible(31 * 256, 3000, 55, 5);
   PlaySoundEffectWhenPossible(2 * 256, 4000, 55, 5);
 
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+  // The default pulse replaces the 50 pushes (~103 ms) the
+  // resets have always been given
+  RPU_SetSolenoidDefaultPulse(SOL_LEFT_DT_RESET, 100);
+  RPU_SetSolenoidDefaultPulse(SOL_CENTER_LEFT_DT_RESET, 100);
+  RPU_SetSolenoidDefaultPulse(SOL_CENTER_RIGHT_DT_RESET, 100);
+  RPU_SetSolenoidDefaultPulse(SOL_TOP_DT_RESET, 100);
+#else
   RPU_SetSolenoidDefaultPulse(SOL_LEFT_DT_RESET, 50);
   RPU_SetSolenoidDefaultPulse(SOL_CENTER_LEFT_DT_RESET, 50);
   RPU_SetSolenoidDefaultPulse(SOL_CENTER_RIGHT_DT_RESET, 50);
   RPU_SetSolenoidDefaultPulse(SOL_TOP_DT_RESET, 50);
+#endif
+
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+  // Drop target resets, outhole and saucer share the main coil supply --
+  // keep at most two of them energized and give each time to cool
+  RPU_SetSolenoidLimits(SOL_LEFT_DT_RESET, 25, 200, 1);
+  RPU_SetSolenoidLimits(SOL_CENTER_LEFT_DT_RESET, 25, 200, 1);
+  RPU_SetSolenoidLimits(SOL_CENTER_RIGHT_DT_RESET, 25, 200, 1);
+  RPU_SetSolenoidLimits(SOL_TOP_DT_RESET, 25, 200, 1);
+  RPU_SetSolenoidLimits(SOL_OUTHOLE, 20, 250, 1);
+  RPU_SetSolenoidLimits(SOL_SAUCER, 20, 250, 1);
+  RPU_SetSolenoidPowerGroupLimit(1, 2);
+#endif
 }
 
 byte ReadSetting(byte setting, byte defaultValue) {
@@ -672,29 +751,45 @@ byte CheckSequentialSwitches(byte startingSwitch, byte numSwitches) {
 //  Lamp Management functions
 //
 ////////////////////////////////////////////////////////////////////////////
-void ShowLampAnimation(byte animationNum, unsigned long divisor, unsigned long baseTime, byte subOffset, boolean dim, boolean reverse = false, byte keepLampOn = 99) {
-  byte currentStep = (baseTime / divisor) % LAMP_ANIMATION_STEPS;
-  if (reverse) currentStep = (LAMP_ANIMATION_STEPS - 1) - currentStep;
+// The animation runs for as long as something
+// keeps asking for it each loop (see loop())
+boolean LampAnimationShown = false;
 
-  byte lampNum = 0;
-  for (int byteNum = 0; byteNum < 8; byteNum++) {
-    byte bitMask = 0x01;
-    for (byte bitNum = 0; bitNum < 8; bitNum++) {
+void ShowLampAnimation(byte animationNum, unsigned long divisor, unsigned long baseTime, byte subOffset, boolean reverse = false) {
+  RPU_StartLampAnimation(&LampAnimations[animationNum][0][0], LAMP_ANIMATION_STEPS, divisor, baseTime, subOffset, reverse ? RPU_LAMP_ANIMATION_REVERSE : 0);
+  LampAnimationShown = true;
+}
 
-      // if there's a subOffset, turn off lights at that offset
-      if (subOffset) {
-        byte lampOff = true;
-        lampOff = LampAnimations[animationNum][(currentStep + subOffset) % LAMP_ANIMATION_STEPS][byteNum] & bitMask;
-        if (lampOff && lampNum != keepLampOn) RPU_SetLampState(lampNum, 0);
-      }
+// Idle mode advertising lives on the mode lamp layer, so it's only
+// rebuilt when IdleMode changes and the normal lamp functions don't
+// have to check for it (the layer hides whatever they set underneath)
+byte IdleModeLampsShown = IDLE_MODE_NONE;
 
-      byte lampOn = false;
-      lampOn = LampAnimations[animationNum][currentStep][byteNum] & bitMask;
-      if (lampOn) RPU_SetLampState(lampNum, 1, dim);
+void ShowIdleModeLampLayer() {
+  byte idleMode = (MachineState == MACHINE_STATE_NORMAL_GAMEPLAY) ? IdleMode : IDLE_MODE_NONE;
+  if (idleMode == IdleModeLampsShown) return;
+  IdleModeLampsShown = idleMode;
 
-      lampNum += 1;
-      bitMask *= 2;
-    }
+  RPU_ClearLampLayer(RPU_LAMP_LAYER_MODE);
+  if (idleMode == IDLE_MODE_NONE) return;
+
+  byte advertiseInvasion = (idleMode == IDLE_MODE_ADVERTISE_INVASION) ? RPU_LAYER_LAMP_FLASH : RPU_LAYER_LAMP_OFF;
+  byte advertiseCombos = (idleMode == IDLE_MODE_ADVERTISE_COMBOS) ? RPU_LAYER_LAMP_FLASH : RPU_LAYER_LAMP_OFF;
+  byte advertiseSpins = (idleMode == IDLE_MODE_ADVERTISE_SPINS || idleMode == IDLE_MODE_ADVERTISE_COMBOS) ? RPU_LAYER_LAMP_FLASH : RPU_LAYER_LAMP_OFF;
+
+  RPU_SetLampLayerFlashPeriod(RPU_LAMP_LAYER_MODE, 250);
+  for (byte count = 0; count < 4; count++) {
+    RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_1 + count, advertiseInvasion);
+    RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_W_ROLLOVER + count, advertiseCombos);
+  }
+  RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_CAPTIVE_BALL, advertiseCombos);
+  RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_BULLSEYE_SPECIAL, advertiseCombos);
+  RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_OUTLANE_SPECIAL, RPU_LAYER_LAMP_OFF);
+  RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_SPINNERS, advertiseSpins);
+
+  if (idleMode == IDLE_MODE_ADVERTISE_SHIELD) {
+    for (byte count = 0; count < 7; count++) RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_CIRCLE_S1 + count, RPU_LAYER_LAMP_FLASH);
+    for (byte count = 0; count < 4; count++) RPU_SetLayerLamp(RPU_LAMP_LAYER_MODE, LAMP_CIRCLE_W + count, RPU_LAYER_LAMP_FLASH);
   }
 }
 
@@ -707,10 +802,6 @@ void ShowTopLaneLamps() {
     for (byte count = 0; count < 4; count++) {
       RPU_SetLampState(LAMP_1 + count, count == SkillShotLane, 0, 250);
     }
-  } else if (IdleMode != IDLE_MODE_NONE) {
-    for (byte count = 0; count < 4; count++) {
-      RPU_SetLampState(LAMP_1 + count, IdleMode == IDLE_MODE_ADVERTISE_INVASION, 0, 250);
-    }
   } else if (InvasionPosition & INVASION_POSITION_TOP_LANE_MASK) {
     unsigned short laneMask = 0x0001;
     for (byte count = 0; count < 4; count++) {
@@ -784,13 +875,6 @@ void ShowSRWSCircleLamps() {
     for (byte count = 0; count < 4; count++) {
       RPU_SetLampState(LAMP_CIRCLE_W + count, count >= (lampPhase - 8) && count <= (lampPhase - 6));
     }
-  } else if (IdleMode == IDLE_MODE_ADVERTISE_SHIELD) {
-    for (byte count = 0; count < 7; count++) {
-      RPU_SetLampState(LAMP_CIRCLE_S1 + count, 1, 0, 250);
-    }
-    for (byte count = 0; count < 4; count++) {
-      RPU_SetLampState(LAMP_CIRCLE_W + count, 1, 0, 250);
-    }
   } else if ((GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE_START || (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE_ADD_ENEMY) {
 
     int lampPhase = ((CurrentTime - GameModeStartTime) / 75) % 30;
@@ -895,14 +979,6 @@ void ShowLaneRolloverAndTargetLamps() {
     RPU_SetLampState(LAMP_CAPTIVE_BALL, 0);
     RPU_SetLampState(LAMP_OUTLANE_SPECIAL, 0);
     RPU_SetLampState(LAMP_BULLSEYE_SPECIAL, 0);
-  } else if (IdleMode != IDLE_MODE_NONE) {
-    RPU_SetLampState(LAMP_W_ROLLOVER, IdleMode == IDLE_MODE_ADVERTISE_COMBOS, 0, 250);
-    RPU_SetLampState(LAMP_A_ROLLOVER, IdleMode == IDLE_MODE_ADVERTISE_COMBOS, 0, 250);
-    RPU_SetLampState(LAMP_R_ROLLOVER, IdleMode == IDLE_MODE_ADVERTISE_COMBOS, 0, 250);
-    RPU_SetLampState(LAMP_S_ROLLOVER, IdleMode == IDLE_MODE_ADVERTISE_COMBOS, 0, 250);
-    RPU_SetLampState(LAMP_CAPTIVE_BALL, IdleMode == IDLE_MODE_ADVERTISE_COMBOS, 0, 250);
-    RPU_SetLampState(LAMP_OUTLANE_SPECIAL, 0);
-    RPU_SetLampState(LAMP_BULLSEYE_SPECIAL, IdleMode == IDLE_MODE_ADVERTISE_COMBOS, 0, 250);
   } else {
     boolean lampWHandled = false;
     boolean lampSHandled = false;
@@ -975,8 +1051,6 @@ void ShowLaneRolloverAndTargetLamps() {
 void ShowSpinnerLamps() {
   if ( (GameMode & GAME_BASE_MODE) == GAME_MODE_SKILL_SHOT) {
     RPU_SetLampState(LAMP_SPINNERS, 0);
-  } else if (IdleMode != IDLE_MODE_NONE) {
-    RPU_SetLampState(LAMP_SPINNERS, (IdleMode == IDLE_MODE_ADVERTISE_SPINS) || (IdleMode == IDLE_MODE_ADVERTISE_COMBOS), 0, 250);
   } else {
     if (LastLeftInlane && CurrentTime < (LastLeftInlane + COMBO_AVAILABLE_TIME)) {
       byte lampPhase = ((CurrentTime - LastLeftInlane) / 140) % 3;
@@ -1089,22 +1163,20 @@ void ShowSaucerLamps() {
 //
 ////////////////////////////////////////////////////////////////////////////
 unsigned long LastTimeScoreChanged = 0;
-unsigned long LastTimeOverrideAnimated = 0;
-unsigned long LastFlashOrDash = 0;
 #ifdef USE_SCORE_OVERRIDES
 unsigned long ScoreOverrideValue[4] = {0, 0, 0, 0};
 byte ScoreOverrideStatus = 0;
 #define DISPLAY_OVERRIDE_BLANK_SCORE 0xFFFFFFFF
 #endif
-byte LastScrollPhase = 0;
 
 byte MagnitudeOfScore(unsigned long score) {
-  if (score == 0) return 0;
-
+  // Compare against powers of ten instead of dividing down
   byte retval = 0;
-  while (score > 0) {
-    score = score / 10;
+  unsigned long placeValue = 1;
+  while (score >= placeValue) {
     retval += 1;
+    if (retval == 10) break;
+    placeValue *= 10;
   }
   return retval;
 }
@@ -1119,33 +1191,13 @@ void OverrideScoreDisplay(byte displayNum, unsigned long value, boolean animate)
 }
 #endif
 
-byte GetDisplayMask(byte numDigits) {
-  byte displayMask = 0;
-  for (byte digitCount = 0; digitCount < numDigits; digitCount++) {
-    displayMask |= (0x20 >> digitCount);
-  }
-  return displayMask;
-}
-
-
 void ShowPlayerScores(byte displayToUpdate, boolean flashCurrent, boolean dashCurrent, unsigned long allScoresShowValue = 0) {
 
 #ifdef USE_SCORE_OVERRIDES
   if (displayToUpdate == 0xFF) ScoreOverrideStatus = 0;
 #endif
 
-  byte displayMask = 0x3F;
   unsigned long displayScore = 0;
-  unsigned long overrideAnimationSeed = CurrentTime / 250;
-  byte scrollPhaseChanged = false;
-
-  byte scrollPhase = ((CurrentTime - LastTimeScoreChanged) / 250) % 16;
-  if (scrollPhase != LastScrollPhase) {
-    LastScrollPhase = scrollPhase;
-    scrollPhaseChanged = true;
-  }
-
-  boolean updateLastTimeAnimated = false;
 
   for (byte scoreCount = 0; scoreCount < 4; scoreCount++) {
 
@@ -1154,24 +1206,9 @@ void ShowPlayerScores(byte displayToUpdate, boolean flashCurrent, boolean dashCu
     if (allScoresShowValue == 0 && (ScoreOverrideStatus & (0x10 << scoreCount))) {
       displayScore = ScoreOverrideValue[scoreCount];
       if (displayScore != DISPLAY_OVERRIDE_BLANK_SCORE) {
-        byte numDigits = MagnitudeOfScore(displayScore);
-        if (numDigits == 0) numDigits = 1;
-        if (numDigits < (RPU_OS_NUM_DIGITS - 1) && (ScoreOverrideStatus & (0x01 << scoreCount))) {
+        if (ScoreOverrideStatus & (0x01 << scoreCount)) {
           // This score is going to be animated (back and forth)
-          if (overrideAnimationSeed != LastTimeOverrideAnimated) {
-            updateLastTimeAnimated = true;
-            byte shiftDigits = (overrideAnimationSeed) % (((RPU_OS_NUM_DIGITS + 1) - numDigits) + ((RPU_OS_NUM_DIGITS - 1) - numDigits));
-            if (shiftDigits >= ((RPU_OS_NUM_DIGITS + 1) - numDigits)) shiftDigits = (RPU_OS_NUM_DIGITS - numDigits) * 2 - shiftDigits;
-            byte digitCount;
-            displayMask = GetDisplayMask(numDigits);
-            for (digitCount = 0; digitCount < shiftDigits; digitCount++) {
-              displayScore *= 10;
-              displayMask = displayMask >> 1;
-            }
-            RPU_SetDisplayBlank(scoreCount, 0x00);
-            RPU_SetDisplay(scoreCount, displayScore, false);
-            RPU_SetDisplayBlank(scoreCount, displayMask);
-          }
+          RPU_StartDisplayEffect(scoreCount, RPU_DISPLAY_EFFECT_BOUNCE, displayScore, 0, 250);
         } else {
           RPU_SetDisplay(scoreCount, displayScore, true, 1);
         }
@@ -1196,76 +1233,14 @@ void ShowPlayerScores(byte displayToUpdate, boolean flashCurrent, boolean dashCu
         }
 
         if (displayScore > RPU_OS_MAX_DISPLAY_SCORE) {
-          // Score needs to be scrolled
-          if ((CurrentTime - LastTimeScoreChanged) < 4000) {
-            RPU_SetDisplay(scoreCount, displayScore % (RPU_OS_MAX_DISPLAY_SCORE + 1), false);
-            RPU_SetDisplayBlank(scoreCount, RPU_OS_ALL_DIGITS_MASK);
-          } else {
-
-            // Scores are scrolled 10 digits and then we wait for 6
-            if (scrollPhase < 11 && scrollPhaseChanged) {
-              byte numDigits = MagnitudeOfScore(displayScore);
-
-              // Figure out top part of score
-              unsigned long tempScore = displayScore;
-              if (scrollPhase < RPU_OS_NUM_DIGITS) {
-                displayMask = RPU_OS_ALL_DIGITS_MASK;
-                for (byte scrollCount = 0; scrollCount < scrollPhase; scrollCount++) {
-                  displayScore = (displayScore % (RPU_OS_MAX_DISPLAY_SCORE + 1)) * 10;
-                  displayMask = displayMask >> 1;
-                }
-              } else {
-                displayScore = 0;
-                displayMask = 0x00;
-              }
-
-              // Add in lower part of score
-              if ((numDigits + scrollPhase) > 10) {
-                byte numDigitsNeeded = (numDigits + scrollPhase) - 10;
-                for (byte scrollCount = 0; scrollCount < (numDigits - numDigitsNeeded); scrollCount++) {
-                  tempScore /= 10;
-                }
-                displayMask |= GetDisplayMask(MagnitudeOfScore(tempScore));
-                displayScore += tempScore;
-              }
-              RPU_SetDisplayBlank(scoreCount, displayMask);
-              RPU_SetDisplay(scoreCount, displayScore);
-            }
-          }
+          // Score needs to be scrolled (timeline restarts when the score changes)
+          RPU_StartDisplayEffect(scoreCount, RPU_DISPLAY_EFFECT_SCROLL, displayScore, LastTimeScoreChanged, 250);
+        } else if (flashCurrent) {
+          RPU_StartDisplayEffect(scoreCount, RPU_DISPLAY_EFFECT_FLASH, displayScore, 0, 250);
+        } else if (dashCurrent) {
+          RPU_StartDisplayEffect(scoreCount, RPU_DISPLAY_EFFECT_DASH, displayScore, 0, 60);
         } else {
-          if (flashCurrent) {
-            unsigned long flashSeed = CurrentTime / 250;
-            if (flashSeed != LastFlashOrDash) {
-              LastFlashOrDash = flashSeed;
-              if (((CurrentTime / 250) % 2) == 0) RPU_SetDisplayBlank(scoreCount, 0x00);
-              else RPU_SetDisplay(scoreCount, displayScore, true, 2);
-            }
-          } else if (dashCurrent) {
-            unsigned long dashSeed = CurrentTime / 50;
-            if (dashSeed != LastFlashOrDash) {
-              LastFlashOrDash = dashSeed;
-              byte dashPhase = (CurrentTime / 60) % 36;
-              byte numDigits = MagnitudeOfScore(displayScore);
-              if (dashPhase < 12) {
-                displayMask = GetDisplayMask((numDigits == 0) ? 2 : numDigits);
-                if (dashPhase < 7) {
-                  for (byte maskCount = 0; maskCount < dashPhase; maskCount++) {
-                    displayMask &= ~(0x01 << maskCount);
-                  }
-                } else {
-                  for (byte maskCount = 12; maskCount > dashPhase; maskCount--) {
-                    displayMask &= ~(0x20 >> (maskCount - dashPhase - 1));
-                  }
-                }
-                RPU_SetDisplay(scoreCount, displayScore);
-                RPU_SetDisplayBlank(scoreCount, displayMask);
-              } else {
-                RPU_SetDisplay(scoreCount, displayScore, true, 2);
-              }
-            }
-          } else {
-            RPU_SetDisplay(scoreCount, displayScore, true, 2);
-          }
+          RPU_SetDisplay(scoreCount, displayScore, true, 2);
         }
       } // End if this display should be updated
 #ifdef USE_SCORE_OVERRIDES
@@ -1273,27 +1248,10 @@ void ShowPlayerScores(byte displayToUpdate, boolean flashCurrent, boolean dashCu
 #endif
   } // End loop on scores
 
-  if (updateLastTimeAnimated) {
-    LastTimeOverrideAnimated = overrideAnimationSeed;
-  }
-
 }
 
 void ShowFlybyValue(byte numToShow, unsigned long timeBase) {
-  byte shiftDigits = (CurrentTime - timeBase) / 120;
-  byte rightSideBlank = 0;
-
-  unsigned long bigVersionOfNum = (unsigned long)numToShow;
-  for (byte count = 0; count < shiftDigits; count++) {
-    bigVersionOfNum *= 10;
-    rightSideBlank /= 2;
-    if (count > 2) rightSideBlank |= 0x20;
-  }
-  bigVersionOfNum /= 1000;
-
-  byte curMask = RPU_SetDisplay(CurrentPlayer, bigVersionOfNum, false, 0);
-  if (bigVersionOfNum == 0) curMask = 0;
-  RPU_SetDisplayBlank(CurrentPlayer, ~(~curMask | rightSideBlank));
+  RPU_StartDisplayEffect(CurrentPlayer, RPU_DISPLAY_EFFECT_FLYBY, numToShow, timeBase, 120, 0);
 }
 
 /*
@@ -1483,7 +1441,14 @@ int RunSelfTest(int curState, boolean curStateChanged) {
     //  reset while the WAV Trigger was already playing.
     StopAudio();
     RPU_TurnOffAllLamps();
+#ifdef RPU_ISR_PROFILER
+    // The profiler page has no callout, so the pages after it keep theirs
+    if (curState!=MACHINE_STATE_TEST_ISR_PROFILE) {
+      PlaySoundEffect(SOUND_EFFECT_SELF_TEST_MODE_START-((curState<MACHINE_STATE_TEST_ISR_PROFILE)?(curState+1):curState), 0, true);
+    }
+#else
     PlaySoundEffect(SOUND_EFFECT_SELF_TEST_MODE_START-curState, 0, true);
+#endif
     if (DEBUG_MESSAGES) {
       char buf[256];
       sprintf(buf, "State changed to %d\n", curState);
@@ -1789,12 +1754,13 @@ int ConvertVolumeSettingToGain(byte volumeSetting) {
   return VolumeToGainConversion[volumeSetting];
 }
 
-#define VOICE_NOTIFICATION_STACK_SIZE   10
+#define VOICE_NOTIFICATION_STACK_SIZE   16
 #define VOICE_NOTIFICATION_STACK_EMPTY  0xFFFF
-byte VoiceNotificationStackFirst = 0;
-byte VoiceNotificationStackLast = 0;
-unsigned int VoiceNotificationNumStack[VOICE_NOTIFICATION_STACK_SIZE];
-byte VoiceNotificationPriorityStack[VOICE_NOTIFICATION_STACK_SIZE];
+struct VoiceNotificationEntry {
+  unsigned int notificationNum;
+  byte priority;
+};
+RPU_Ring<VoiceNotificationEntry, VOICE_NOTIFICATION_STACK_SIZE> VoiceNotificationStack;
 unsigned int CurrentNotificationPlaying = 0;
 byte CurrentNotificationPriority = 0;
 
@@ -1807,8 +1773,7 @@ void StopAudio() {
   wTrig.stopAllTracks();
   CurrentBackgroundSong = SOUND_EFFECT_NONE;
 #endif
-  VoiceNotificationStackFirst = 0;
-  VoiceNotificationStackLast = 0;
+  VoiceNotificationStack.Clear();
 
 }
 
@@ -2215,53 +2180,35 @@ void UpdateSoundQueue() {
 
 
 
-int SpaceLeftOnNotificationStack() {
-  if (VoiceNotificationStackFirst >= VOICE_NOTIFICATION_STACK_SIZE || VoiceNotificationStackLast >= VOICE_NOTIFICATION_STACK_SIZE) return 0;
-  if (VoiceNotificationStackLast >= VoiceNotificationStackFirst) return ((VOICE_NOTIFICATION_STACK_SIZE - 1) - (VoiceNotificationStackLast - VoiceNotificationStackFirst));
-  return (VoiceNotificationStackFirst - VoiceNotificationStackLast) - 1;
-}
-
-
 void PushToNotificationStack(unsigned int notification, byte priority) {
-  // If the switch stack last index is out of range, then it's an error - return
-  if (SpaceLeftOnNotificationStack() == 0) return;
+  VoiceNotificationEntry *newEntry = VoiceNotificationStack.Reserve();
+  // If the stack is full, drop it
+  if (newEntry == NULL) return;
 
-  VoiceNotificationNumStack[VoiceNotificationStackLast] = notification;
-  VoiceNotificationPriorityStack[VoiceNotificationStackLast] = priority;
-
-  VoiceNotificationStackLast += 1;
-  if (VoiceNotificationStackLast == VOICE_NOTIFICATION_STACK_SIZE) {
-    // If the end index is off the end, then wrap
-    VoiceNotificationStackLast = 0;
-  }
+  newEntry->notificationNum = notification;
+  newEntry->priority = priority;
+  VoiceNotificationStack.Publish();
 }
 
 
 unsigned int PullFirstFromVoiceNotificationStack(byte *priority) {
-  // If first and last are equal, there's nothing on the stack
-  if (VoiceNotificationStackFirst == VoiceNotificationStackLast) return VOICE_NOTIFICATION_STACK_EMPTY;
+  VoiceNotificationEntry *firstEntry = VoiceNotificationStack.Front();
+  if (firstEntry == NULL) return VOICE_NOTIFICATION_STACK_EMPTY;
 
-  unsigned int retVal = VoiceNotificationNumStack[VoiceNotificationStackFirst];
-  *priority = VoiceNotificationPriorityStack[VoiceNotificationStackFirst];
-
-  VoiceNotificationStackFirst += 1;
-  if (VoiceNotificationStackFirst >= VOICE_NOTIFICATION_STACK_SIZE) VoiceNotificationStackFirst = 0;
+  unsigned int retVal = firstEntry->notificationNum;
+  *priority = firstEntry->priority;
+  VoiceNotificationStack.Release();
 
   return retVal;
 }
 
 
 byte GetTopNotificationPriority() {
-  byte startStack = VoiceNotificationStackFirst;
-  byte endStack = VoiceNotificationStackLast;
-  if (startStack==endStack) return 0;
-
   byte topPriorityFound = 0;
 
-  while (startStack!=endStack) {
-    if (VoiceNotificationPriorityStack[startStack]>topPriorityFound) topPriorityFound = VoiceNotificationPriorityStack[startStack];
-    startStack += 1;
-    if (startStack >= VOICE_NOTIFICATION_STACK_SIZE) startStack = 0;
+  VoiceNotificationEntry *stackEntry;
+  for (byte stackPosition = 0; (stackEntry = VoiceNotificationStack.Peek(stackPosition)) != NULL; stackPosition++) {
+    if (stackEntry->priority > topPriorityFound) topPriorityFound = stackEntry->priority;
   }
 
   return topPriorityFound;
@@ -2269,8 +2216,7 @@ byte GetTopNotificationPriority() {
 
 
 void ClearNotificationStack() {
-  VoiceNotificationStackFirst = 0;
-  VoiceNotificationStackLast = 0;
+  VoiceNotificationStack.Clear();
 }
 
 
@@ -2438,13 +2384,13 @@ int RunAttractMode(int curState, boolean curStateChanged) {
   }
 
   if (attractPlayfieldPhase < 2) {
-    ShowLampAnimation(1, 40, CurrentTime, 14, false, false);
+    ShowLampAnimation(1, 40, CurrentTime, 14, false);
   } else if (attractPlayfieldPhase == 3) {
-    ShowLampAnimation(0, 40, CurrentTime, 11, false, false);
+    ShowLampAnimation(0, 40, CurrentTime, 11, false);
   } else if (attractPlayfieldPhase == 2) {
-    ShowLampAnimation(1, 40, CurrentTime, 3, false, true);
+    ShowLampAnimation(1, 40, CurrentTime, 3, true);
   } else {
-    ShowLampAnimation(2, 40, CurrentTime, 14, false, false);
+    ShowLampAnimation(2, 40, CurrentTime, 14, false);
   }
 
   byte switchHit;
@@ -2637,6 +2583,8 @@ int InitNewBall(bool curStateChanged, byte playerNum, int ballNum) {
 
     BallSaveUsed = false;
     BallTimeInTrough = 0;
+    OutholeClosedTime = 0;
+    SaucerClosedTime = 0;
     NumTiltWarnings = 0;
     LastTiltWarningTime = 0;
 
@@ -2770,6 +2718,12 @@ unsigned short CurrentBattleLetterPosition = 0xFF;
 int ManageGameMode() {
   int returnState = MACHINE_STATE_NORMAL_GAMEPLAY;
 
+  // The debounced switch state says whether the ball is there - the
+  // events only say when it got there, so a lost one can't leave a
+  // stale time behind
+  if (!RPU_ReadSingleSwitchState(SW_OUTHOLE)) OutholeClosedTime = 0;
+  if (!RPU_ReadSingleSwitchState(SW_SAUCER)) SaucerClosedTime = 0;
+
   if (ResetLeftDropTargetStatusTime != 0 && CurrentTime > ResetLeftDropTargetStatusTime) {
     LeftDropTargetStatus = 0;
     ResetLeftDropTargetStatusTime = 0;
@@ -2943,7 +2897,7 @@ int ManageGameMode() {
           } else {
             if (IdleMode != IDLE_MODE_ADVERTISE_NZS) QueueNotification(SOUND_EFFECT_VP_ADVERTISE_NZS, 1);
             IdleMode = IDLE_MODE_ADVERTISE_NZS;
-            ShowLampAnimation(0, 40, CurrentTime, 11, false, false);
+            ShowLampAnimation(0, 40, CurrentTime, 11, false);
             specialAnimationRunning = true;
           }
         } else if (TicksCountedTowardsStatus > 31000) {
@@ -2995,7 +2949,7 @@ int ManageGameMode() {
               }
             }
             IdleMode = IDLE_MODE_ANNOUNCE_GOALS;
-            ShowLampAnimation(2, 40, CurrentTime, 11, false, false);
+            ShowLampAnimation(2, 40, CurrentTime, 11, false);
             specialAnimationRunning = true;
           }
         }
@@ -3092,7 +3046,7 @@ int ManageGameMode() {
       }
 
       //      specialAnimationRunning = true;
-      //      ShowLampAnimation(0, 80, CurrentTime, 1, false, false);
+      //      ShowLampAnimation(0, 80, CurrentTime, 1, false);
 
       if (CurrentTime > GameModeEndTime) {
         SetGameMode(GAME_MODE_BATTLE);
@@ -3166,7 +3120,7 @@ int ManageGameMode() {
       }
 
       specialAnimationRunning = true;
-      ShowLampAnimation(1, 40, CurrentTime, 14, false, false);
+      ShowLampAnimation(1, 40, CurrentTime, 14, false);
 
       if (CurrentTime > GameModeEndTime) {
         StopBackgroundSong();
@@ -3186,7 +3140,7 @@ int ManageGameMode() {
       }
 
       specialAnimationRunning = true;
-      ShowLampAnimation(2, 50, CurrentTime, 2, false, true);
+      ShowLampAnimation(2, 50, CurrentTime, 2, true);
 
       if (CurrentTime > GameModeEndTime) {
         StopBackgroundSong();
@@ -3288,7 +3242,7 @@ int ManageGameMode() {
       }
 
       specialAnimationRunning = true;
-      ShowLampAnimation(1, 40, CurrentTime, 14, false, false);
+      ShowLampAnimation(1, 40, CurrentTime, 14, false);
 
       if (CurrentTime > GameModeEndTime) {
         PlayBackgroundSong(SOUND_EFFECT_BACKGROUND_SONG_1 + ((CurrentTime / 10) % NUM_BACKGROUND_SONGS));
@@ -3346,7 +3300,7 @@ int ManageGameMode() {
             Serial.write("Waiting for ball to return before starting wizard\n");
           }
         } else if (TimeInSaucer==0) {
-          TimeInSaucer = CurrentTime;
+          TimeInSaucer = BallArrivalTime(SaucerClosedTime);
           PlaySoundEffect(SOUND_EFFECT_WIZARD_START_SAUCER);
         }
       } else {
@@ -3363,7 +3317,7 @@ int ManageGameMode() {
       }
 
       specialAnimationRunning = true;
-      ShowLampAnimation(3, 30, CurrentTime, 2, false, true);
+      ShowLampAnimation(3, 30, CurrentTime, 2, true);
       ShowShootAgainLamps();
       ShowSaucerLamps();
       
@@ -3389,7 +3343,7 @@ int ManageGameMode() {
       specialAnimationRunning = true;
       RPU_SetLampState(LAMP_SHOOT_AGAIN, 1);
       RPU_SetLampState(LAMP_HEAD_SAME_PLAYER_SHOOTS_AGAIN, 1);
-      ShowLampAnimation((CurrentTime/300)%4, 30, CurrentTime, 2, false, true);
+      ShowLampAnimation((CurrentTime/300)%4, 30, CurrentTime, 2, true);
       //ShowShootAgainLamps();
       
       if (BallSaveUsed) {
@@ -3464,7 +3418,7 @@ int ManageGameMode() {
       
       if (CurrentTime<(GameModeEndTime-5000)) {
         specialAnimationRunning = true;
-        ShowLampAnimation(0, 40, CurrentTime, 14, false, false);
+        ShowLampAnimation(0, 40, CurrentTime, 14, false);
       }
 
       if (CurrentTime>GameModeEndTime) {
@@ -3491,7 +3445,7 @@ int ManageGameMode() {
 
       specialAnimationRunning = true;
       ShowShootAgainLamps();
-      ShowLampAnimation(1, 40, CurrentTime-GameModeStartTime, 14, false, false);
+      ShowLampAnimation(1, 40, CurrentTime-GameModeStartTime, 14, false);
 
       if (CurrentTime>GameModeEndTime) {
         RPU_PushToTimedSolenoidStack(SOL_SAUCER, 16, CurrentTime + 100, true);
@@ -3520,7 +3474,7 @@ int ManageGameMode() {
 
       specialAnimationRunning = true;
       ShowShootAgainLamps();
-      ShowLampAnimation(2, 40, CurrentTime-GameModeStartTime, 14, false, false);
+      ShowLampAnimation(2, 40, CurrentTime-GameModeStartTime, 14, false);
 
       if (CurrentTime>GameModeEndTime) {
         SetGameMode(GAME_MODE_WIZARD_END_BALL_COLLECT);
@@ -3545,7 +3499,7 @@ int ManageGameMode() {
 
       specialAnimationRunning = true;
       ShowShootAgainLamps();
-      ShowLampAnimation(2, 40, CurrentTime-GameModeStartTime, 2, false, true);
+      ShowLampAnimation(2, 40, CurrentTime-GameModeStartTime, 2, true);
 
       if (CurrentTime>GameModeEndTime) {
         SetGameMode(GAME_MODE_WIZARD_END_BALL_COLLECT);
@@ -3581,7 +3535,12 @@ int ManageGameMode() {
 
   }
 
+  LOOP_STAGE_BEGIN(lampStageStart);
   if ( !specialAnimationRunning && NumTiltWarnings <= MaxTiltWarnings ) {
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+    // Build the playfield lamps off-screen so they change all at once
+    RPU_BeginLampFrame();
+#endif
     ShowBonusLamps();
     ShowBonusXLamps();
     ShowShootAgainLamps();
@@ -3591,7 +3550,11 @@ int ManageGameMode() {
     ShowTopLaneLamps();
     ShowSaucerLamps();
     ShowSpinnerLamps();
+#if (RPU_MPU_ARCHITECTURE>=10) && (RPU_OS_HARDWARE_REV<200)
+    RPU_CommitLampFrame();
+#endif
   }
+  LOOP_STAGE_END(LOOP_STAGE_LAMPS, lampStageStart);
 
 
   // Three types of display modes are shown here:
@@ -3663,11 +3626,12 @@ int ManageGameMode() {
       }
     }
   }
+  LOOP_STAGE_END(LOOP_STAGE_DISPLAYS, lampStageStart);
 
   // Check to see if ball is in the outhole
   if (RPU_ReadSingleSwitchState(SW_OUTHOLE)) {
     if (BallTimeInTrough == 0) {
-      BallTimeInTrough = CurrentTime;
+      BallTimeInTrough = BallArrivalTime(OutholeClosedTime);
     } else {
       // Make sure the ball stays on the sensor for at least
       // 0.5 seconds to be sure that it's not bouncing
@@ -3878,17 +3842,29 @@ int ShowMatchSequence(boolean curStateChanged) {
   return MACHINE_STATE_MATCH_MODE;
 }
 
+void UpdateBallLocationSwitches(byte switchHit, byte eventType, unsigned long eventTime) {
+  unsigned long closedTime = (eventType == SWITCH_EVENT_CLOSED) ? eventTime : 0;
+  if (switchHit == SW_OUTHOLE) OutholeClosedTime = closedTime;
+  else if (switchHit == SW_SAUCER) SaucerClosedTime = closedTime;
+}
+
+// When the scan saw the ball arrive, or now if that event was lost
+unsigned long BallArrivalTime(unsigned long closedTime) {
+  if (closedTime == 0 || closedTime > CurrentTime) return CurrentTime;
+  return closedTime;
+}
+
 unsigned long ToplaneDebounce[4] = {0, 0, 0, 0};
 
-void HandleTopLaneHit(byte switchHit) {
+void HandleTopLaneHit(byte switchHit, unsigned long hitTime) {
 
   if (ToplaneDebounce[switchHit - SW_1_TOPLANE] != 0) {
     // if it has been less than a 1/4 second since the last hit, reject this one
-    if (CurrentTime < (ToplaneDebounce[switchHit - SW_1_TOPLANE] + 250)) return;
+    if (hitTime < (ToplaneDebounce[switchHit - SW_1_TOPLANE] + 250)) return;
   }
 
   byte laneMask = (1 << (switchHit - SW_1_TOPLANE));
-  ToplaneDebounce[switchHit - SW_1_TOPLANE] = CurrentTime;
+  ToplaneDebounce[switchHit - SW_1_TOPLANE] = hitTime;
 
   if ((GameMode & GAME_BASE_MODE) == GAME_MODE_SKILL_SHOT) {
     if ( (switchHit - SW_1_TOPLANE) == SkillShotLane ) {
@@ -4358,7 +4334,9 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
   } else if (curState == MACHINE_STATE_INIT_NEW_BALL) {
     returnState = InitNewBall(curStateChanged, CurrentPlayer, CurrentBallInPlay);
   } else if (curState == MACHINE_STATE_NORMAL_GAMEPLAY) {
+    LOOP_STAGE_BEGIN(gameModeStart);
     returnState = ManageGameMode();
+    LOOP_STAGE_END(LOOP_STAGE_GAME_MODE, gameModeStart);
   } else if (curState == MACHINE_STATE_COUNTDOWN_BONUS) {
     returnState = CountdownBonus(curStateChanged);
     ShowPlayerScores(0xFF, false, false);
@@ -4395,14 +4373,23 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
   }
 
   byte switchHit;
+  RPU_SwitchEvent switchEvent;
   unsigned long lastBallFirstSwitchHitTime = BallFirstSwitchHitTime;
+  LOOP_STAGE_BEGIN(switchStageStart);
 
   if (NumTiltWarnings <= MaxTiltWarnings) {
-    while ( (switchHit = RPU_PullFirstFromSwitchStack()) != SWITCH_STACK_EMPTY ) {
+    while ( (switchHit = RPU_PullFirstSwitchEvent(&switchEvent)) != SWITCH_STACK_EMPTY ) {
+      // Timing decisions use when the switch actually closed,
+      // not when this loop got around to it
+      unsigned long switchTime = switchEvent.eventTime;
+
+      UpdateBallLocationSwitches(switchHit, switchEvent.eventType, switchEvent.eventTime);
+      // Nothing is scored on a switch opening
+      if (switchEvent.eventType == SWITCH_EVENT_OPENED) continue;
 
       if (DEBUG_MESSAGES) {
         char buf[128];
-        sprintf(buf, "Switch Hit = %d\n", switchHit);
+        sprintf(buf, "Switch Hit = %d (col %d, row %d) at %lu\n", switchHit, switchEvent.column, switchEvent.row, switchTime);
         Serial.write(buf);
       }
 
@@ -4419,8 +4406,8 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
         case SW_ROLL_TILT:
         case SW_PLAYFIELD_TILT:
           // This should be debounced
-          if (IdleMode != IDLE_MODE_BALL_SEARCH && (CurrentTime - LastTiltWarningTime) > TILT_WARNING_DEBOUNCE_TIME) {
-            LastTiltWarningTime = CurrentTime;
+          if (IdleMode != IDLE_MODE_BALL_SEARCH && (switchTime - LastTiltWarningTime) > TILT_WARNING_DEBOUNCE_TIME) {
+            LastTiltWarningTime = switchTime;
             NumTiltWarnings += 1;
             if (NumTiltWarnings > MaxTiltWarnings) {
               RPU_DisableSolenoidStack();
@@ -4438,7 +4425,7 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
           SetLastSelfTestChangedTime(CurrentTime);
           break;
         case SW_RIGHT_BULLSEYE:
-          if (LastLeftInlane && CurrentTime < (LastLeftInlane + COMBO_AVAILABLE_TIME)) {
+          if (LastLeftInlane && switchTime < (LastLeftInlane + COMBO_AVAILABLE_TIME)) {
             AwardCombo(COMBO_LEFT_TO_BULLSEYE);
           }
           
@@ -4458,45 +4445,45 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             PlaySoundEffect(SOUND_EFFECT_BULLSEYE_UNLIT);
           }
           RotateWSLetters(true);
-          LastSwitchHitTime = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
           break;
         case SW_LEFT_DT_STANDUP:
           HandleNeutralZoneHit(NEUTRAL_ZONE_1, (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE);
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_LOWER_TOP_LEFT_SU:
           HandleNeutralZoneHit(NEUTRAL_ZONE_2, (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE);
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_UPPER_TOP_LEFT_SU:
           HandleNeutralZoneHit(NEUTRAL_ZONE_3, (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE);
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_MIDDLE_RIGHT_SU:
           HandleNeutralZoneHit(NEUTRAL_ZONE_4, (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE);
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_UPPER_DT_STANDUP:
           HandleNeutralZoneHit(NEUTRAL_ZONE_5, (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE);
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_TOP_RIGHT_SU:
           HandleNeutralZoneHit(NEUTRAL_ZONE_6, (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE);
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_CENTER_STANDUP:
           HandleNeutralZoneHit(NEUTRAL_ZONE_7, (GameMode & GAME_BASE_MODE) == GAME_MODE_BATTLE);
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_LEFT_DT_1:
         case SW_LEFT_DT_2:
         case SW_LEFT_DT_3:
         case SW_LEFT_DT_ALL:
           if (HandleLeftDropTargetHit(switchHit)) {
-            if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
+            if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
           }
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_CENTER_DT_1:
         case SW_CENTER_DT_2:
@@ -4504,70 +4491,70 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
         case SW_CENTER_DT_4:
         case SW_CENTER_DT_ALL:
           if (HandleCenterDropTargetHit(switchHit)) {
-            if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
+            if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
           }
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_UPPER_DT_1:
         case SW_UPPER_DT_2:
         case SW_UPPER_DT_3:
         case SW_UPPER_DT_ALL:
           if (HandleRightDropTargetHit(switchHit)) {
-            if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
+            if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
           }
-          LastSwitchHitTime = CurrentTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_W_ROLLOVER:
           AwardSWLetter(SW_LETTER_W_INDEX);
-          if (LastRightInlane && CurrentTime < (LastRightInlane + COMBO_AVAILABLE_TIME)) {
+          if (LastRightInlane && switchTime < (LastRightInlane + COMBO_AVAILABLE_TIME)) {
             AwardCombo(COMBO_RIGHT_TO_LEFT_ALLEY_PASS);
           }
-          LastLeftInlane = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          LastLeftInlane = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_A_ROLLOVER:
           AwardSWLetter(SW_LETTER_A2_INDEX);
-          LastLeftInlane = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          LastLeftInlane = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_R_ROLLOVER:
           AwardSWLetter(SW_LETTER_R2_INDEX);
-          LastRightInlane = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          LastRightInlane = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_S_ROLLOVER:
           AwardSWLetter(SW_LETTER_S2_INDEX);
-          if (LastLeftInlane && CurrentTime < (LastLeftInlane + COMBO_AVAILABLE_TIME)) {
+          if (LastLeftInlane && switchTime < (LastLeftInlane + COMBO_AVAILABLE_TIME)) {
             AwardCombo(COMBO_LEFT_TO_RIGHT_ALLEY_PASS);
           }
-          LastRightInlane = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          LastRightInlane = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_1_TOPLANE:
         case SW_2_TOPLANE:
         case SW_3_TOPLANE:
         case SW_4_TOPLANE:
           WizardBonus += 5000;
-          HandleTopLaneHit(switchHit);
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          HandleTopLaneHit(switchHit, switchTime);
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_LEFT_SLINGSHOT:
         case SW_RIGHT_SLINGSHOT:
-          if (CurrentTime < (BallSearchSolenoidFireTime[6] + 150)) break;
-          if (CurrentTime < (BallSearchSolenoidFireTime[7] + 150)) break;
+          if (switchTime < (BallSearchSolenoidFireTime[6] + 150)) break;
+          if (switchTime < (BallSearchSolenoidFireTime[7] + 150)) break;
           CurrentScores[CurrentPlayer] += PlayfieldMultiplier * 10;
           PlaySoundEffect(SOUND_EFFECT_SLING_SHOT);
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_TOP_CENTER_POP:
           WizardBonus += 100;        
-          if (CurrentTime < (BallSearchSolenoidFireTime[4] + 150)) break;
+          if (switchTime < (BallSearchSolenoidFireTime[4] + 150)) break;
           if (InvasionPosition & INVASION_POSITION_MIDDLE_POP) {
             InvasionPosition &= ~(INVASION_POSITION_MIDDLE_POP);
             CurrentScores[CurrentPlayer] += PlayfieldMultiplier * 1000;
@@ -4580,13 +4567,13 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             PlaySoundEffect(SOUND_EFFECT_BUMPER_HIT);
           }
           BasesVisited |= BASE_VISIT_TOP_CENTER_POP;
-          TopCenterPopLastHit = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          TopCenterPopLastHit = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_TOP_LEFT_POP:
           WizardBonus += 100;        
-          if (CurrentTime < (BallSearchSolenoidFireTime[2] + 150)) break;
+          if (switchTime < (BallSearchSolenoidFireTime[2] + 150)) break;
           if (InvasionPosition & INVASION_POSITION_TL_POP) {
             InvasionPosition &= ~(INVASION_POSITION_TL_POP);
             CurrentScores[CurrentPlayer] += PlayfieldMultiplier * 1000;
@@ -4599,13 +4586,13 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             PlaySoundEffect(SOUND_EFFECT_BUMPER_HIT);
           }
           BasesVisited |= BASE_VISIT_TOP_LEFT_POP;
-          TopLeftPopLastHit = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          TopLeftPopLastHit = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_TOP_RIGHT_POP:
           WizardBonus += 100;        
-          if (CurrentTime < (BallSearchSolenoidFireTime[3] + 150)) break;
+          if (switchTime < (BallSearchSolenoidFireTime[3] + 150)) break;
           if (InvasionPosition & INVASION_POSITION_TR_POP) {
             InvasionPosition &= ~(INVASION_POSITION_TR_POP);
             CurrentScores[CurrentPlayer] += PlayfieldMultiplier * 1000;
@@ -4618,13 +4605,13 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             PlaySoundEffect(SOUND_EFFECT_BUMPER_HIT);
           }
           BasesVisited |= BASE_VISIT_TOP_RIGHT_POP;
-          TopRightPopLastHit = CurrentTime;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          TopRightPopLastHit = switchTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_BOTTOM_LEFT_POP:
           WizardBonus += 100;        
-          if (CurrentTime < (BallSearchSolenoidFireTime[0] + 150)) break;
+          if (switchTime < (BallSearchSolenoidFireTime[0] + 150)) break;
           if (InvasionPosition & INVASION_POSITION_LOWER_POPS) {
             InvasionPosition &= ~(INVASION_POSITION_LOWER_POPS);
             CurrentScores[CurrentPlayer] += 1000;
@@ -4637,12 +4624,12 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             PlaySoundEffect(SOUND_EFFECT_LOWER_BUMPER_HIT);
           }
           BasesVisited |= BASE_VISIT_BOTTOM_LEFT_POP;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_BOTTOM_RIGHT_POP:
           WizardBonus += 100;        
-          if (CurrentTime < (BallSearchSolenoidFireTime[5] + 150)) break;
+          if (switchTime < (BallSearchSolenoidFireTime[5] + 150)) break;
           if (InvasionPosition & INVASION_POSITION_LOWER_POPS) {
             InvasionPosition &= ~(INVASION_POSITION_LOWER_POPS);
             CurrentScores[CurrentPlayer] += 1000;
@@ -4654,14 +4641,13 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             CurrentScores[CurrentPlayer] += PlayfieldMultiplier * 100;
             PlaySoundEffect(SOUND_EFFECT_LOWER_BUMPER_HIT);
           }
-          RPU_PushToSolenoidStack(SOL_BOTTOM_RIGHT_POP, 10);
           BasesVisited |= BASE_VISIT_BOTTOM_RIGHT_POP;
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_LEFT_SPINNER:
           WizardBonus += 2000;
-          if (LastRightInlane && CurrentTime < (LastRightInlane + COMBO_AVAILABLE_TIME)) {
+          if (LastRightInlane && switchTime < (LastRightInlane + COMBO_AVAILABLE_TIME)) {
             if (AwardCombo(COMBO_RIGHT_TO_LEFT_SPINNER)) {
               if (SpinnerAccelerators) {
                 if (TotalSpins[CurrentPlayer]>(SpinnerMaxGoal-14)) TotalSpins[CurrentPlayer] = SpinnerMaxGoal;
@@ -4691,13 +4677,13 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             }
             PlaySoundEffect(SOUND_EFFECT_LEFT_SPINNER);
           }
-          //if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
-          LastSpinnerHit = CurrentTime;          
+          //if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
+          LastSpinnerHit = switchTime;          
           break;
         case SW_RIGHT_SPINNER:
           WizardBonus += 2000;
-          if (LastLeftInlane && CurrentTime < (LastLeftInlane + COMBO_AVAILABLE_TIME)) {
+          if (LastLeftInlane && switchTime < (LastLeftInlane + COMBO_AVAILABLE_TIME)) {
             if (AwardCombo(COMBO_LEFT_TO_RIGHT_SPINNER)) {
               if (SpinnerAccelerators) {
                 if (TotalSpins[CurrentPlayer]>(SpinnerMaxGoal-19)) TotalSpins[CurrentPlayer] = SpinnerMaxGoal;
@@ -4724,12 +4710,12 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             CurrentScores[CurrentPlayer] += PlayfieldMultiplier * 100;
           }
           PlaySoundEffect(SOUND_EFFECT_RIGHT_SPINNER);
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
-          LastSpinnerHit = CurrentTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
+          LastSpinnerHit = switchTime;
           break;
         case SW_CAPTIVE_BALL:
-          if (LastRightInlane && CurrentTime < (LastRightInlane + COMBO_AVAILABLE_TIME)) {
+          if (LastRightInlane && switchTime < (LastRightInlane + COMBO_AVAILABLE_TIME)) {
             AwardCombo(COMBO_RIGHT_TO_CAPTIVE);
           }
           if ((GameMode & GAME_BASE_MODE) == GAME_MODE_WIZARD) {
@@ -4746,8 +4732,8 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             PlaySoundEffect(SOUND_EFFECT_CAPTIVE_BALL_UNLIT);
           }
           RotateWSLetters(false);
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_LEFT_SPECIAL:
         case SW_RIGHT_SPECIAL:
@@ -4764,11 +4750,11 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
           if (BallSaveEndTime!=0) {
             BallSaveEndTime += 3000;
           }
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_SAUCER:
-          if (CurrentTime > SaucerEjectTime) {
+          if (switchTime > SaucerEjectTime) {
             if ((GameMode & GAME_BASE_MODE) == GAME_MODE_SKILL_SHOT) {
               StartScoreAnimation(50000 * PlayfieldMultiplier);
               SetGameMode(GAME_MODE_BATTLE_START);
@@ -4800,8 +4786,8 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
             SaucerScoreAnimationStart = CurrentTime;
 
           }
-          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = CurrentTime;
-          LastSwitchHitTime = CurrentTime;
+          if (BallFirstSwitchHitTime == 0) BallFirstSwitchHitTime = switchTime;
+          LastSwitchHitTime = switchTime;
           break;
         case SW_COIN_1:
         case SW_COIN_2:
@@ -4832,7 +4818,9 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
     }
   } else {
     // We're tilted, so just wait for outhole
-    while ( (switchHit = RPU_PullFirstFromSwitchStack()) != SWITCH_STACK_EMPTY ) {
+    while ( (switchHit = RPU_PullFirstSwitchEvent(&switchEvent)) != SWITCH_STACK_EMPTY ) {
+      UpdateBallLocationSwitches(switchHit, switchEvent.eventType, switchEvent.eventTime);
+      if (switchEvent.eventType == SWITCH_EVENT_OPENED) continue;
       switch (switchHit) {
         case SW_SELF_TEST_SWITCH:
           returnState = MACHINE_STATE_TEST_BOOT;
@@ -4847,6 +4835,7 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
       }
     }
   }
+  LOOP_STAGE_END(LOOP_STAGE_SWITCHES, switchStageStart);
 
   if (lastBallFirstSwitchHitTime==0 && BallFirstSwitchHitTime!=0) {
     BallSaveEndTime = BallFirstSwitchHitTime + ((unsigned long)BallSaveNumSeconds)*1000;
@@ -4883,27 +4872,114 @@ int RunGamePlayMode(int curState, boolean curStateChanged) {
 
 unsigned long LastLEDUpdateTime = 0;
 byte LEDPhase = 0;
-unsigned long NumLoops = 0;
-unsigned long LastLoopReportTime = 0;
 //extern volatile byte LISYMessageError;
 
-void loop() {
+#ifdef LOOP_PROFILER
+unsigned long LoopProfileStartTime = 0;
+unsigned long NumLoops = 0;
+unsigned long WorstLoopForLEDs = 0;
+
+// The last period's numbers, written out a line per loop
+LoopStageProfile LoopReportStages[NUM_LOOP_STAGES];
+unsigned long LoopReportWorstByState[NUM_LOOP_PROFILE_STATES];
+unsigned long LoopReportRate = 0;
+byte LoopReportLine = 0xFF;
+const char *LoopStageNames[NUM_LOOP_STAGES] = {
+  "whole loop", "machine state", "switches", "game mode", "lamps",
+  "displays", "RPU_Update", "sound queue", "notifications", "board LEDs"
+};
+const char *LoopProfileStateNames[NUM_LOOP_PROFILE_STATES] = {
+  "self test", "attract", "init game", "init ball", "play", "bonus", "ball over", "match"
+};
 
-/*
-  if (0 && DEBUG_MESSAGES) {
-    NumLoops += 1;
-    if (CurrentTime>(LastLoopReportTime+1000)) {
-      LastLoopReportTime = CurrentTime;
-      char buf[128];
-      sprintf(buf, "Loop running at %lu Hz (msg errors=%d)\n", NumLoops, LISYMessageError);
-      Serial.write(buf);
-      NumLoops = 0;
+// Records the time since *stageStart and restarts it (for back-to-back stages)
+unsigned long EndLoopStage(byte stage, unsigned long *stageStart) {
+  unsigned long now = micros();
+  unsigned long elapsed = now - *stageStart;
+  LoopStages[stage].totalMicros += elapsed;
+  if (elapsed > LoopStages[stage].maxMicros) LoopStages[stage].maxMicros = elapsed;
+  LoopStages[stage].samples += 1;
+  *stageStart = now;
+  return elapsed;
+}
+
+byte LoopProfileState(int machineState) {
+  if (machineState < 0) return 0;
+  switch (machineState) {
+    case MACHINE_STATE_ATTRACT: return 1;
+    case MACHINE_STATE_INIT_GAMEPLAY: return 2;
+    case MACHINE_STATE_INIT_NEW_BALL: return 3;
+    case MACHINE_STATE_NORMAL_GAMEPLAY: return 4;
+    case MACHINE_STATE_COUNTDOWN_BONUS: return 5;
+    case MACHINE_STATE_BALL_OVER: return 6;
+  }
+  return 7;
+}
+
+void UpdateLoopProfile(int profiledState, unsigned long loopMicros) {
+  NumLoops += 1;
+  byte stateIndex = LoopProfileState(profiledState);
+  if (loopMicros > WorstLoopByState[stateIndex]) WorstLoopByState[stateIndex] = loopMicros;
+  if (loopMicros > WorstLoopForLEDs) WorstLoopForLEDs = loopMicros;
+
+  if (LoopProfileStartTime == 0) LoopProfileStartTime = CurrentTime;
+  if ((CurrentTime - LoopProfileStartTime) >= LOOP_PROFILE_REPORT_MS && LoopReportLine == 0xFF) {
+    // Take a copy to report and start the next period
+    LoopReportRate = (NumLoops * 1000) / (CurrentTime - LoopProfileStartTime);
+    for (byte count = 0; count < NUM_LOOP_STAGES; count++) {
+      LoopReportStages[count] = LoopStages[count];
+      LoopStages[count].totalMicros = 0;
+      LoopStages[count].maxMicros = 0;
+      LoopStages[count].samples = 0;
+    }
+    for (byte count = 0; count < NUM_LOOP_PROFILE_STATES; count++) {
+      LoopReportWorstByState[count] = WorstLoopByState[count];
+      WorstLoopByState[count] = 0;
+    }
+    NumLoops = 0;
+    LoopProfileStartTime = CurrentTime;
+    LoopReportLine = 0;
+  }
+
+  if (LoopReportLine == 0xFF) return;
+
+  // One line a loop, and only if it fits in the serial
+  // buffer, so reporting never holds up the loop
+  char buf[64];
+  if (LoopReportLine == 0) {
+    sprintf(buf, "Loop at %lu Hz\n", LoopReportRate);
+  } else if (LoopReportLine <= NUM_LOOP_STAGES) {
+    LoopStageProfile *stage = &LoopReportStages[LoopReportLine - 1];
+    if (stage->samples == 0) {
+      LoopReportLine += 1;
+      return;
+    }
+    sprintf(buf, "  %-14s avg %6lu max %6lu us\n", LoopStageNames[LoopReportLine - 1], stage->totalMicros / stage->samples, stage->maxMicros);
+  } else {
+    byte stateIndex = LoopReportLine - (NUM_LOOP_STAGES + 1);
+    if (LoopReportWorstByState[stateIndex] == 0) {
+      buf[0] = 0;
+    } else {
+      sprintf(buf, "  worst in %-10s %6lu us\n", LoopProfileStateNames[stateIndex], LoopReportWorstByState[stateIndex]);
     }
   }
-*/
-  
+  if (buf[0] && Serial.availableForWrite() < (int)strlen(buf)) return;
+  if (buf[0]) Serial.write(buf);
+
+  LoopReportLine += 1;
+  if (LoopReportLine > (NUM_LOOP_STAGES + NUM_LOOP_PROFILE_STATES)) LoopReportLine = 0xFF;
+}
+#endif
+
+void loop() {
+
   CurrentTime = millis();
   int newMachineState = MachineState;
+  LOOP_STAGE_BEGIN(loopStart);
+  LOOP_STAGE_BEGIN(stageStart);
+#ifdef LOOP_PROFILER
+  int profiledState = MachineState;
+#endif
 
   if (MachineState < 0) {
     newMachineState = RunSelfTest(MachineState, MachineStateChanged);
@@ -4920,13 +4996,32 @@ void loop() {
     MachineStateChanged = false;
   }
 
+  if (!LampAnimationShown) RPU_StopLampAnimation();
+  LampAnimationShown = false;
+  ShowIdleModeLampLayer();
+  LOOP_STAGE_END(LOOP_STAGE_MACHINE_STATE, stageStart);
+
   RPU_Update(CurrentTime);
+  LOOP_STAGE_END(LOOP_STAGE_RPU_UPDATE, stageStart);
   UpdateSoundQueue();
+  LOOP_STAGE_END(LOOP_STAGE_SOUND_QUEUE, stageStart);
   ServiceNotificationQueue();
+  LOOP_STAGE_END(LOOP_STAGE_NOTIFICATIONS, stageStart);
 
   if (LastLEDUpdateTime == 0 || (CurrentTime - LastLEDUpdateTime) > 250) {
     LastLEDUpdateTime = CurrentTime;
+#ifdef LOOP_PROFILER
+    // Load meter - the worst loop since the last update, in ms
+    RPU_SetBoardLEDs(false, false, (WorstLoopForLEDs < 9000) ? (WorstLoopForLEDs / 1000) : 9);
+    WorstLoopForLEDs = 0;
+#else
     RPU_SetBoardLEDs((LEDPhase % 8) == 1 || (LEDPhase % 8) == 3, (LEDPhase % 8) == 5 || (LEDPhase % 8) == 7);
+#endif
     LEDPhase += 1;
   }
+  LOOP_STAGE_END(LOOP_STAGE_BOARD_LEDS, stageStart);
+
+#ifdef LOOP_PROFILER
+  UpdateLoopProfile(profiledState, LOOP_STAGE_END(LOOP_STAGE_WHOLE_LOOP, loopStart));
+#endif
 }
@@ -0,0 +1,146 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - checks the packed BCD score helpers against binary
+// arithmetic.
+//
+//   spacebattle_bcd_test [--cases N] [--seed N]
+//
+// Runs the edge cases (saturation at 99,999,999 and long carry chains)
+// and then --cases random cases (2,000,000 by default) of each of
+// RPU_BCDAdd, RPU_BCDMultiply, RPU_BCDFromBinary, RPU_BCDToBinary and
+// RPU_BCDMagnitude. Half of the random scores are made mostly of 9s so
+// the carries run through several digits. The same seed always gives
+// the same cases. Exits with 1 if any case is wrong.
+
+#include "HostArduino.h"
+#include "RPU_Config.h"
+#include "RPU.h"
+
+#define BCD_TEST_MAX_SCORE        99999999UL
+#define BCD_TEST_MAX_REPORTED     10
+
+const unsigned long DecimalPlaces[RPU_BCD_SCORE_DIGITS] = {1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL};
+
+static unsigned long long RandomState = 1;
+static unsigned long NumFailures = 0;
+
+// xorshift64 - the same sequence on every computer
+static unsigned long NextRandom() {
+  RandomState ^= RandomState << 13;
+  RandomState ^= RandomState >> 7;
+  RandomState ^= RandomState << 17;
+  return (unsigned long)(RandomState >> 16);
+}
+
+static unsigned long RandomScore() {
+  if (NextRandom() & 0x01) return NextRandom() % (BCD_TEST_MAX_SCORE + 1);
+
+  unsigned long score = 0;
+  byte numDigits = 1 + NextRandom() % RPU_BCD_SCORE_DIGITS;
+  for (byte digitCount = 0; digitCount < numDigits; digitCount++) {
+    unsigned long digit = (NextRandom() % 4) ? 9 : (NextRandom() % 10);
+    score = score * 10 + digit;
+  }
+  return score;
+}
+
+static unsigned long Saturate(unsigned long long value) {
+  return (value > BCD_TEST_MAX_SCORE) ? BCD_TEST_MAX_SCORE : (unsigned long)value;
+}
+
+static byte DecimalMagnitude(unsigned long value) {
+  byte magnitude = 0;
+  for (; value; value /= 10) magnitude += 1;
+  return magnitude;
+}
+
+static void Check(boolean passed, const char *operation, unsigned long value1, unsigned long value2, unsigned long result, unsigned long expected) {
+  if (passed) return;
+  NumFailures += 1;
+  if (NumFailures <= BCD_TEST_MAX_REPORTED) {
+    fprintf(stderr, "%s(%lu, %lu) gave %lu, expected %lu\n", operation, value1, value2, result, expected);
+  }
+}
+
+static void CheckAdd(unsigned long value1, unsigned long value2) {
+  unsigned long result = RPU_BCDToBinary(RPU_BCDAdd(RPU_BCDFromBinary(value1), RPU_BCDFromBinary(value2)));
+  unsigned long expected = Saturate((unsigned long long)value1 + value2);
+  Check(result == expected, "RPU_BCDAdd", value1, value2, result, expected);
+}
+
+static void CheckMultiply(unsigned long value, byte multiplier) {
+  unsigned long result = RPU_BCDToBinary(RPU_BCDMultiply(RPU_BCDFromBinary(value), multiplier));
+  unsigned long expected = Saturate((unsigned long long)value * multiplier);
+  Check(result == expected, "RPU_BCDMultiply", value, multiplier, result, expected);
+}
+
+// Builds the packed digits by hand, so FromBinary and ToBinary are
+// each checked against something other than the other one
+static void CheckConversions(unsigned long value) {
+  unsigned long saturated = Saturate(value);
+  RPU_BCDScore expectedBCD = 0;
+  for (byte digitCount = 0; digitCount < RPU_BCD_SCORE_DIGITS; digitCount++) {
+    expectedBCD |= (RPU_BCDScore)((saturated / DecimalPlaces[digitCount]) % 10) << (4 * digitCount);
+  }
+
+  RPU_BCDScore bcdValue = RPU_BCDFromBinary(value);
+  Check(bcdValue == expectedBCD, "RPU_BCDFromBinary", value, 0, bcdValue, expectedBCD);
+  unsigned long binaryValue = RPU_BCDToBinary(expectedBCD);
+  Check(binaryValue == saturated, "RPU_BCDToBinary", expectedBCD, 0, binaryValue, saturated);
+  byte magnitude = RPU_BCDMagnitude(expectedBCD);
+  Check(magnitude == DecimalMagnitude(saturated), "RPU_BCDMagnitude", expectedBCD, 0, magnitude, DecimalMagnitude(saturated));
+}
+
+int main(int argc, char **argv) {
+  unsigned long numCases = 2000000;
+  unsigned long seed = 1;
+
+  for (int argCount = 1; argCount < argc; argCount++) {
+    if (!strcmp(argv[argCount], "--cases") && (argCount + 1) < argc) {
+      numCases = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--seed") && (argCount + 1) < argc) {
+      seed = strtoul(argv[++argCount], NULL, 10);
+    } else {
+      fprintf(stderr, "usage: spacebattle_bcd_test [--cases N] [--seed N]\n");
+      return 1;
+    }
+  }
+  RandomState = seed ? seed : 1;
+
+  // Saturation, and carries through every digit
+  const unsigned long edgeScores[] = {0, 1, 9, 10, 99, 999999, 9999999, 10000000, 50000000, 99999998, 99999999, 100000000, 0xFFFFFFFFUL};
+  const byte numEdgeScores = sizeof(edgeScores) / sizeof(edgeScores[0]);
+  for (byte scoreCount1 = 0; scoreCount1 < numEdgeScores; scoreCount1++) {
+    CheckConversions(edgeScores[scoreCount1]);
+    unsigned long value1 = Saturate(edgeScores[scoreCount1]);
+    for (byte scoreCount2 = 0; scoreCount2 < numEdgeScores; scoreCount2++) CheckAdd(value1, Saturate(edgeScores[scoreCount2]));
+    for (unsigned short multiplier = 0; multiplier < 256; multiplier++) CheckMultiply(value1, (byte)multiplier);
+  }
+
+  for (unsigned long caseCount = 0; caseCount < numCases; caseCount++) {
+    CheckAdd(RandomScore(), RandomScore());
+    CheckMultiply(RandomScore(), (byte)NextRandom());
+    CheckConversions((NextRandom() & 0x01) ? RandomScore() : (NextRandom() << 8) & 0xFFFFFFFFUL);
+  }
+
+  if (NumFailures) {
+    fprintf(stderr, "%lu BCD cases failed\n", NumFailures);
+    return 1;
+  }
+  printf("%lu random BCD cases of each operation passed (seed %lu)\n", numCases, seed);
+  return 0;
+}
@@ -0,0 +1,240 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - times ManageGameMode in every game mode, on its own and
+// with a score animation, the pop frenzy or the spinner frenzy running.
+//
+//   spacebattle_gamemode_bench [--calls N] [--window-ms N]
+//
+// A game is started through loop() (coin, start, ball served). Each
+// mode is then entered (through the mode that leads into it, if it
+// needs that set up) and ManageGameMode is called --calls times, the
+// clock moving 1 ms a call and going back to the start of the window
+// every --window-ms so timed modes don't run out. A call that moves
+// to another mode is counted as a leak and the mode is put back.
+// Times are on this computer, so compare runs on the same one (the
+// median and 99th percentile are steadier than the average).
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "HostArduino.h"
+#include "HostMPU.h"
+#include "RPU_Config.h"
+#include "RPU.h"
+#include "SpaceBattle2022.h"
+
+void setup();
+void loop();
+int ManageGameMode();
+void SetGameMode(byte newGameMode);
+void StartScoreAnimation(unsigned long scoreToAnimate);
+
+// From SpaceBattle2022.ino
+extern char MachineState;
+extern byte GameMode;
+extern unsigned long CurrentTime;
+extern unsigned long UpperPopFrenzyFinish;
+extern unsigned long SpinnerFrenzyEndTime;
+extern unsigned long ScoreAdditionAnimation;
+
+#define BENCH_NO_LEAD_IN              0xFF
+// Longest a lead-in mode gets to hand over
+#define BENCH_LEAD_IN_MS              60000
+
+struct BenchGameMode {
+  byte gameMode;
+  byte leadInMode;
+  const char *name;
+};
+
+// The modes come from SpaceBattle2022.h, named without GAME_MODE_
+#define BENCH_GAME_MODE(mode, leadInMode)   {GAME_MODE_##mode, leadInMode, #mode}
+
+static const BenchGameMode BenchGameModes[] = {
+  BENCH_GAME_MODE(SKILL_SHOT, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(UNSTRUCTURED_PLAY, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(BATTLE_START, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(BATTLE, GAME_MODE_BATTLE_START),
+  BENCH_GAME_MODE(BATTLE_ADD_ENEMY, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(BATTLE_WON, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(BATTLE_LOST, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(INVASION_START, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(INVASION, GAME_MODE_INVASION_START),
+  BENCH_GAME_MODE(INVASION_WON, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(INVASION_LOST, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(WIZARD_START, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(WIZARD_WAIT_FOR_BALL, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(WIZARD, GAME_MODE_WIZARD_START),
+  BENCH_GAME_MODE(WIZARD_FINISHED_100, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(WIZARD_FINISHED_50, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(WIZARD_FINISHED_10, BENCH_NO_LEAD_IN),
+  BENCH_GAME_MODE(WIZARD_END_BALL_COLLECT, BENCH_NO_LEAD_IN)
+};
+#define NUM_BENCH_GAME_MODES  (sizeof(BenchGameModes) / sizeof(BenchGameModes[0]))
+
+#define BENCH_VARIANT_PLAIN           0
+#define BENCH_VARIANT_SCORE_ANIMATION 1
+#define BENCH_VARIANT_POP_FRENZY      2
+#define BENCH_VARIANT_SPINNER_FRENZY  3
+#define NUM_BENCH_VARIANTS            4
+static const char *BenchVariantNames[NUM_BENCH_VARIANTS] = {"-", "score anim", "pop frenzy", "spinner frenzy"};
+
+struct BenchResult {
+  std::vector<unsigned long long> callNanoseconds;
+  unsigned long long totalNanoseconds;
+  unsigned long leaks;
+};
+
+static unsigned long long Percentile(std::vector<unsigned long long> *samples, unsigned long percent) {
+  size_t position = (samples->size() - 1) * percent / 100;
+  std::nth_element(samples->begin(), samples->begin() + position, samples->end());
+  return (*samples)[position];
+}
+
+static void ShowUsage() {
+  fprintf(stderr, "usage: spacebattle_gamemode_bench [--calls N] [--window-ms N]\n");
+}
+
+static void RunLoopFor(unsigned long milliseconds) {
+  unsigned long long endCycle = HostCycles() + (unsigned long long)milliseconds * 1000ULL * HOST_CYCLES_PER_MICROSECOND;
+  while (HostCycles() < endCycle) {
+    loop();
+    HostAdvanceCycles(1600);
+  }
+  Serial.HostTakeOutput();
+}
+
+// Coin up, start and serve a ball
+static boolean StartGame() {
+  HostMPU_SetSwitch(SW_OUTHOLE, true);
+  RunLoopFor(3000);
+  RPU_PushToSwitchStack(SW_COIN_1);
+  RunLoopFor(500);
+  RPU_PushToSwitchStack(SW_CREDIT_RESET);
+  RunLoopFor(1000);
+  HostMPU_SetSwitch(SW_OUTHOLE, false);
+  for (byte tries = 0; tries < 20 && MachineState != MACHINE_STATE_NORMAL_GAMEPLAY; tries++) RunLoopFor(500);
+  return (MachineState == MACHINE_STATE_NORMAL_GAMEPLAY) ? true : false;
+}
+
+static void StartVariant(byte variant, unsigned long windowStart, unsigned long windowMS) {
+  UpperPopFrenzyFinish = 0;
+  SpinnerFrenzyEndTime = 0;
+  CurrentTime = windowStart;
+  switch (variant) {
+    case BENCH_VARIANT_SCORE_ANIMATION:
+      ScoreAdditionAnimation = 0;
+      StartScoreAnimation(50000);
+      break;
+    case BENCH_VARIANT_POP_FRENZY:
+      UpperPopFrenzyFinish = windowStart + windowMS + 1000;
+      break;
+    case BENCH_VARIANT_SPINNER_FRENZY:
+      SpinnerFrenzyEndTime = windowStart + windowMS + 1000;
+      break;
+  }
+}
+
+// Lets the lead-in mode run until it moves on to gameMode
+static void EnterGameMode(const BenchGameMode *benchMode) {
+  if (benchMode->leadInMode != BENCH_NO_LEAD_IN) {
+    SetGameMode(benchMode->leadInMode);
+    for (unsigned long leadInCount = 0; leadInCount < BENCH_LEAD_IN_MS; leadInCount++) {
+      CurrentTime += 1;
+      ManageGameMode();
+      if ((GameMode & GAME_BASE_MODE) == benchMode->gameMode) return;
+    }
+  }
+  SetGameMode(benchMode->gameMode);
+}
+
+static void BenchGameMode(const BenchGameMode *benchMode, byte variant, unsigned long numCalls, unsigned long windowMS, BenchResult *result) {
+  byte gameMode = benchMode->gameMode;
+  result->callNanoseconds.clear();
+  result->callNanoseconds.reserve(numCalls);
+  result->totalNanoseconds = 0;
+  result->leaks = 0;
+  UpperPopFrenzyFinish = 0;
+  SpinnerFrenzyEndTime = 0;
+  EnterGameMode(benchMode);
+  unsigned long windowStart = CurrentTime + 1;
+  StartVariant(variant, windowStart, windowMS);
+
+  for (unsigned long callCount = 0; callCount < numCalls; callCount++) {
+    if (callCount && (callCount % windowMS) == 0) StartVariant(variant, windowStart, windowMS);
+    CurrentTime = windowStart + (callCount % windowMS);
+
+    std::chrono::steady_clock::time_point callStart = std::chrono::steady_clock::now();
+    ManageGameMode();
+    unsigned long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - callStart).count();
+    result->totalNanoseconds += elapsed;
+    result->callNanoseconds.push_back(elapsed);
+
+    if ((GameMode & GAME_BASE_MODE) != gameMode) {
+      result->leaks += 1;
+      GameMode = gameMode | (GameMode & ~GAME_BASE_MODE);
+    }
+    if ((callCount % 1024) == 0) {
+      Serial.HostTakeOutput();
+      Serial1.HostTakeOutput();
+    }
+  }
+  CurrentTime = windowStart + windowMS;
+}
+
+int main(int argc, char **argv) {
+  unsigned long numCalls = 20000;
+  unsigned long windowMS = 2000;
+
+  for (int argCount = 1; argCount < argc; argCount++) {
+    if (!strcmp(argv[argCount], "--calls") && (argCount + 1) < argc) {
+      numCalls = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--window-ms") && (argCount + 1) < argc) {
+      windowMS = strtoul(argv[++argCount], NULL, 10);
+    } else {
+      ShowUsage();
+      return 1;
+    }
+  }
+  if (numCalls == 0 || windowMS == 0) {
+    ShowUsage();
+    return 1;
+  }
+
+  HostReset();
+  setup();
+  if (!StartGame()) {
+    fprintf(stderr, "couldn't get a game started (machine state %d)\n", MachineState);
+    return 1;
+  }
+  // Nothing but ManageGameMode runs from here on
+  HostSetTimerInterruptMode(HOST_TIMER_MANUAL);
+
+  printf("ManageGameMode, %lu calls per row, %lu ms window\n\n", numCalls, windowMS);
+  printf("%-24s %-15s %9s %9s %9s %7s\n", "mode", "running", "avg ns", "median", "99%", "leaks");
+  BenchResult result;
+  for (byte modeCount = 0; modeCount < NUM_BENCH_GAME_MODES; modeCount++) {
+    for (byte variant = 0; variant < NUM_BENCH_VARIANTS; variant++) {
+      BenchGameMode(&BenchGameModes[modeCount], variant, numCalls, windowMS, &result);
+      printf("%-24s %-15s %9.1f %9llu %9llu %7lu\n", BenchGameModes[modeCount].name, BenchVariantNames[variant],
+             (double)result.totalNanoseconds / numCalls, Percentile(&result.callNanoseconds, 50),
+             Percentile(&result.callNanoseconds, 99), result.leaks);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,353 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+#include <chrono>
+#include "HostArduino.h"
+#include "HostMPU.h"
+
+HardwareSerial Serial;
+HardwareSerial Serial1;
+HardwareSerial Serial2;
+HardwareSerial Serial3;
+EEPROMClass EEPROM;
+
+HostRegister<uint8_t> PORTA(HOST_REG_PORTA), PORTB(HOST_REG_PORTB), PORTC(HOST_REG_PORTC), PORTD(HOST_REG_PORTD);
+HostRegister<uint8_t> PORTE(HOST_REG_PORTE), PORTF(HOST_REG_PORTF), PORTG(HOST_REG_PORTG), PORTH(HOST_REG_PORTH);
+HostRegister<uint8_t> PORTJ(HOST_REG_PORTJ), PORTK(HOST_REG_PORTK), PORTL(HOST_REG_PORTL);
+HostRegister<uint8_t> DDRA(HOST_REG_DDRA), DDRB(HOST_REG_DDRB), DDRC(HOST_REG_DDRC), DDRD(HOST_REG_DDRD);
+HostRegister<uint8_t> DDRE(HOST_REG_DDRE), DDRF(HOST_REG_DDRF), DDRG(HOST_REG_DDRG), DDRH(HOST_REG_DDRH);
+HostRegister<uint8_t> DDRJ(HOST_REG_DDRJ), DDRK(HOST_REG_DDRK), DDRL(HOST_REG_DDRL);
+HostRegister<uint8_t> PINA(HOST_REG_PINA), PINB(HOST_REG_PINB), PINC(HOST_REG_PINC), PIND(HOST_REG_PIND);
+HostRegister<uint8_t> PINE(HOST_REG_PINE), PINF(HOST_REG_PINF), PING(HOST_REG_PING), PINH(HOST_REG_PINH);
+HostRegister<uint8_t> PINJ(HOST_REG_PINJ), PINK(HOST_REG_PINK), PINL(HOST_REG_PINL);
+HostRegister<uint8_t> TCCR1A(HOST_REG_TCCR1A), TCCR1B(HOST_REG_TCCR1B), TIMSK1(HOST_REG_TIMSK1), TIFR1(HOST_REG_TIFR1);
+HostRegister<uint16_t> TCNT1(HOST_REG_TCNT1), OCR1A(HOST_REG_OCR1A), OCR1B(HOST_REG_OCR1B);
+HostRegister<uint8_t> SREG(HOST_REG_SREG);
+
+static uint16_t Registers[HOST_NUM_REGISTERS];
+static unsigned long long Cycles = 0;
+static boolean InterruptsEnabled = true;
+static boolean InsideInterrupt = false;
+static byte TimerInterruptMode = HOST_TIMER_AUTOMATIC;
+static unsigned long long TimerStartCycle = 0;
+static unsigned long TimerInterrupts = 0;
+static unsigned long MissedTimerInterrupts = 0;
+static byte BusReadLatch = 0xFF;
+
+static byte PinModes[HOST_NUM_DIGITAL_PINS];
+static byte PinOutputs[HOST_NUM_DIGITAL_PINS];
+static byte PinInputs[HOST_NUM_DIGITAL_PINS];
+static void (*ExternalInterrupts[6])(void);
+
+static unsigned long RandomState = 1;
+
+
+/******************************************************
+     Clock & Timer 1
+*/
+static unsigned long TimerPrescaler() {
+  switch (Registers[HOST_REG_TCCR1B] & 0x07) {
+    case 1: return 1;
+    case 2: return 8;
+    case 3: return 64;
+    case 4: return 256;
+    case 5: return 1024;
+  }
+  return 0;
+}
+
+// CTC mode - counts to OCR1A, then the compare match restarts it
+static unsigned long long NextCompareCycle() {
+  return TimerStartCycle + ((unsigned long long)Registers[HOST_REG_OCR1A] + 1) * TimerPrescaler();
+}
+
+static void RunTimerInterruptNow() {
+  InsideInterrupt = true;
+  InterruptsEnabled = false;
+  Registers[HOST_REG_TIFR1] &= ~(1 << OCF1A);
+  TimerInterrupts += 1;
+  HostAdvanceCycles(HOST_ISR_OVERHEAD_CYCLES);
+  TIMER1_COMPA_vect();
+  InterruptsEnabled = true;
+  InsideInterrupt = false;
+}
+
+// Runs a pending timer interrupt if the code could be interrupted now
+static void DispatchInterrupts() {
+  while ( TimerInterruptMode == HOST_TIMER_AUTOMATIC && InterruptsEnabled && !InsideInterrupt &&
+          (Registers[HOST_REG_TIMSK1] & (1 << OCIE1A)) && (Registers[HOST_REG_TIFR1] & (1 << OCF1A)) ) {
+    RunTimerInterruptNow();
+  }
+}
+
+unsigned long long HostCycles() {
+  return Cycles;
+}
+
+unsigned long long HostNanoseconds() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void HostAdvanceCycles(unsigned long long cycles) {
+  unsigned long long target = Cycles + cycles;
+  while (TimerPrescaler() && NextCompareCycle() <= target) {
+    unsigned long long compareCycle = NextCompareCycle();
+    if (compareCycle > Cycles) Cycles = compareCycle;
+    TimerStartCycle = compareCycle;
+    if (Registers[HOST_REG_TIFR1] & (1 << OCF1A)) MissedTimerInterrupts += 1;
+    Registers[HOST_REG_TIFR1] |= (1 << OCF1A);
+    // The interrupt's own work moves the clock on (maybe past target)
+    DispatchInterrupts();
+  }
+  if (Cycles < target) Cycles = target;
+}
+
+void HostSetTimerInterruptMode(byte mode) {
+  TimerInterruptMode = mode;
+  DispatchInterrupts();
+}
+
+void HostRunTimerInterrupt() {
+  if (InsideInterrupt) return;
+  boolean wereEnabled = InterruptsEnabled;
+  RunTimerInterruptNow();
+  InterruptsEnabled = wereEnabled;
+}
+
+unsigned long HostTimerInterrupts() {
+  return TimerInterrupts;
+}
+
+unsigned long HostMissedTimerInterrupts() {
+  return MissedTimerInterrupts;
+}
+
+unsigned long millis() {
+  HostAdvanceCycles(HOST_CLOCK_READ_CYCLES);
+  return (unsigned long)(Cycles / (HOST_CYCLES_PER_MICROSECOND * 1000UL));
+}
+
+unsigned long micros() {
+  HostAdvanceCycles(HOST_CLOCK_READ_CYCLES);
+  return (unsigned long)(Cycles / HOST_CYCLES_PER_MICROSECOND);
+}
+
+void delay(unsigned long ms) {
+  HostAdvanceCycles((unsigned long long)ms * HOST_CYCLES_PER_MICROSECOND * 1000UL);
+}
+
+void delayMicroseconds(unsigned int us) {
+  HostAdvanceCycles((unsigned long long)us * HOST_CYCLES_PER_MICROSECOND);
+}
+
+void interrupts() {
+  InterruptsEnabled = true;
+  DispatchInterrupts();
+}
+
+void noInterrupts() {
+  InterruptsEnabled = false;
+}
+
+void sei() {
+  interrupts();
+}
+
+void cli() {
+  noInterrupts();
+}
+
+
+/******************************************************
+     Registers & the rev 101/102 bus
+*/
+uint16_t HostReadRegister(byte registerID) {
+  HostAdvanceCycles(HOST_REGISTER_ACCESS_CYCLES);
+  switch (registerID) {
+    case HOST_REG_PINA:
+      // The data bus (or what the Arduino is driving onto it)
+      if (Registers[HOST_REG_DDRA]) return Registers[HOST_REG_PORTA];
+      return BusReadLatch;
+    case HOST_REG_PING:
+      // The clock pin reads high (a 6802/8 - the Arduino makes the clock)
+      return Registers[HOST_REG_PORTG] | 0x04;
+    case HOST_REG_TCNT1:
+      if (!TimerPrescaler()) return Registers[HOST_REG_TCNT1];
+      return (uint16_t)((Cycles - TimerStartCycle) / TimerPrescaler());
+    case HOST_REG_SREG:
+      return InterruptsEnabled ? 0x80 : 0x00;
+  }
+  if (registerID >= HOST_REG_PINA && registerID <= HOST_REG_PINL) {
+    return Registers[registerID - HOST_REG_PINA + HOST_REG_PORTA];
+  }
+  return Registers[registerID];
+}
+
+void HostWriteRegister(byte registerID, uint16_t value) {
+  HostAdvanceCycles(HOST_REGISTER_ACCESS_CYCLES);
+  switch (registerID) {
+    case HOST_REG_PORTG:
+      // VMA (PG1) going high starts a bus cycle with the
+      // address on PORTF/PORTK and R/W on PE5
+      if (!(Registers[HOST_REG_PORTG] & 0x02) && (value & 0x02)) {
+        unsigned short address = Registers[HOST_REG_PORTF] | (Registers[HOST_REG_PORTK] << 8);
+        if (Registers[HOST_REG_PORTE] & 0x20) BusReadLatch = HostMPU_BusRead(address);
+        else HostMPU_BusWrite(address, (byte)Registers[HOST_REG_PORTA]);
+      }
+      break;
+    case HOST_REG_TCNT1:
+      if (TimerPrescaler()) TimerStartCycle = Cycles - (unsigned long long)value * TimerPrescaler();
+      break;
+    case HOST_REG_TCCR1B: {
+      // The count carries on from where it is at the new prescaler
+      uint16_t count = HostReadRegister(HOST_REG_TCNT1);
+      Registers[HOST_REG_TCCR1B] = value;
+      Registers[HOST_REG_TCNT1] = count;
+      if (TimerPrescaler()) TimerStartCycle = Cycles - (unsigned long long)count * TimerPrescaler();
+      return;
+    }
+    case HOST_REG_TIFR1:
+      // Flags are cleared by writing a one
+      Registers[HOST_REG_TIFR1] &= ~value;
+      return;
+    case HOST_REG_SREG:
+      // Restoring the I bit turns interrupts back on (or leaves them off)
+      InterruptsEnabled = (value & 0x80) ? true : false;
+      DispatchInterrupts();
+      return;
+  }
+  Registers[registerID] = value;
+  if (registerID == HOST_REG_TIMSK1) DispatchInterrupts();
+}
+
+
+/******************************************************
+     Pins, random numbers & serial ports
+*/
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < HOST_NUM_DIGITAL_PINS) PinModes[pin] = mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < HOST_NUM_DIGITAL_PINS) PinOutputs[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+  if (pin >= HOST_NUM_DIGITAL_PINS) return LOW;
+  return (PinModes[pin] == OUTPUT) ? PinOutputs[pin] : PinInputs[pin];
+}
+
+int analogRead(uint8_t pin) {
+  return (pin < HOST_NUM_DIGITAL_PINS && PinInputs[pin]) ? 1023 : 0;
+}
+
+void HostSetDigitalInput(byte pin, byte value) {
+  if (pin < HOST_NUM_DIGITAL_PINS) PinInputs[pin] = value ? HIGH : LOW;
+}
+
+byte HostGetDigitalOutput(byte pin) {
+  return (pin < HOST_NUM_DIGITAL_PINS) ? PinOutputs[pin] : LOW;
+}
+
+// The Mega's external interrupt pins (INT0-INT5)
+int digitalPinToInterrupt(uint8_t pin) {
+  switch (pin) {
+    case 2: return 4;
+    case 3: return 5;
+    case 18: return 3;
+    case 19: return 2;
+    case 20: return 1;
+    case 21: return 0;
+  }
+  return -1;
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode) {
+  (void)mode;
+  if (interruptNum < 6) ExternalInterrupts[interruptNum] = userFunc;
+}
+
+void HostTriggerExternalInterrupt(byte interruptNum) {
+  if (interruptNum >= 6 || !ExternalInterrupts[interruptNum] || InsideInterrupt) return;
+  InsideInterrupt = true;
+  InterruptsEnabled = false;
+  HostAdvanceCycles(HOST_ISR_OVERHEAD_CYCLES);
+  ExternalInterrupts[interruptNum]();
+  InterruptsEnabled = true;
+  InsideInterrupt = false;
+  DispatchInterrupts();
+}
+
+// A fixed generator, so runs repeat exactly
+long random(long howBig) {
+  if (howBig <= 0) return 0;
+  RandomState = RandomState * 1103515245UL + 12345UL;
+  return (long)((RandomState >> 1) % (unsigned long)howBig);
+}
+
+long random(long howSmall, long howBig) {
+  if (howSmall >= howBig) return howSmall;
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) RandomState = seed;
+}
+
+size_t HardwareSerial::write(uint8_t value) {
+  output.push_back((char)value);
+  if (echoFile) fputc(value, echoFile);
+  return 1;
+}
+
+size_t HardwareSerial::write(const char *str) {
+  return write((const uint8_t *)str, strlen(str));
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  output.append((const char *)buffer, size);
+  if (echoFile) fwrite(buffer, 1, size, echoFile);
+  return size;
+}
+
+size_t HardwareSerial::print(long value) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%ld", value);
+  return write(buf);
+}
+
+
+void HostReset() {
+  memset(Registers, 0, sizeof(Registers));
+  Cycles = 0;
+  InterruptsEnabled = true;
+  InsideInterrupt = false;
+  TimerInterruptMode = HOST_TIMER_AUTOMATIC;
+  TimerStartCycle = 0;
+  TimerInterrupts = 0;
+  MissedTimerInterrupts = 0;
+  BusReadLatch = 0xFF;
+  memset(PinModes, INPUT, sizeof(PinModes));
+  memset(PinOutputs, LOW, sizeof(PinOutputs));
+  memset(PinInputs, LOW, sizeof(PinInputs));
+  memset(ExternalInterrupts, 0, sizeof(ExternalInterrupts));
+  RandomState = 1;
+  Serial.HostTakeOutput();
+  Serial1.HostTakeOutput();
+  Serial2.HostTakeOutput();
+  Serial3.HostTakeOutput();
+  HostMPU_Reset();
+}
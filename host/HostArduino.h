@@ -0,0 +1,61 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - control of the simulated Arduino from the host side.
+//
+// Time is counted in CPU clocks (16 per microsecond) and only moves when
+// the code touches a register, reads the clock, or waits. Code that does
+// none of those takes no virtual time, so a host that wants loop() to
+// cost something has to charge for it with HostAdvanceCycles.
+
+#ifndef HOST_ARDUINO_CONTROL_H
+#define HOST_ARDUINO_CONTROL_H
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#define HOST_CYCLES_PER_MICROSECOND     (F_CPU / 1000000UL)
+// What the simulated code is charged for each kind of access
+#define HOST_REGISTER_ACCESS_CYCLES     2
+#define HOST_CLOCK_READ_CYCLES          16
+#define HOST_ISR_OVERHEAD_CYCLES        40
+
+#define HOST_TIMER_AUTOMATIC            0
+#define HOST_TIMER_MANUAL               1
+
+// Back to power-on: clock at zero, registers & pins cleared, serial
+// captures emptied (EEPROM is kept)
+void HostReset();
+
+unsigned long long HostCycles();
+// Real time on the host (for timing the simulated code itself)
+unsigned long long HostNanoseconds();
+void HostAdvanceCycles(unsigned long long cycles);
+
+// HOST_TIMER_AUTOMATIC runs the Timer 1 interrupt whenever a compare
+// match comes due (and interrupts are on), the way the chip does.
+// HOST_TIMER_MANUAL leaves it to HostRunTimerInterrupt.
+void HostSetTimerInterruptMode(byte mode);
+void HostRunTimerInterrupt();
+unsigned long HostTimerInterrupts();
+// Compare matches that came due while the last one was still pending
+unsigned long HostMissedTimerInterrupts();
+
+void HostSetDigitalInput(byte pin, byte value);
+byte HostGetDigitalOutput(byte pin);
+void HostTriggerExternalInterrupt(byte interruptNum);
+
+#endif
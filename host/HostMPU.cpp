@@ -0,0 +1,252 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+#include "RPU_Config.h"
+#include "HostMPU.h"
+
+#if (RPU_OS_HARDWARE_REV!=101) && (RPU_OS_HARDWARE_REV!=102)
+#error "The host build simulates the RPU_OS_HARDWARE_REV 101/102 bus, check RPU_Config.h"
+#endif
+#if (RPU_MPU_ARCHITECTURE<10) || (RPU_MPU_ARCHITECTURE>13)
+#error "The host build simulates RPU_MPU_ARCHITECTURE 10 to 13, check RPU_Config.h"
+#endif
+
+#define HOST_PIA_SOUND      0
+#define HOST_PIA_SOLENOID   1
+#define HOST_PIA_LAMPS      2
+#define HOST_PIA_DISPLAY    3
+#define HOST_PIA_SWITCH     4
+#define HOST_NUM_PIAS       5
+
+struct HostPIA {
+  byte outputA, outputB;
+  byte directionA, directionB;
+  byte controlA, controlB;
+  byte inputA, inputB;
+};
+
+// The 6821 control register: b2 picks the data register over the data
+// direction register, b3-b5 set CA2/CB2 (0x30 = output, b3 is its level),
+// b6-b7 are the interrupt flags (read only, cleared by reading the port)
+#define PIA_CONTROL_PORT_SELECT   0x04
+#define PIA_CONTROL_IRQ_FLAGS     0xC0
+
+static HostPIA PIAs[HOST_NUM_PIAS];
+static byte SwitchMatrix[HOST_MPU_NUM_SWITCH_COLUMNS];
+static byte LampColumns[HOST_MPU_NUM_LAMP_COLUMNS];
+static byte DisplayStrobeData[HOST_MPU_NUM_DISPLAY_STROBES];
+static unsigned long SolenoidFirings[HOST_MPU_NUM_SOLENOIDS];
+static unsigned long SolenoidsOn = 0;
+static unsigned long BusCycles = 0;
+static boolean UpDownHeld = false;
+
+
+void HostMPU_Reset() {
+  memset(PIAs, 0, sizeof(PIAs));
+  memset(SwitchMatrix, 0, sizeof(SwitchMatrix));
+  memset(LampColumns, 0, sizeof(LampColumns));
+  memset(DisplayStrobeData, 0xFF, sizeof(DisplayStrobeData));
+  memset(SolenoidFirings, 0, sizeof(SolenoidFirings));
+  SolenoidsOn = 0;
+  BusCycles = 0;
+  UpDownHeld = false;
+}
+
+// Which PIA answers an address (or -1 for none)
+static int PIAForAddress(unsigned short address) {
+  switch (address & 0xFFFC) {
+#if (RPU_MPU_ARCHITECTURE==13)
+    case 0x2100: return HOST_PIA_SOUND;
+#endif
+    case 0x2200: return HOST_PIA_SOLENOID;
+    case 0x2400: return HOST_PIA_LAMPS;
+    case 0x2800: return HOST_PIA_DISPLAY;
+    case 0x3000: return HOST_PIA_SWITCH;
+  }
+  return -1;
+}
+
+// A special solenoid is on when its CA2/CB2 is an output driven low
+static inline boolean ControlLineLow(byte control) {
+  return (control & 0x38) == 0x30;
+}
+
+static void UpdateSolenoids() {
+  unsigned long solenoids = PIAs[HOST_PIA_SOLENOID].outputA & PIAs[HOST_PIA_SOLENOID].directionA;
+  solenoids |= ((unsigned long)(PIAs[HOST_PIA_SOLENOID].outputB & PIAs[HOST_PIA_SOLENOID].directionB)) << 8;
+  // Same order as the special solenoids in the interrupt
+  if (ControlLineLow(PIAs[HOST_PIA_LAMPS].controlB)) solenoids |= (1UL << 16);
+  if (ControlLineLow(PIAs[HOST_PIA_LAMPS].controlA)) solenoids |= (1UL << 17);
+  if (ControlLineLow(PIAs[HOST_PIA_SWITCH].controlB)) solenoids |= (1UL << 18);
+  if (ControlLineLow(PIAs[HOST_PIA_SWITCH].controlA)) solenoids |= (1UL << 19);
+  if (ControlLineLow(PIAs[HOST_PIA_SOLENOID].controlA)) solenoids |= (1UL << 20);
+  if (ControlLineLow(PIAs[HOST_PIA_DISPLAY].controlB)) solenoids |= (1UL << 21);
+
+  unsigned long turnedOn = solenoids & ~SolenoidsOn;
+  for (byte solCount = 0; turnedOn; solCount++, turnedOn >>= 1) {
+    if (turnedOn & 0x01) SolenoidFirings[solCount] += 1;
+  }
+  SolenoidsOn = solenoids;
+}
+
+// The board's reaction to an output changing
+static void OutputsChanged(int piaNum) {
+  HostPIA *pia = &PIAs[piaNum];
+  switch (piaNum) {
+    case HOST_PIA_LAMPS: {
+      // Port B strobes lamp columns, port A is the column's data (a set bit is off)
+      byte strobes = pia->outputB & pia->directionB;
+      for (byte column = 0; column < HOST_MPU_NUM_LAMP_COLUMNS; column++) {
+        if (strobes & (1 << column)) LampColumns[column] = ~(pia->outputA & pia->directionA);
+      }
+      break;
+    }
+    case HOST_PIA_DISPLAY:
+      // Port A's low nibble picks the digit, port B has the BCD for two displays
+      DisplayStrobeData[pia->outputA & 0x0F] = pia->outputB;
+      break;
+  }
+  UpdateSolenoids();
+}
+
+// What's on a port's input pins right now
+static byte PortInputs(int piaNum, boolean portB) {
+  HostPIA *pia = &PIAs[piaNum];
+  if (piaNum == HOST_PIA_SWITCH && !portB) {
+    // Port B strobes the switch columns, port A returns the rows
+    byte strobes = pia->outputB & pia->directionB;
+    byte rows = 0;
+    for (byte column = 0; column < HOST_MPU_NUM_SWITCH_COLUMNS; column++) {
+      if (strobes & (1 << column)) rows |= SwitchMatrix[column];
+    }
+    return rows;
+  }
+  return portB ? pia->inputB : pia->inputA;
+}
+
+byte HostMPU_BusRead(unsigned short address) {
+  BusCycles += 1;
+  int piaNum = PIAForAddress(address);
+  if (piaNum < 0) return 0xFF;
+
+  HostPIA *pia = &PIAs[piaNum];
+  switch (address & 0x03) {
+    case 0:
+      if (!(pia->controlA & PIA_CONTROL_PORT_SELECT)) return pia->directionA;
+      pia->controlA &= ~PIA_CONTROL_IRQ_FLAGS;
+      return (pia->outputA & pia->directionA) | (PortInputs(piaNum, false) & ~pia->directionA);
+    case 1:
+      return pia->controlA;
+    case 2: {
+      if (!(pia->controlB & PIA_CONTROL_PORT_SELECT)) return pia->directionB;
+      pia->controlB &= ~PIA_CONTROL_IRQ_FLAGS;
+      // A held up/down switch flags again straight away
+      if (piaNum == HOST_PIA_DISPLAY && UpDownHeld) pia->controlB |= 0x80;
+      return (pia->outputB & pia->directionB) | (PortInputs(piaNum, true) & ~pia->directionB);
+    }
+  }
+  return pia->controlB;
+}
+
+void HostMPU_BusWrite(unsigned short address, byte data) {
+  BusCycles += 1;
+  int piaNum = PIAForAddress(address);
+  if (piaNum < 0) return;
+
+  HostPIA *pia = &PIAs[piaNum];
+  switch (address & 0x03) {
+    case 0:
+      if (pia->controlA & PIA_CONTROL_PORT_SELECT) pia->outputA = data;
+      else pia->directionA = data;
+      break;
+    case 1:
+      pia->controlA = (pia->controlA & PIA_CONTROL_IRQ_FLAGS) | (data & ~PIA_CONTROL_IRQ_FLAGS);
+      break;
+    case 2:
+      if (pia->controlB & PIA_CONTROL_PORT_SELECT) pia->outputB = data;
+      else pia->directionB = data;
+      break;
+    case 3:
+      pia->controlB = (pia->controlB & PIA_CONTROL_IRQ_FLAGS) | (data & ~PIA_CONTROL_IRQ_FLAGS);
+      break;
+  }
+  OutputsChanged(piaNum);
+}
+
+unsigned long HostMPU_GetBusCycles() {
+  return BusCycles;
+}
+
+void HostMPU_SetSwitch(byte switchNum, boolean closed) {
+  if (switchNum >= HOST_MPU_NUM_SWITCH_COLUMNS * 8) return;
+  if (closed) SwitchMatrix[switchNum / 8] |= (1 << (switchNum % 8));
+  else SwitchMatrix[switchNum / 8] &= ~(1 << (switchNum % 8));
+}
+
+boolean HostMPU_GetSwitch(byte switchNum) {
+  if (switchNum >= HOST_MPU_NUM_SWITCH_COLUMNS * 8) return false;
+  return (SwitchMatrix[switchNum / 8] & (1 << (switchNum % 8))) ? true : false;
+}
+
+void HostMPU_PressSelfTestButton() {
+  PIAs[HOST_PIA_DISPLAY].controlA |= 0x80;
+}
+
+void HostMPU_SetUpDownSwitch(boolean held) {
+  UpDownHeld = held;
+  if (held) PIAs[HOST_PIA_DISPLAY].controlB |= 0x80;
+}
+
+boolean HostMPU_GetLamp(byte lampNum) {
+  if (lampNum >= HOST_MPU_NUM_LAMP_COLUMNS * 8) return false;
+  return (LampColumns[lampNum / 8] & (1 << (lampNum % 8))) ? true : false;
+}
+
+byte HostMPU_GetLampColumn(byte column) {
+  return (column < HOST_MPU_NUM_LAMP_COLUMNS) ? LampColumns[column] : 0;
+}
+
+unsigned long HostMPU_GetSolenoids() {
+  return SolenoidsOn;
+}
+
+unsigned long HostMPU_GetSolenoidFirings(byte solNum) {
+  return (solNum < HOST_MPU_NUM_SOLENOIDS) ? SolenoidFirings[solNum] : 0;
+}
+
+byte HostMPU_GetDisplayStrobeData(byte strobe) {
+  return (strobe < HOST_MPU_NUM_DISPLAY_STROBES) ? DisplayStrobeData[strobe] : 0xFF;
+}
+
+boolean HostMPU_GetDisplayDigits(byte displayNum, char *digits) {
+#if (RPU_MPU_ARCHITECTURE<13)
+  if (displayNum > 3) return false;
+  // Displays 1 & 3 are on strobes 0-5, 2 & 4 on 8-13 (the
+  // first of each pair in the high nibble)
+  byte firstStrobe = (displayNum & 0x01) ? 8 : 0;
+  for (byte digitCount = 0; digitCount < 6; digitCount++) {
+    byte data = DisplayStrobeData[firstStrobe + digitCount];
+    byte bcd = (displayNum < 2) ? (data >> 4) : (data & 0x0F);
+    digits[digitCount] = (bcd < 10) ? ('0' + bcd) : ' ';
+  }
+  digits[6] = 0;
+  return true;
+#else
+  (void)displayNum;
+  digits[0] = 0;
+  return false;
+#endif
+}
@@ -0,0 +1,61 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - a simulated Williams MPU (RPU_MPU_ARCHITECTURE 10 to 13)
+// on the far side of the rev 101/102 bus. The 6821 PIAs keep their data
+// direction, output & control registers, and the board around them has
+// a switch matrix, lamp matrix, solenoid drivers and displays.
+
+#ifndef HOST_MPU_H
+#define HOST_MPU_H
+
+#include <Arduino.h>
+
+#define HOST_MPU_NUM_SWITCH_COLUMNS   8
+#define HOST_MPU_NUM_LAMP_COLUMNS     8
+// Solenoid port A, port B, then the six special solenoids (CA2/CB2 lines)
+#define HOST_MPU_NUM_SOLENOIDS        22
+#define HOST_MPU_NUM_DISPLAY_STROBES  16
+
+void HostMPU_Reset();
+
+// Called by the bus (VMA going high) for each read or write cycle
+byte HostMPU_BusRead(unsigned short address);
+void HostMPU_BusWrite(unsigned short address, byte data);
+unsigned long HostMPU_GetBusCycles();
+
+// Switch numbers match the RPU (column * 8 + row)
+void HostMPU_SetSwitch(byte switchNum, boolean closed);
+boolean HostMPU_GetSwitch(byte switchNum);
+// The coin door buttons (display PIA CA1 and CB1)
+void HostMPU_PressSelfTestButton();
+void HostMPU_SetUpDownSwitch(boolean held);
+
+// Lamp numbers match the RPU (strobe * 8 + bit)
+boolean HostMPU_GetLamp(byte lampNum);
+byte HostMPU_GetLampColumn(byte column);
+
+// Bit n is on if solenoid n is being driven
+unsigned long HostMPU_GetSolenoids();
+unsigned long HostMPU_GetSolenoidFirings(byte solNum);
+
+// The last digit data written for a display strobe
+byte HostMPU_GetDisplayStrobeData(byte strobe);
+// The six digits of a player display as text (blank digits are spaces),
+// or false if this architecture's display layout isn't decoded
+boolean HostMPU_GetDisplayDigits(byte displayNum, char *digits);
+
+#endif
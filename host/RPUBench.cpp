@@ -0,0 +1,123 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - runs the RPU micro-benchmarks (RPUBenchmark.cpp) and
+// checks them against a saved baseline.
+//
+//   spacebattle_rpu_bench [--calls N] [--runs N] [--tolerance PCT]
+//                         [--baseline FILE] [--save-baseline FILE]
+//
+// Each benchmark's time is the best of --runs runs of --calls calls.
+// A baseline file has a "name time" line per benchmark (times in tenths
+// of a ns). Exits with 2 if any call is more than --tolerance percent
+// slower than the baseline. Times are on this computer, so only compare
+// a baseline saved on the same one.
+
+#include "HostArduino.h"
+#include "RPU_Config.h"
+#include "RPU.h"
+#include "RPUBenchmark.h"
+
+void setup();
+
+static void ShowUsage() {
+  fprintf(stderr, "usage: spacebattle_rpu_bench [--calls N] [--runs N] [--tolerance PCT] [--baseline FILE] [--save-baseline FILE]\n");
+}
+
+static boolean LoadBaseline(const char *path, unsigned long *baseline) {
+  FILE *file = fopen(path, "r");
+  if (!file) return false;
+  char name[64];
+  unsigned long benchmarkTime;
+  for (byte benchmarkNum = 0; benchmarkNum < RPU_NUM_BENCHMARKS; benchmarkNum++) baseline[benchmarkNum] = 0;
+  while (fscanf(file, "%63s %lu", name, &benchmarkTime) == 2) {
+    for (byte benchmarkNum = 0; benchmarkNum < RPU_NUM_BENCHMARKS; benchmarkNum++) {
+      if (!strcmp(name, GetRPUBenchmarkName(benchmarkNum))) baseline[benchmarkNum] = benchmarkTime;
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+static boolean SaveBaseline(const char *path, const unsigned long *times) {
+  FILE *file = fopen(path, "w");
+  if (!file) return false;
+  for (byte benchmarkNum = 0; benchmarkNum < RPU_NUM_BENCHMARKS; benchmarkNum++) {
+    if (times[benchmarkNum]) fprintf(file, "%s %lu\n", GetRPUBenchmarkName(benchmarkNum), times[benchmarkNum]);
+  }
+  return (fclose(file) == 0) ? true : false;
+}
+
+int main(int argc, char **argv) {
+  unsigned long numCalls = 50000;
+  unsigned long numRuns = 21;
+  unsigned long tolerancePercent = 10;
+  const char *baselinePath = NULL;
+  const char *saveBaselinePath = NULL;
+
+  for (int argCount = 1; argCount < argc; argCount++) {
+    if (!strcmp(argv[argCount], "--calls") && (argCount + 1) < argc) {
+      numCalls = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--runs") && (argCount + 1) < argc) {
+      numRuns = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--tolerance") && (argCount + 1) < argc) {
+      tolerancePercent = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--baseline") && (argCount + 1) < argc) {
+      baselinePath = argv[++argCount];
+    } else if (!strcmp(argv[argCount], "--save-baseline") && (argCount + 1) < argc) {
+      saveBaselinePath = argv[++argCount];
+    } else {
+      ShowUsage();
+      return 1;
+    }
+  }
+  if (numCalls == 0 || numCalls > 65535 || numRuns == 0 || tolerancePercent > 255) {
+    ShowUsage();
+    return 1;
+  }
+
+  unsigned long baseline[RPU_NUM_BENCHMARKS];
+  if (baselinePath && !LoadBaseline(baselinePath, baseline)) {
+    fprintf(stderr, "%s: can't read the baseline\n", baselinePath);
+    return 1;
+  }
+
+  HostReset();
+  setup();
+  Serial.HostTakeOutput();
+  Serial1.HostTakeOutput();
+  // The interrupt would only add noise to calls this short
+  HostSetTimerInterruptMode(HOST_TIMER_MANUAL);
+
+  unsigned long bestTimes[RPU_NUM_BENCHMARKS];
+  unsigned long runTimes[RPU_NUM_BENCHMARKS];
+  for (unsigned long runCount = 0; runCount < numRuns; runCount++) {
+    RunRPUBenchmarks((unsigned short)numCalls, runTimes);
+    for (byte benchmarkNum = 0; benchmarkNum < RPU_NUM_BENCHMARKS; benchmarkNum++) {
+      if (runCount == 0 || runTimes[benchmarkNum] < bestTimes[benchmarkNum]) bestTimes[benchmarkNum] = runTimes[benchmarkNum];
+    }
+  }
+
+  Serial.HostSetEcho(stdout);
+  byte numSlower = ReportRPUBenchmarks(&Serial, bestTimes, baselinePath ? baseline : NULL, (byte)tolerancePercent);
+  fflush(stdout);
+
+  if (saveBaselinePath && !SaveBaseline(saveBaselinePath, bestTimes)) {
+    fprintf(stderr, "%s: couldn't save the baseline\n", saveBaselinePath);
+    return 1;
+  }
+  return numSlower ? 2 : 0;
+}
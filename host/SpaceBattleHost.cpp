@@ -0,0 +1,105 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - runs the game against the simulated MPU for a stretch of
+// virtual time and reports what it did.
+//
+//   spacebattle_host [--seconds N] [--loop-cycles N] [--eeprom FILE] [--quiet]
+//
+// --loop-cycles charges each pass through loop() for the CPU time of
+// code that doesn't touch a register (see HostArduino.h). --eeprom loads
+// the EEPROM image from FILE (if it exists) and saves it back at the end.
+
+#include "HostArduino.h"
+#include "HostMPU.h"
+
+void setup();
+void loop();
+
+static void ShowUsage() {
+  fprintf(stderr, "usage: spacebattle_host [--seconds N] [--loop-cycles N] [--eeprom FILE] [--quiet]\n");
+}
+
+int main(int argc, char **argv) {
+  unsigned long runSeconds = 10;
+  unsigned long loopCycles = 1600;
+  const char *eepromPath = NULL;
+  boolean quiet = false;
+
+  for (int argCount = 1; argCount < argc; argCount++) {
+    if (!strcmp(argv[argCount], "--seconds") && (argCount + 1) < argc) {
+      runSeconds = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--loop-cycles") && (argCount + 1) < argc) {
+      loopCycles = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--eeprom") && (argCount + 1) < argc) {
+      eepromPath = argv[++argCount];
+    } else if (!strcmp(argv[argCount], "--quiet")) {
+      quiet = true;
+    } else {
+      ShowUsage();
+      return 1;
+    }
+  }
+
+  if (eepromPath) {
+    FILE *eepromFile = fopen(eepromPath, "rb");
+    if (eepromFile) {
+      size_t bytesRead = fread(EEPROM.HostData(), 1, HOST_EEPROM_SIZE, eepromFile);
+      fclose(eepromFile);
+      if (bytesRead != HOST_EEPROM_SIZE) fprintf(stderr, "%s: short EEPROM image (%lu bytes)\n", eepromPath, (unsigned long)bytesRead);
+    }
+  }
+
+  HostReset();
+  if (!quiet) Serial.HostSetEcho(stdout);
+
+  setup();
+  unsigned long long endCycle = (unsigned long long)runSeconds * 1000000ULL * HOST_CYCLES_PER_MICROSECOND;
+  unsigned long numLoops = 0;
+  while (HostCycles() < endCycle) {
+    loop();
+    HostAdvanceCycles(loopCycles);
+    numLoops += 1;
+  }
+
+  printf("\n%lu s virtual: %lu loops, %lu timer interrupts (%lu missed), %lu bus cycles, %lu EEPROM writes\n",
+         runSeconds, numLoops, HostTimerInterrupts(), HostMissedTimerInterrupts(), HostMPU_GetBusCycles(), EEPROM.HostWrites());
+
+  char digits[8];
+  printf("Displays:");
+  for (byte displayCount = 0; displayCount < 4; displayCount++) {
+    if (HostMPU_GetDisplayDigits(displayCount, digits)) printf(" [%s]", digits);
+  }
+  printf("\nLamps on:");
+  for (byte lampCount = 0; lampCount < HOST_MPU_NUM_LAMP_COLUMNS * 8; lampCount++) {
+    if (HostMPU_GetLamp(lampCount)) printf(" %d", lampCount);
+  }
+  printf("\nSolenoid firings:");
+  for (byte solCount = 0; solCount < HOST_MPU_NUM_SOLENOIDS; solCount++) {
+    if (HostMPU_GetSolenoidFirings(solCount)) printf(" %d:%lu", solCount, HostMPU_GetSolenoidFirings(solCount));
+  }
+  printf("\n");
+
+  if (eepromPath) {
+    FILE *eepromFile = fopen(eepromPath, "wb");
+    if (!eepromFile || fwrite(EEPROM.HostData(), 1, HOST_EEPROM_SIZE, eepromFile) != HOST_EEPROM_SIZE) {
+      fprintf(stderr, "%s: couldn't save the EEPROM image\n", eepromPath);
+    }
+    if (eepromFile) fclose(eepromFile);
+  }
+
+  return 0;
+}
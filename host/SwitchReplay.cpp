@@ -0,0 +1,210 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - replays a switch log (see RPU_SetSwitchRecorder) through
+// the game and reports how long loop() took on this computer.
+//
+//   spacebattle_replay LOG [--speed N] [--loop-cycles N] [--tail-seconds N]
+//                          [--trace FILE] [--rerecord FILE]
+//
+// --trace writes every change to the lamps, displays, solenoid & sound
+// lines and WAV Trigger commands, stamped with the virtual time in ms,
+// so two builds can be diffed to show they play the same game.
+// --rerecord saves the log the game records while it's replayed (it
+// should match LOG at --speed 1).
+
+#include <chrono>
+#include <string>
+#include "HostArduino.h"
+#include "HostMPU.h"
+#include "RPU_Config.h"
+#include "RPU.h"
+
+void setup();
+void loop();
+
+// The game records to SWITCH_LOG_SERIAL (Serial2), so the log is fed in
+// on a port it doesn't use
+#define REPLAY_SERIAL   Serial3
+
+struct ReplayOutputs {
+  byte lampColumns[HOST_MPU_NUM_LAMP_COLUMNS];
+  byte displayStrobes[HOST_MPU_NUM_DISPLAY_STROBES];
+  unsigned long solenoids;
+};
+
+static void ShowUsage() {
+  fprintf(stderr, "usage: spacebattle_replay LOG [--speed N] [--loop-cycles N] [--tail-seconds N] [--trace FILE] [--rerecord FILE]\n");
+}
+
+static boolean ReadFile(const char *path, std::string *contents) {
+  FILE *file = fopen(path, "rb");
+  if (!file) return false;
+  char buffer[4096];
+  size_t bytesRead;
+  while ((bytesRead = fread(buffer, 1, sizeof(buffer), file)) > 0) contents->append(buffer, bytesRead);
+  fclose(file);
+  return true;
+}
+
+// Checks the header and adds up the events and their timing
+static boolean ScanSwitchLog(const std::string &log, unsigned long *numEvents, unsigned long *duration) {
+  static const char header[RPU_SWITCH_LOG_HEADER_SIZE] = {'R', 'S', 'W', RPU_SWITCH_LOG_VERSION};
+  if (log.size() < (RPU_SWITCH_LOG_HEADER_SIZE + RPU_SWITCH_LOG_STATE_SIZE) || log.compare(0, RPU_SWITCH_LOG_HEADER_SIZE, header, RPU_SWITCH_LOG_HEADER_SIZE)) return false;
+  *numEvents = 0;
+  *duration = 0;
+  for (size_t offset = RPU_SWITCH_LOG_HEADER_SIZE + RPU_SWITCH_LOG_STATE_SIZE; offset + RPU_SWITCH_LOG_RECORD_SIZE <= log.size(); offset += RPU_SWITCH_LOG_RECORD_SIZE) {
+    *duration += (byte)log[offset + 1] | ((unsigned long)(byte)log[offset + 2] << 8);
+    if ((byte)log[offset] != RPU_SWITCH_LOG_GAP) *numEvents += 1;
+  }
+  return true;
+}
+
+static void CaptureOutputs(ReplayOutputs *outputs) {
+  for (byte column = 0; column < HOST_MPU_NUM_LAMP_COLUMNS; column++) outputs->lampColumns[column] = HostMPU_GetLampColumn(column);
+  for (byte strobe = 0; strobe < HOST_MPU_NUM_DISPLAY_STROBES; strobe++) outputs->displayStrobes[strobe] = HostMPU_GetDisplayStrobeData(strobe);
+  outputs->solenoids = HostMPU_GetSolenoids();
+}
+
+static void TraceOutputs(FILE *traceFile, const ReplayOutputs &previous, const ReplayOutputs &current) {
+  unsigned long traceTime = (unsigned long)(HostCycles() / (HOST_CYCLES_PER_MICROSECOND * 1000));
+
+  if (memcmp(previous.lampColumns, current.lampColumns, sizeof(current.lampColumns))) {
+    fprintf(traceFile, "%lu lamps", traceTime);
+    for (byte column = 0; column < HOST_MPU_NUM_LAMP_COLUMNS; column++) fprintf(traceFile, " %02X", current.lampColumns[column]);
+    fprintf(traceFile, "\n");
+  }
+  if (memcmp(previous.displayStrobes, current.displayStrobes, sizeof(current.displayStrobes))) {
+    fprintf(traceFile, "%lu displays", traceTime);
+    for (byte strobe = 0; strobe < HOST_MPU_NUM_DISPLAY_STROBES; strobe++) fprintf(traceFile, " %02X", current.displayStrobes[strobe]);
+    fprintf(traceFile, "\n");
+  }
+  if (previous.solenoids != current.solenoids) fprintf(traceFile, "%lu solenoids %06lX\n", traceTime, current.solenoids);
+
+  std::string wavTriggerCommands = Serial1.HostTakeOutput();
+  if (wavTriggerCommands.size()) {
+    fprintf(traceFile, "%lu wavtrigger", traceTime);
+    for (size_t count = 0; count < wavTriggerCommands.size(); count++) fprintf(traceFile, " %02X", (byte)wavTriggerCommands[count]);
+    fprintf(traceFile, "\n");
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *logPath = NULL;
+  const char *tracePath = NULL;
+  const char *rerecordPath = NULL;
+  unsigned long speedMultiple = 1;
+  unsigned long loopCycles = 1600;
+  unsigned long tailSeconds = 5;
+
+  for (int argCount = 1; argCount < argc; argCount++) {
+    if (!strcmp(argv[argCount], "--speed") && (argCount + 1) < argc) {
+      speedMultiple = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--loop-cycles") && (argCount + 1) < argc) {
+      loopCycles = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--tail-seconds") && (argCount + 1) < argc) {
+      tailSeconds = strtoul(argv[++argCount], NULL, 10);
+    } else if (!strcmp(argv[argCount], "--trace") && (argCount + 1) < argc) {
+      tracePath = argv[++argCount];
+    } else if (!strcmp(argv[argCount], "--rerecord") && (argCount + 1) < argc) {
+      rerecordPath = argv[++argCount];
+    } else if (argv[argCount][0] != '-' && logPath == NULL) {
+      logPath = argv[argCount];
+    } else {
+      ShowUsage();
+      return 1;
+    }
+  }
+  if (logPath == NULL || speedMultiple > 255) {
+    ShowUsage();
+    return 1;
+  }
+
+  std::string switchLog;
+  unsigned long numEvents, logDuration;
+  if (!ReadFile(logPath, &switchLog)) {
+    fprintf(stderr, "%s: can't read the switch log\n", logPath);
+    return 1;
+  }
+  if (!ScanSwitchLog(switchLog, &numEvents, &logDuration)) {
+    fprintf(stderr, "%s: not a version %d switch log\n", logPath, RPU_SWITCH_LOG_VERSION);
+    return 1;
+  }
+
+  FILE *traceFile = NULL;
+  if (tracePath && !(traceFile = fopen(tracePath, "w"))) {
+    fprintf(stderr, "%s: can't write the trace\n", tracePath);
+    return 1;
+  }
+
+  HostReset();
+  setup();
+
+  // setup() has started recording by now (nothing was sent to it to
+  // replay), which gives the rerecorded log
+  Serial2.HostTakeOutput();
+  RPU_SetSwitchRecorder(&Serial2);
+  REPLAY_SERIAL.HostQueueInput((const uint8_t *)switchLog.data(), switchLog.size());
+  RPU_StartSwitchReplay(&REPLAY_SERIAL, (byte)speedMultiple);
+  Serial1.HostTakeOutput();
+
+  unsigned long long tailCycles = (unsigned long long)tailSeconds * 1000000ULL * HOST_CYCLES_PER_MICROSECOND;
+  unsigned long long endCycle = 0;
+  if (speedMultiple) endCycle = HostCycles() + (unsigned long long)logDuration * 1000ULL * HOST_CYCLES_PER_MICROSECOND / speedMultiple + tailCycles;
+
+  ReplayOutputs previousOutputs, currentOutputs;
+  CaptureOutputs(&previousOutputs);
+  unsigned long numLoops = 0;
+  unsigned long long loopNanoseconds = 0, maxLoopNanoseconds = 0;
+
+  while (endCycle == 0 || HostCycles() < endCycle) {
+    std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+    loop();
+    unsigned long long elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - loopStart).count();
+    loopNanoseconds += elapsed;
+    if (elapsed > maxLoopNanoseconds) maxLoopNanoseconds = elapsed;
+    numLoops += 1;
+    HostAdvanceCycles(loopCycles);
+
+    if (traceFile) {
+      CaptureOutputs(&currentOutputs);
+      TraceOutputs(traceFile, previousOutputs, currentOutputs);
+      previousOutputs = currentOutputs;
+    }
+    // At speed 0 the end isn't known until the log has all gone in
+    if (endCycle == 0 && REPLAY_SERIAL.available() == 0) endCycle = HostCycles() + tailCycles;
+  }
+
+  printf("%s: %lu events over %lu.%03lu s, replayed at ", logPath, numEvents, logDuration / 1000, logDuration % 1000);
+  if (speedMultiple) printf("%lux\n", speedMultiple);
+  else printf("full speed\n");
+  printf("%lu loops in %.3f s virtual, %.3f ms on this computer (%.0f ns per loop, worst %llu ns)\n",
+         numLoops, (double)HostCycles() / (HOST_CYCLES_PER_MICROSECOND * 1000000.0), loopNanoseconds / 1000000.0,
+         numLoops ? (double)loopNanoseconds / numLoops : 0.0, maxLoopNanoseconds);
+  printf("%lu timer interrupts (%lu missed)\n", HostTimerInterrupts(), HostMissedTimerInterrupts());
+
+  if (traceFile) fclose(traceFile);
+  if (rerecordPath) {
+    std::string rerecorded = Serial2.HostTakeOutput();
+    FILE *rerecordFile = fopen(rerecordPath, "wb");
+    if (!rerecordFile || fwrite(rerecorded.data(), 1, rerecorded.size(), rerecordFile) != rerecorded.size()) {
+      fprintf(stderr, "%s: couldn't save the rerecorded log\n", rerecordPath);
+    }
+    if (rerecordFile) fclose(rerecordFile);
+  }
+
+  return 0;
+}
@@ -0,0 +1,152 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - the parts of the Arduino core (and the ATmega2560
+// registers) that the RPU code uses, so it can be compiled unchanged
+// on a PC. The registers are objects: every access goes through
+// HostArduino.cpp, which advances the virtual clock, runs the Timer 1
+// interrupt when it's due, and passes bus cycles to the simulated MPU.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+#define RISING        3
+#define FALLING       2
+#define CHANGE        1
+
+#define F_CPU         16000000UL
+
+#define PROGMEM
+#define pgm_read_byte(address)    (*(const uint8_t *)(address))
+#define pgm_read_word(address)    (*(const uint16_t *)(address))
+#define pgm_read_dword(address)   (*(const uint32_t *)(address))
+#define F(string)                 (string)
+
+#define A0    54
+#define A1    55
+#define A2    56
+#define A3    57
+#define A4    58
+#define A5    59
+#define A6    60
+#define A7    61
+#define A8    62
+#define A9    63
+#define A10   64
+#define A11   65
+#define A12   66
+#define A13   67
+#define A14   68
+#define A15   69
+#define HOST_NUM_DIGITAL_PINS   70
+
+template<class T, class U> inline T min(T a, U b) { return (a < (T)b) ? a : (T)b; }
+template<class T, class U> inline T max(T a, U b) { return (a > (T)b) ? a : (T)b; }
+#define constrain(amount, low, high) ((amount)<(low)?(low):((amount)>(high)?(high):(amount)))
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+void interrupts();
+void noInterrupts();
+void cli();
+void sei();
+int digitalPinToInterrupt(uint8_t pin);
+void attachInterrupt(uint8_t interruptNum, void (*userFunc)(void), int mode);
+
+// An interrupt routine is an ordinary function that the host calls
+#define ISR(vector) extern "C" void vector(void)
+extern "C" void TIMER1_COMPA_vect(void);
+
+
+/******************************************************
+     ATmega2560 registers
+*/
+enum HostRegisterID {
+  HOST_REG_PORTA, HOST_REG_PORTB, HOST_REG_PORTC, HOST_REG_PORTD, HOST_REG_PORTE, HOST_REG_PORTF,
+  HOST_REG_PORTG, HOST_REG_PORTH, HOST_REG_PORTJ, HOST_REG_PORTK, HOST_REG_PORTL,
+  HOST_REG_DDRA, HOST_REG_DDRB, HOST_REG_DDRC, HOST_REG_DDRD, HOST_REG_DDRE, HOST_REG_DDRF,
+  HOST_REG_DDRG, HOST_REG_DDRH, HOST_REG_DDRJ, HOST_REG_DDRK, HOST_REG_DDRL,
+  HOST_REG_PINA, HOST_REG_PINB, HOST_REG_PINC, HOST_REG_PIND, HOST_REG_PINE, HOST_REG_PINF,
+  HOST_REG_PING, HOST_REG_PINH, HOST_REG_PINJ, HOST_REG_PINK, HOST_REG_PINL,
+  HOST_REG_TCCR1A, HOST_REG_TCCR1B, HOST_REG_TIMSK1, HOST_REG_TIFR1,
+  HOST_REG_TCNT1, HOST_REG_OCR1A, HOST_REG_OCR1B,
+  HOST_REG_SREG,
+  HOST_NUM_REGISTERS
+};
+
+uint16_t HostReadRegister(byte registerID);
+void HostWriteRegister(byte registerID, uint16_t value);
+
+template<class T> class HostRegister {
+public:
+  explicit HostRegister(byte registerID) : id(registerID) {}
+  operator T() const { return (T)HostReadRegister(id); }
+  HostRegister &operator=(T value) { HostWriteRegister(id, value); return *this; }
+  HostRegister &operator=(const HostRegister &other) { HostWriteRegister(id, (T)other); return *this; }
+  HostRegister &operator|=(T value) { HostWriteRegister(id, (T)(*this) | value); return *this; }
+  HostRegister &operator&=(T value) { HostWriteRegister(id, (T)(*this) & value); return *this; }
+  HostRegister &operator^=(T value) { HostWriteRegister(id, (T)(*this) ^ value); return *this; }
+private:
+  byte id;
+};
+
+extern HostRegister<uint8_t> PORTA, PORTB, PORTC, PORTD, PORTE, PORTF, PORTG, PORTH, PORTJ, PORTK, PORTL;
+extern HostRegister<uint8_t> DDRA, DDRB, DDRC, DDRD, DDRE, DDRF, DDRG, DDRH, DDRJ, DDRK, DDRL;
+extern HostRegister<uint8_t> PINA, PINB, PINC, PIND, PINE, PINF, PING, PINH, PINJ, PINK, PINL;
+extern HostRegister<uint8_t> TCCR1A, TCCR1B, TIMSK1, TIFR1;
+extern HostRegister<uint16_t> TCNT1, OCR1A, OCR1B;
+// Only the I bit (interrupts enabled) of the status register is kept
+extern HostRegister<uint8_t> SREG;
+
+#define CS10    0
+#define CS11    1
+#define CS12    2
+#define WGM12   3
+#define OCIE1A  1
+#define OCF1A   1
+
+#include "HardwareSerial.h"
+
+#endif
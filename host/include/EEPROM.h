@@ -0,0 +1,52 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - the ATmega2560's 4K of EEPROM, erased (0xFF) at startup
+// unless the host loads an image
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define HOST_EEPROM_SIZE  4096
+
+class EEPROMClass {
+public:
+  EEPROMClass() : writes(0) { memset(data, 0xFF, sizeof(data)); }
+
+  uint8_t read(int address) { return (address >= 0 && address < HOST_EEPROM_SIZE) ? data[address] : 0xFF; }
+  void write(int address, uint8_t value) {
+    if (address < 0 || address >= HOST_EEPROM_SIZE) return;
+    data[address] = value;
+    writes += 1;
+  }
+  void update(int address, uint8_t value) { if (read(address) != value) write(address, value); }
+  uint16_t length() { return HOST_EEPROM_SIZE; }
+
+  // Host side
+  uint8_t *HostData() { return data; }
+  unsigned long HostWrites() const { return writes; }
+
+private:
+  uint8_t data[HOST_EEPROM_SIZE];
+  unsigned long writes;
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,75 @@
+/**************************************************************************
+ *     This file is part of the RPU OS for Arduino Project.
+
+    RPU is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    RPU is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    See <https://www.gnu.org/licenses/>.
+ */
+
+// Host build - serial ports capture what's written to them (and can
+// echo it to a file), and hand out whatever the host queued as input.
+
+#ifndef HOST_HARDWARE_SERIAL_H
+#define HOST_HARDWARE_SERIAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string>
+#include "Stream.h"
+
+#define HOST_SERIAL_TX_BUFFER_SIZE  64
+
+class HardwareSerial : public Stream {
+public:
+  HardwareSerial() : echoFile(NULL), baudRate(0) {}
+
+  void begin(unsigned long baud) { baudRate = baud; }
+  void end() { baudRate = 0; }
+  operator bool() const { return true; }
+
+  size_t write(uint8_t value) override;
+  size_t write(const char *str);
+  size_t write(const uint8_t *buffer, size_t size) override;
+  size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+  size_t print(const char *str) { return write(str); }
+  size_t print(long value);
+  size_t println(const char *str) { return write(str) + write("\r\n"); }
+  size_t println(long value) { return print(value) + write("\r\n"); }
+  size_t println() { return write("\r\n"); }
+  // Output is captured instantly, so the transmit buffer is always empty
+  int availableForWrite() override { return HOST_SERIAL_TX_BUFFER_SIZE - 1; }
+  void flush() override {}
+
+  int available() override { return (int)(input.size() - inputPosition); }
+  int peek() override { return available() ? (uint8_t)input[inputPosition] : -1; }
+  int read() override { return available() ? (uint8_t)input[inputPosition++] : -1; }
+
+  // Host side
+  void HostQueueInput(const uint8_t *buffer, size_t size) { input.append((const char *)buffer, size); }
+  std::string HostTakeOutput() { std::string taken; taken.swap(output); return taken; }
+  const std::string &HostOutput() const { return output; }
+  void HostSetEcho(FILE *file) { echoFile = file; }
+
+private:
+  std::string output;
+  std::string input;
+  size_t inputPosition = 0;
+  FILE *echoFile;
+  unsigned long baudRate;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif
@@ -0,0 +1,55 @@
+#!/usr/bin/env python3
+# Host build - turns a sketch into C++ the way the Arduino builder does:
+# adds #include <Arduino.h> and a prototype for every function, ahead of
+# the first function definition (so they can be called before they're
+# defined), with #line directives so errors point into the sketch.
+#
+#   ino2cpp.py SpaceBattle2022.ino SpaceBattle2022.ino.cpp
+
+import re
+import sys
+
+FUNCTION_DEFINITION = re.compile(
+    r'^((?:[A-Za-z_][\w]*[ \t\*&]+)+?)([A-Za-z_]\w*)[ \t]*\(([^;{}()]*)\)[ \t\r\n]*\{', re.M)
+NOT_FUNCTIONS = ('if', 'while', 'for', 'switch', 'return', 'else', 'do', 'sizeof')
+
+
+def prototypes(source):
+    found = []
+    for match in FUNCTION_DEFINITION.finditer(source):
+        returnType, name, arguments = match.group(1).strip(), match.group(2), match.group(3)
+        if name in NOT_FUNCTIONS or returnType.split()[0] in NOT_FUNCTIONS:
+            continue
+        # Default values only belong on the first declaration
+        arguments = re.sub(r'\s*=\s*[^,]+', '', arguments)
+        found.append((match.start(), '%s %s(%s);' % (returnType, name, arguments)))
+    return found
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit('usage: ino2cpp.py <sketch.ino> <output.cpp>')
+    sketchPath, outputPath = sys.argv[1], sys.argv[2]
+    with open(sketchPath) as sketchFile:
+        source = sketchFile.read()
+
+    found = prototypes(source)
+    if not found:
+        sys.exit('%s: no functions found' % sketchPath)
+    # A declaration of a function that's only defined inside an #if
+    # that's off is harmless, so they all go in
+    firstFunction = found[0][0]
+    firstLine = source.count('\n', 0, firstFunction) + 1
+    sketchName = sketchPath.replace('\\', '/')
+
+    with open(outputPath, 'w') as outputFile:
+        outputFile.write('#include <Arduino.h>\n')
+        outputFile.write('#line 1 "%s"\n' % sketchName)
+        outputFile.write(source[:firstFunction])
+        outputFile.write('\n'.join(prototype for start, prototype in found) + '\n')
+        outputFile.write('#line %d "%s"\n' % (firstLine, sketchName))
+        outputFile.write(source[firstFunction:])
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+# Switch logs (see RPU_SetSwitchRecorder in RPU.h) - print one, build one
+# from text, or send one to a machine to replay.
+#
+#   switchlog.py dump LOG            one "ms switch [opened]" line per event
+#   switchlog.py build TEXT LOG      the reverse (times from the start)
+#
+# The switches closed when recording started go on a "closed" line
+# (e.g. "closed 8 20") ahead of the events.
+#   switchlog.py send LOG PORT [--speed N]
+#
+# send expects PORT set to SWITCH_LOG_BAUD already (stty -F PORT 115200
+# raw) and the machine powered on after it starts: it offers the header
+# until the machine echoes it, then sends each event a little before
+# it's due so the machine's small receive buffer never overflows.
+
+import argparse
+import os
+import select
+import struct
+import sys
+import time
+
+HEADER = b'RSW\x01'
+STATE_SIZE = 8
+RECORD_SIZE = 3
+OPENED_FLAG = 0x80
+GAP = 0xFF
+SEND_LEAD_SECONDS = 0.05
+
+
+def check(log):
+    if not log.startswith(HEADER) or len(log) < len(HEADER) + STATE_SIZE:
+        sys.exit('not a version %d switch log' % HEADER[3])
+
+
+def closedSwitches(log):
+    states = log[len(HEADER):len(HEADER) + STATE_SIZE]
+    return [switchNum for switchNum in range(STATE_SIZE * 8) if states[switchNum // 8] & (1 << (switchNum % 8))]
+
+
+def records(log):
+    for offset in range(len(HEADER) + STATE_SIZE, len(log) - RECORD_SIZE + 1, RECORD_SIZE):
+        event, elapsed = struct.unpack_from('<BH', log, offset)
+        yield event, elapsed, log[offset:offset + RECORD_SIZE]
+
+
+def dump(args):
+    with open(args.log, 'rb') as logFile:
+        log = logFile.read()
+    check(log)
+    print('closed %s' % ' '.join(str(switchNum) for switchNum in closedSwitches(log)))
+    logTime = 0
+    for event, elapsed, record in records(log):
+        logTime += elapsed
+        if event != GAP:
+            print('%d %d%s' % (logTime, event & ~OPENED_FLAG, ' opened' if event & OPENED_FLAG else ''))
+
+
+def build(args):
+    states = bytearray(STATE_SIZE)
+    events = bytearray()
+    lastTime = 0
+    with open(args.text) as textFile:
+        for line in textFile:
+            fields = line.split('#')[0].split()
+            if not fields:
+                continue
+            if fields[0] == 'closed':
+                for switchNum in map(int, fields[1:]):
+                    states[switchNum // 8] |= 1 << (switchNum % 8)
+                continue
+            eventTime, switchNum = int(fields[0]), int(fields[1])
+            if eventTime < lastTime or switchNum > 0x7F:
+                sys.exit('%s: bad event "%s"' % (args.text, line.strip()))
+            elapsed = eventTime - lastTime
+            lastTime = eventTime
+            while elapsed > 0xFFFF:
+                events += struct.pack('<BH', GAP, 0xFFFF)
+                elapsed -= 0xFFFF
+            opened = OPENED_FLAG if len(fields) > 2 and fields[2] == 'opened' else 0
+            events += struct.pack('<BH', switchNum | opened, elapsed)
+    with open(args.log, 'wb') as logFile:
+        logFile.write(HEADER + states + events)
+
+
+def send(args):
+    with open(args.log, 'rb') as logFile:
+        log = logFile.read()
+    check(log)
+    port = os.open(args.port, os.O_RDWR | os.O_NOCTTY)
+    received = b''
+    while HEADER not in received:
+        os.write(port, HEADER)
+        ready, _, _ = select.select([port], [], [], 0.2)
+        if ready:
+            received = (received + os.read(port, 64))[-64:]
+    os.write(port, log[len(HEADER):len(HEADER) + STATE_SIZE])
+    start = time.monotonic()
+    logTime = 0
+    for event, elapsed, record in records(log):
+        logTime += elapsed
+        wait = start + logTime / 1000.0 / args.speed - SEND_LEAD_SECONDS - time.monotonic()
+        if wait > 0:
+            time.sleep(wait)
+        os.write(port, record)
+    os.close(port)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Switch log tool')
+    commands = parser.add_subparsers(dest='command', required=True)
+    dumpCommand = commands.add_parser('dump')
+    dumpCommand.add_argument('log')
+    dumpCommand.set_defaults(run=dump)
+    buildCommand = commands.add_parser('build')
+    buildCommand.add_argument('text')
+    buildCommand.add_argument('log')
+    buildCommand.set_defaults(run=build)
+    sendCommand = commands.add_parser('send')
+    sendCommand.add_argument('log')
+    sendCommand.add_argument('port')
+    sendCommand.add_argument('--speed', type=int, default=1)
+    sendCommand.set_defaults(run=send)
+    args = parser.parse_args()
+    args.run(args)
+
+
+if __name__ == '__main__':
+    main()